@@ -1,39 +1,53 @@
 #version 450
 
-uniform mat4 m_model_view;
+// Variants are selected with the defines in ShaderFeature
 
-uniform vec3 lightPos;
-uniform vec4 lightColor;
-uniform vec4 modelColor;
+// Per-frame values shared by every program, see SceneRenderer::FrameUniforms
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 mvp_matrix;
+    mat4 m_model_view;
+    mat4 normalMatrix; // Upper 3x3 used
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 modelColor;
+};
+
+in vec3 fragPosition; // Eye space
 
+#ifndef FLAT
 in vec3 fragNormal;
-in vec3 fragVert;
+#endif
+
+#ifdef OCCLUSION
+in float fragOcclusion;
+#endif
 
 out vec4 finalColor;
 
 void main()
 {
-    mat3 normalMatrix = transpose(inverse(mat3(m_model_view)));
-    vec3 normal = normalize(normalMatrix * fragNormal);
-
-    //calculate the location of this fragment (pixel) in world coordinates
-    vec3 fragPosition = vec3(m_model_view * vec4(fragVert, 1));
-
-    //calculate the vector from this pixels surface to the light source
-    vec3 surfaceToLight = lightPos - fragPosition;
+#ifdef FLAT
+    // Face normal from the screen space derivatives of the position
+    vec3 normal = normalize(cross(dFdx(fragPosition), dFdy(fragPosition)));
+#else
+    vec3 normal = normalize(fragNormal);
+#endif
 
     //calculate the cosine of the angle of incidence
-    float brightness = dot(normal, surfaceToLight) / (length(surfaceToLight) * length(normal));
+    float brightness = dot(normal, normalize(lightPos.xyz - fragPosition));
+
+#ifdef TWO_SIDED
+    // Back faces are lit like front faces
     brightness = abs(brightness);
-    //brightness = clamp(brightness, 0., 1.);
-
-    //calculate final color of the pixel, based on:
-    // 1. The angle of incidence: brightness
-    // 2. The color/intensities of the light: light.intensities
-    // 3. The texture and texture coord: texture(tex, fragTexCoord)
-    vec4 surfaceColor = modelColor; //texture(tex, fragTexCoord);
-    //finalColor = vec4(brightness * lightColor * surfaceColor);
-    //finalColor.a = 1.;
-    finalColor = vec4(vec3(brightness * lightColor * surfaceColor), 1.);
-    //finalColor = vec4(1.0, 1.0, 1.0, 1.0);
+#else
+    brightness = max(brightness, 0.);
+#endif
+
+#ifdef OCCLUSION
+    // Baked ambient occlusion
+    brightness *= fragOcclusion;
+#endif
+
+    finalColor = vec4(vec3(brightness * lightColor * modelColor), 1.);
 }
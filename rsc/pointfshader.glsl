@@ -0,0 +1,26 @@
+#version 450
+
+// Per-frame values shared by every program, see SceneRenderer::FrameUniforms
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 mvp_matrix;
+    mat4 m_model_view;
+    mat4 normalMatrix; // Upper 3x3 used
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 modelColor;
+};
+
+out vec4 finalColor;
+
+void main()
+{
+    // Round points, darker towards the rim so overlapping points stay apart
+    vec2 d = gl_PointCoord * 2. - 1.;
+    float r = dot(d, d);
+    if (r > 1.)
+        discard;
+
+    float brightness = 1. - 0.4 * r;
+    finalColor = vec4(vec3(brightness * lightColor * modelColor), 1.);
+}
@@ -0,0 +1,22 @@
+#version 450
+
+// Per-frame values shared by every program, see SceneRenderer::FrameUniforms
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 mvp_matrix;
+    mat4 m_model_view;
+    mat4 normalMatrix; // Upper 3x3 used
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 modelColor;
+};
+
+uniform float pointSize;
+
+layout(location = 0) in vec3 vPos;
+
+void main()
+{
+    gl_Position = mvp_matrix * vec4(vPos, 1.);
+    gl_PointSize = pointSize;
+}
@@ -0,0 +1,12 @@
+#version 450
+
+uniform sampler2D frame;
+
+in vec2 fragTexCoord;
+
+out vec4 finalColor;
+
+void main()
+{
+    finalColor = texture(frame, fragTexCoord);
+}
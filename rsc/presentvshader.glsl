@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec2 vPos;
+
+uniform vec2 texCoordScale; // Part of the texture holding the frame
+
+out vec2 fragTexCoord;
+
+void main()
+{
+    // Full screen quad, texture coordinates follow the clip space corners
+    fragTexCoord = (vPos * 0.5 + 0.5) * texCoordScale;
+    gl_Position = vec4(vPos, 0., 1.);
+}
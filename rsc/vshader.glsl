@@ -1,17 +1,42 @@
 #version 450
 
-uniform mat4 mvp_matrix;
+// Variants are selected with the defines in ShaderFeature
 
-in vec3 vPos;
-in vec3 vNormal;
+// Per-frame values shared by every program, see SceneRenderer::FrameUniforms
+layout(std140, binding = 0) uniform FrameUniforms
+{
+    mat4 mvp_matrix;
+    mat4 m_model_view;
+    mat4 normalMatrix; // Upper 3x3 used
+    vec4 lightPos;
+    vec4 lightColor;
+    vec4 modelColor;
+};
+
+layout(location = 0) in vec3 vPos;
+out vec3 fragPosition; // Eye space
 
-out vec3 fragVert;
+#ifndef FLAT
+layout(location = 1) in vec3 vNormal;
 out vec3 fragNormal;
+#endif
+
+#ifdef OCCLUSION
+layout(location = 2) in float vOcclusion;
+out float fragOcclusion;
+#endif
 
 void main()
 {
-    fragVert = vec3(vPos);
-    fragNormal = vec3(vNormal);
+    fragPosition = vec3(m_model_view * vec4(vPos, 1.));
+
+#ifndef FLAT
+    fragNormal = mat3(normalMatrix) * vNormal;
+#endif
+
+#ifdef OCCLUSION
+    fragOcclusion = vOcclusion;
+#endif
 
     gl_Position = mvp_matrix * vec4(vPos, 1.);
 }
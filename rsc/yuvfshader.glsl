@@ -0,0 +1,51 @@
+#version 450
+
+uniform sampler2D frame;
+uniform vec2 texCoordScale; // Part of the texture holding the frame
+uniform vec2 size; // Of the Y plane, even
+
+out float value;
+
+// BT.601 limited range, what encoders assume for untagged YUV 4:2:0
+const vec3 yCoeffs = vec3(0.256788, 0.504129, 0.097906);
+const vec3 uCoeffs = vec3(-0.148223, -0.290993, 0.439216);
+const vec3 vCoeffs = vec3(0.439216, -0.367788, -0.071427);
+
+// Box filter over an output pixel of the given size in texture coordinates.
+// Four bilinear taps of 2x2 texels each cover up to 4x4 source pixels.
+vec3 average(vec2 center, vec2 footprint)
+{
+    vec2 offset = footprint * 0.25;
+    return (texture(frame, center + vec2(-offset.x, -offset.y)).rgb +
+        texture(frame, center + vec2(offset.x, -offset.y)).rgb +
+        texture(frame, center + vec2(-offset.x, offset.y)).rgb +
+        texture(frame, center + vec2(offset.x, offset.y)).rgb) * 0.25;
+}
+
+// Texture coordinates of pixel p in an image of the given size, top row first
+vec2 sourceCoord(vec2 p, vec2 imageSize)
+{
+    return vec2((p.x + 0.5) / imageSize.x, 1. - (p.y + 0.5) / imageSize.y) * texCoordScale;
+}
+
+void main()
+{
+    // Framebuffer rows are read back bottom row first, so row 0 comes out on top
+    vec2 p = floor(gl_FragCoord.xy);
+
+    if (p.y < size.y)
+    {
+        vec3 rgb = average(sourceCoord(p, size), texCoordScale / size);
+        value = dot(yCoeffs, rgb) + 16. / 255.;
+    }
+    else
+    {
+        // Each row below holds a row of U on the left and of V on the right
+        vec2 chromaSize = size * 0.5;
+        bool u = p.x < chromaSize.x;
+        vec2 c = vec2(u ? p.x : p.x - chromaSize.x, p.y - size.y);
+
+        vec3 rgb = average(sourceCoord(c, chromaSize), texCoordScale / chromaSize);
+        value = dot(u ? uCoeffs : vCoeffs, rgb) + 128. / 255.;
+    }
+}
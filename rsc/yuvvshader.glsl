@@ -0,0 +1,8 @@
+#version 450
+
+void main()
+{
+    // Full screen quad as a strip, no vertex buffer
+    vec2 pos = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2. - 1.;
+    gl_Position = vec4(pos, 0., 1.);
+}
@@ -0,0 +1,36 @@
+#include "debug/Stable.h"
+
+#include "AoBakeDialog.h"
+
+AoBakeDialog::AoBakeDialog(QWidget *parent, AoBaker* aoBaker) :
+    QWidget(parent),
+    baker(aoBaker)
+{
+    progress = new QProgressDialog("Baking ambient occlusion...", "Abort", 0, 200, this);
+    progress->setWindowModality(Qt::NonModal);
+    connect(progress, &QProgressDialog::canceled, this, &AoBakeDialog::cancel);
+
+    timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, &AoBakeDialog::update);
+    timer->start(25);
+}
+
+void AoBakeDialog::update()
+{
+    if (baker && !baker->isFinished())
+    {
+        progress->setMaximum(baker->getMaxProgress());
+        progress->setValue(baker->getProgress());
+        return;
+    }
+
+    timer->stop();
+    progress->reset();
+    deleteLater();
+}
+
+void AoBakeDialog::cancel()
+{
+    if (baker)
+        baker->cancel();
+}
@@ -0,0 +1,32 @@
+#ifndef AOBAKEDIALOG_H
+#define AOBAKEDIALOG_H
+
+#include "debug/Stable.h"
+
+#include <QPointer>
+#include <QProgressDialog>
+#include <QTimer>
+#include <QWidget>
+
+#include "AoBaker.h"
+
+// Non-modal progress of a background AO bake, closes itself when the bake ends
+// or the baker is deleted. The dialog only shows up if the bake takes a while.
+class AoBakeDialog : public QWidget
+{
+    Q_OBJECT
+
+public:
+    AoBakeDialog(QWidget*, AoBaker*);
+
+private:
+    QTimer* timer;
+    QProgressDialog* progress;
+    QPointer<AoBaker> baker;
+
+public slots:
+    void update();
+    void cancel();
+};
+
+#endif // AOBAKEDIALOG_H
@@ -0,0 +1,288 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#include "debug/Stable.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "AoBaker.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const quint32 cacheMagic = 0x31434f41; // "AOC1"
+
+    struct CacheHeader
+    {
+        quint32 magic;
+        quint32 sampleCount;
+        quint64 vertexCount;
+        quint64 indexCount;
+        qint64 sourceSize;
+        qint64 sourceTime;
+    };
+
+    // Occlusion radius relative to the model size
+    const float radiusScale = 0.1f;
+    const float biasScale = 1e-4f;
+
+    const float twoPi = 6.28318531f;
+
+    float radicalInverse(quint32 bits)
+    {
+        bits = (bits << 16) | (bits >> 16);
+        bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+        bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+        bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+        bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+        return bits * 2.3283064365386963e-10f;
+    }
+
+    quint32 hash(quint32 x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+}
+
+AoBaker::AoBaker(const Model* model, BvhBuilder* builder, QString modelFileName) :
+    QThread(),
+    m_model(model),
+    m_builder(builder),
+    m_modelFileName(modelFileName),
+    m_cacheFileName(modelFileName + ".ao"),
+    m_ready(false),
+    m_cancelled(false),
+    m_progress(0),
+    m_maxProgress((int)model->getVertices().size()),
+    m_builderFinished(false)
+{}
+
+bool AoBaker::isReady()
+{
+    return m_ready;
+}
+
+bool AoBaker::isCancelled()
+{
+    return m_cancelled;
+}
+
+int AoBaker::getProgress()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_progress;
+}
+
+int AoBaker::getMaxProgress()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_maxProgress;
+}
+
+const std::vector<float>& AoBaker::getOcclusion()
+{
+    return m_occlusion;
+}
+
+void AoBaker::cancel()
+{
+    QMutexLocker lck(&m_mutex);
+    m_cancelled = true;
+    m_wake.wakeAll();
+}
+
+void AoBaker::read(Model* mdl)
+{
+    if (m_ready)
+        mdl->setOcclusion(m_occlusion);
+}
+
+void AoBaker::run()
+{
+    if (readCache())
+    {
+        m_ready = true;
+        return;
+    }
+
+    const Bvh* bvh = &m_bvh;
+
+    if (m_builder)
+    {
+        // The viewport builds the same BVH for picking, share it
+        QMetaObject::Connection connection = connect(m_builder, &QThread::finished, [this]()
+        {
+            QMutexLocker lck(&m_mutex);
+            m_builderFinished = true;
+            m_wake.wakeAll();
+        });
+
+        {
+            QMutexLocker lck(&m_mutex);
+            while (!m_builderFinished && !m_builder->isFinished() && !m_cancelled)
+                m_wake.wait(&m_mutex);
+        }
+
+        disconnect(connection);
+
+        if (!m_builder->isReady())
+            return;
+
+        bvh = &m_builder->getBvh();
+    }
+    else if (!m_bvh.build(m_model->getVertices(), m_model->getIndices(), m_cancelled))
+        return;
+
+    if (!bake(*bvh))
+        return;
+
+    writeCache();
+    m_ready = true;
+}
+
+bool AoBaker::bake(const Bvh& bvh)
+{
+    int count = (int)m_model->getVertices().size();
+
+    BoundingBox bbox;
+    for (const Part& p : m_model->getParts())
+        bbox.extend(p.bbox);
+
+    float size = bbox.isEmpty() ? 1 : (bbox.max - bbox.min).length();
+    float radius = size * radiusScale;
+    float bias = size * biasScale;
+
+    // Cosine weighted hemisphere directions around +z from a Hammersley set
+    float dirs[sampleCount][3];
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        float u = (i + 0.5f) / sampleCount;
+        float phi = twoPi * radicalInverse(i);
+        float r = std::sqrt(u);
+        dirs[i][0] = r * std::cos(phi);
+        dirs[i][1] = r * std::sin(phi);
+        dirs[i][2] = std::sqrt(1 - u);
+    }
+
+    m_occlusion.assign(count, 1.f);
+
+    // Short parallelFor calls of one job per thread, the viewport's culling and the recorder get the pool in between
+    int chunks = (count + chunkSize - 1) / chunkSize;
+    int chunksPerCall = ThreadPool::instance()->getThreadCount() + 1;
+    for (int first = 0; first < chunks && !m_cancelled; first += chunksPerCall)
+    {
+        ThreadPool::instance()->parallelFor(std::min(chunksPerCall, chunks - first), [&](int job)
+        {
+            bakeChunk(bvh, first + job, dirs, radius, bias);
+        });
+    }
+
+    return !m_cancelled;
+}
+
+void AoBaker::bakeChunk(const Bvh& bvh, int chunk, const float (*dirs)[3], float radius, float bias)
+{
+    const std::vector<Vertex>& vertices = m_model->getVertices();
+    int count = (int)vertices.size();
+    int end = std::min(count, (chunk + 1) * chunkSize);
+
+    for (int i = chunk * chunkSize; i < end; ++i)
+    {
+        QVector3D n = vertices[i].norm;
+        if (n.lengthSquared() < 1e-12f)
+            continue;
+        n.normalize();
+
+        // Orthonormal basis around the normal
+        float sign = n.z() >= 0 ? 1.f : -1.f;
+        float a = -1 / (sign + n.z());
+        float b = n.x() * n.y() * a;
+        QVector3D t(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+        QVector3D s(b, sign + n.y() * n.y() * a, -n.y());
+
+        // Rotate the pattern per vertex so neighbours do not share the same banding
+        float angle = twoPi * (hash(i) * 2.3283064365386963e-10f);
+        float c = std::cos(angle), d = std::sin(angle);
+
+        Ray ray;
+        ray.origin = vertices[i].pos + n * bias;
+
+        int open = 0;
+        for (int k = 0; k < sampleCount; ++k)
+        {
+            float x = c * dirs[k][0] - d * dirs[k][1];
+            float y = d * dirs[k][0] + c * dirs[k][1];
+            ray.direction = t * x + s * y + n * dirs[k][2];
+
+            if (!bvh.occluded(ray, 0, radius))
+                ++open;
+        }
+
+        m_occlusion[i] = float(open) / sampleCount;
+    }
+
+    QMutexLocker lck(&m_mutex);
+    m_progress += end - chunk * chunkSize;
+}
+
+bool AoBaker::readCache()
+{
+    QFileInfo source(m_modelFileName);
+
+    std::ifstream in(m_cacheFileName.toStdString(), std::ios::in | std::ios::binary);
+    if (!in)
+        return false;
+
+    CacheHeader header;
+    in.read((char*)&header, sizeof(header));
+
+    // Stale if the model file or the baking parameters changed
+    if (!in || header.magic != cacheMagic || header.sampleCount != sampleCount ||
+        header.vertexCount != m_model->getVertices().size() || header.indexCount != m_model->getIndices().size() ||
+        header.sourceSize != source.size() || header.sourceTime != source.lastModified().toMSecsSinceEpoch())
+        return false;
+
+    m_occlusion.resize(header.vertexCount);
+    in.read((char*)m_occlusion.data(), m_occlusion.size() * sizeof(float));
+
+    if (!in)
+    {
+        m_occlusion.clear();
+        return false;
+    }
+
+    QMutexLocker lck(&m_mutex);
+    m_progress = m_maxProgress;
+    return true;
+}
+
+void AoBaker::writeCache()
+{
+    QFileInfo source(m_modelFileName);
+
+    std::ofstream out(m_cacheFileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write " << m_cacheFileName.toStdString() << std::endl;
+        return;
+    }
+
+    CacheHeader header;
+    header.magic = cacheMagic;
+    header.sampleCount = sampleCount;
+    header.vertexCount = m_model->getVertices().size();
+    header.indexCount = m_model->getIndices().size();
+    header.sourceSize = source.size();
+    header.sourceTime = source.lastModified().toMSecsSinceEpoch();
+
+    out.write((const char*)&header, sizeof(header));
+    out.write((const char*)m_occlusion.data(), m_occlusion.size() * sizeof(float));
+}
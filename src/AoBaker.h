@@ -0,0 +1,65 @@
+#ifndef AOBAKER_H
+#define AOBAKER_H
+
+#include <atomic>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "model.h"
+#include "Bvh.h"
+#include "BvhBuilder.h"
+
+// Bakes per-vertex ambient occlusion in the background by casting hemisphere
+// rays from every vertex on the thread pool. Progress is reported like ModelLoader.
+// Results are cached next to the model file and reused while the model is unchanged.
+// The model and the builder must outlive the baker, cancel() and wait() before deleting them.
+class AoBaker : public QThread
+{
+    Q_OBJECT
+
+public:
+    // Uses the BVH of builder once it is ready, builds its own if builder is null
+    AoBaker(const Model* model, BvhBuilder* builder, QString modelFileName);
+
+    bool isReady();
+    bool isCancelled();
+    int getProgress();
+    int getMaxProgress();
+    const std::vector<float>& getOcclusion();
+    void cancel();
+    void read(Model*);
+
+private:
+    static const int sampleCount = 32;
+    static const int chunkSize = 256; // Vertices per job, a few ms
+
+    void run() override;
+    bool bake(const Bvh& bvh);
+    void bakeChunk(const Bvh& bvh, int chunk, const float (*dirs)[3], float radius, float bias);
+    bool readCache();
+    void writeCache();
+
+    const Model* m_model;
+    BvhBuilder* m_builder;
+    QString m_modelFileName;
+    QString m_cacheFileName;
+
+    std::atomic<bool> m_ready;
+    std::atomic<bool> m_cancelled;
+    int m_progress;
+    int m_maxProgress;
+    QMutex m_mutex;
+    QWaitCondition m_wake; // The builder finished or the bake was cancelled
+    bool m_builderFinished; // Guarded by m_mutex
+
+    Bvh m_bvh;
+    std::vector<float> m_occlusion;
+};
+
+#endif // AOBAKER_H
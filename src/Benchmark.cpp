@@ -0,0 +1,253 @@
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+#include "debug/Stable.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLTimerQuery>
+
+#include "Benchmark.h"
+#include "OffscreenRenderer.h"
+#include "CameraPath.h"
+#include "Profiler.h"
+
+Benchmark::Benchmark(const BenchmarkSettings& settings) :
+    m_settings(settings)
+{}
+
+bool Benchmark::exec()
+{
+    OffscreenRenderer renderer(m_settings.width, m_settings.height);
+    if (!renderer.initialize())
+        return false;
+
+    renderer.setOcclusionCulling(m_settings.occlusionCulling);
+
+    if (!renderer.loadModel(m_settings.modelFileName))
+    {
+        qDebug() << "Benchmark: cannot load" << m_settings.modelFileName;
+        return false;
+    }
+
+    Camera camera;
+    CameraPath path;
+
+    if (m_settings.cameraPathFileName.isEmpty())
+        path = CameraPath::turntable(camera, m_settings.duration > 0 ? m_settings.duration : 10);
+    else if (!path.load(m_settings.cameraPathFileName))
+        return false;
+
+    double duration = m_settings.duration > 0 ? m_settings.duration : path.getDuration();
+    int frameCount = std::max(1, (int)std::lround(duration * m_settings.fps));
+
+    renderer.makeCurrent();
+
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+    QString rendererName = QString("%1, %2").arg((const char*)f->glGetString(GL_RENDERER)).arg((const char*)f->glGetString(GL_VERSION));
+    qDebug() << "Benchmark:" << rendererName;
+
+    // Shader builds, uploads and first-use costs stay out of the timings
+    for (int i = 0; i < m_settings.warmupFrames; ++i)
+    {
+        path.apply(double(i) / m_settings.fps, camera);
+        if (!renderer.draw(camera))
+        {
+            renderer.doneCurrent();
+            return false;
+        }
+    }
+
+    f->glFinish();
+    Profiler::instance()->reset();
+
+    // One query per frame in flight, recycled once its result is read
+    std::vector<QOpenGLTimerQuery*> freeQueries;
+    std::deque<std::pair<int, QOpenGLTimerQuery*>> pending;
+    bool timerQueries = true;
+
+    std::vector<Frame> frames(frameCount);
+    bool ok = true;
+
+    for (int i = 0; i < frameCount; ++i)
+    {
+        Frame& frame = frames[i];
+        frame.time = double(i) / m_settings.fps;
+        frame.gpu = -1;
+
+        path.apply(frame.time, camera);
+
+        QOpenGLTimerQuery* query = nullptr;
+        if (timerQueries)
+        {
+            if (freeQueries.empty())
+            {
+                query = new QOpenGLTimerQuery();
+                timerQueries = query->create();
+                if (!timerQueries)
+                {
+                    qDebug() << "Benchmark: no timer queries, GPU times are not reported";
+                    delete query;
+                    query = nullptr;
+                }
+            }
+            else
+            {
+                query = freeQueries.back();
+                freeQueries.pop_back();
+            }
+        }
+
+        QElapsedTimer timer;
+        timer.start();
+
+        if (query)
+            query->begin();
+
+        ok = renderer.draw(camera);
+
+        if (query)
+        {
+            query->end();
+            pending.push_back(std::make_pair(i, query));
+        }
+
+        if (!ok)
+            break;
+
+        frame.cpu = timer.nsecsElapsed() / 1e6;
+
+        FrameStats stats = renderer.getFrameStats();
+        frame.partsDrawn = stats.partsDrawn;
+        frame.trianglesDrawn = stats.trianglesDrawn;
+        frame.pointsDrawn = stats.pointsDrawn;
+
+        // Only results that are already there, the CPU never waits for the GPU
+        while (!pending.empty() && pending.front().second->isResultAvailable())
+        {
+            frames[pending.front().first].gpu = pending.front().second->waitForResult() / 1e6;
+            freeQueries.push_back(pending.front().second);
+            pending.pop_front();
+        }
+    }
+
+    for (const auto& p : pending)
+    {
+        frames[p.first].gpu = p.second->waitForResult() / 1e6;
+        freeQueries.push_back(p.second);
+    }
+
+    for (QOpenGLTimerQuery* query : freeQueries)
+    {
+        query->destroy();
+        delete query;
+    }
+
+    renderer.doneCurrent();
+
+    return ok && writeReport(frames, rendererName);
+}
+
+QJsonObject Benchmark::summarize(std::vector<double> samples)
+{
+    QJsonObject summary;
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double s : samples)
+        sum += s;
+
+    auto percentile = [&samples](double p)
+    {
+        return samples[std::min(samples.size() - 1, (size_t)(p * samples.size()))];
+    };
+
+    summary["average"] = sum / samples.size();
+    summary["min"] = samples.front();
+    summary["median"] = percentile(0.5);
+    summary["p95"] = percentile(0.95);
+    summary["p99"] = percentile(0.99);
+    summary["max"] = samples.back();
+    return summary;
+}
+
+bool Benchmark::writeReport(const std::vector<Frame>& frames, QString rendererName)
+{
+    QJsonArray frameArray;
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        const Frame& frame = frames[i];
+
+        QJsonObject o;
+        o["frame"] = (int)i;
+        o["time"] = frame.time;
+        o["cpu"] = frame.cpu;
+        o["gpu"] = frame.gpu >= 0 ? QJsonValue(frame.gpu) : QJsonValue();
+        o["partsDrawn"] = frame.partsDrawn;
+        o["trianglesDrawn"] = frame.trianglesDrawn;
+        o["pointsDrawn"] = frame.pointsDrawn;
+        frameArray.append(o);
+
+        cpuTimes.push_back(frame.cpu);
+        if (frame.gpu >= 0)
+            gpuTimes.push_back(frame.gpu);
+    }
+
+    QJsonObject summary;
+    summary["frames"] = (int)frames.size();
+    summary["cpu"] = summarize(cpuTimes);
+    summary["gpu"] = summarize(gpuTimes);
+
+    // CPU stages inside the frame, over the last frames only
+    QJsonArray stages;
+    for (const ProfileStats& s : Profiler::instance()->getStats())
+    {
+        QJsonObject o;
+        o["stage"] = s.stage;
+        o["average"] = s.average;
+        o["p95"] = s.p95;
+        o["max"] = s.max;
+        stages.append(o);
+    }
+
+    QJsonObject report;
+    report["model"] = m_settings.modelFileName;
+    report["cameraPath"] = m_settings.cameraPathFileName;
+    report["renderer"] = rendererName;
+    report["width"] = m_settings.width;
+    report["height"] = m_settings.height;
+    report["fps"] = m_settings.fps;
+    report["warmupFrames"] = m_settings.warmupFrames;
+    report["occlusionCulling"] = m_settings.occlusionCulling;
+    report["summary"] = summary;
+    report["stages"] = stages;
+    report["frames"] = frameArray;
+
+    for (const char* clock : { "cpu", "gpu" })
+    {
+        QJsonObject s = summary[clock].toObject();
+        if (!s.isEmpty())
+            qDebug() << "Benchmark:" << clock << "avg" << s["average"].toDouble() << "ms, median" << s["median"].toDouble()
+                     << "ms, p95" << s["p95"].toDouble() << "ms, max" << s["max"].toDouble() << "ms";
+    }
+
+    QFile file(m_settings.reportFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Benchmark: cannot write" << m_settings.reportFileName;
+        return false;
+    }
+
+    file.write(QJsonDocument(report).toJson());
+    return true;
+}
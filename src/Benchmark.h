@@ -0,0 +1,52 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QJsonObject>
+
+struct BenchmarkSettings
+{
+    QString modelFileName;
+    QString cameraPathFileName; // Empty for a turntable
+    QString reportFileName; // JSON
+    int width;
+    int height;
+    int fps; // Fixed timestep of the camera path
+    double duration; // Seconds, 0 to use the camera path duration
+    int warmupFrames; // Rendered before timing starts
+    bool occlusionCulling;
+};
+
+// Plays a camera path offscreen at a fixed timestep and times every frame.
+// CPU time covers culling and command submission, GPU time comes from timer queries.
+// Nothing depends on the wall clock or input, so runs compare across builds,
+// with --software-gl on any machine.
+class Benchmark
+{
+public:
+    explicit Benchmark(const BenchmarkSettings&);
+
+    bool exec();
+
+private:
+    struct Frame
+    {
+        double time; // Camera path time, seconds
+        double cpu; // ms
+        double gpu; // ms, -1 without timer queries
+        int partsDrawn;
+        int trianglesDrawn;
+        int pointsDrawn;
+    };
+
+    static QJsonObject summarize(std::vector<double> samples);
+    bool writeReport(const std::vector<Frame>& frames, QString rendererName);
+
+    BenchmarkSettings m_settings;
+};
+
+#endif // BENCHMARK_H
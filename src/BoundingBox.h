@@ -0,0 +1,75 @@
+#ifndef BOUNDINGBOX_H
+#define BOUNDINGBOX_H
+
+#include <cfloat>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+struct BoundingBox
+{
+    QVector3D min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+    QVector3D max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+    bool isEmpty() const
+    {
+        return min.x() > max.x() || min.y() > max.y() || min.z() > max.z();
+    }
+
+    void extend(const QVector3D& p)
+    {
+        min = QVector3D(qMin(min.x(), p.x()), qMin(min.y(), p.y()), qMin(min.z(), p.z()));
+        max = QVector3D(qMax(max.x(), p.x()), qMax(max.y(), p.y()), qMax(max.z(), p.z()));
+    }
+
+    void extend(const BoundingBox& b)
+    {
+        if (b.isEmpty())
+            return;
+
+        extend(b.min);
+        extend(b.max);
+    }
+
+    QVector3D center() const
+    {
+        return (min + max) * 0.5f;
+    }
+
+    QVector3D size() const
+    {
+        return max - min;
+    }
+
+    QVector3D corner(int i) const
+    {
+        return QVector3D(i & 1 ? max.x() : min.x(), i & 2 ? max.y() : min.y(), i & 4 ? max.z() : min.z());
+    }
+
+    // False only if all corners are beyond one clip plane
+    bool intersectsFrustum(const QMatrix4x4& mvp) const
+    {
+        int outside[6] = { 0, 0, 0, 0, 0, 0 };
+
+        for (int i = 0; i < 8; ++i)
+        {
+            QVector4D p = mvp * QVector4D(corner(i), 1);
+
+            outside[0] += p.x() < -p.w();
+            outside[1] += p.x() > p.w();
+            outside[2] += p.y() < -p.w();
+            outside[3] += p.y() > p.w();
+            outside[4] += p.z() < -p.w();
+            outside[5] += p.z() > p.w();
+        }
+
+        for (int k = 0; k < 6; ++k)
+            if (outside[k] == 8)
+                return false;
+
+        return true;
+    }
+};
+
+#endif // BOUNDINGBOX_H
@@ -0,0 +1,648 @@
+#include <algorithm>
+#include <cmath>
+
+#include <emmintrin.h>
+
+#include "debug/Stable.h"
+
+#include "Bvh.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const int chunkSize = 1 << 14; // Triangles per parallel binning job
+    const int chunksPerCall = 256; // Keeps each parallelFor short so the viewport's culling is not held up
+
+    // Runs fn(begin, end) over [0, count) in chunks, in several short parallelFor calls
+    template <typename Fn>
+    bool parallelChunks(int count, const std::atomic<bool>& cancelled, Fn fn)
+    {
+        int chunkCount = (count + chunkSize - 1) / chunkSize;
+
+        for (int first = 0; first < chunkCount; first += chunksPerCall)
+        {
+            if (cancelled)
+                return false;
+
+            ThreadPool::instance()->parallelFor(std::min(chunksPerCall, chunkCount - first), [&](int i)
+            {
+                int begin = (first + i) * chunkSize;
+                fn(first + i, begin, std::min(begin + chunkSize, count));
+            });
+        }
+
+        return true;
+    }
+
+    // Slab test of one box, min and max point to three floats followed by one more readable float
+    inline bool intersectBox(const float* min, const float* max, __m128 origin, __m128 invDir, float tMin, float tMax, float& tNear)
+    {
+        __m128 a = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(min), origin), invDir);
+        __m128 b = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(max), origin), invDir);
+        __m128 lo = _mm_min_ps(a, b);
+        __m128 hi = _mm_max_ps(a, b);
+
+        // Reduce lanes 0..2, lane 3 holds whatever follows the box
+        lo = _mm_max_ss(_mm_max_ss(lo, _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(lo, lo, _MM_SHUFFLE(2, 2, 2, 2)));
+        hi = _mm_min_ss(_mm_min_ss(hi, _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(hi, hi, _MM_SHUFFLE(2, 2, 2, 2)));
+
+        tNear = std::max(_mm_cvtss_f32(lo), tMin);
+        return tNear <= std::min(_mm_cvtss_f32(hi), tMax);
+    }
+}
+
+void Bvh::Bounds::reset()
+{
+    _mm_storeu_ps(min, _mm_set1_ps(FLT_MAX));
+    _mm_storeu_ps(max, _mm_set1_ps(-FLT_MAX));
+}
+
+void Bvh::Bounds::set(__m128 min4, __m128 max4)
+{
+    _mm_storeu_ps(min, min4);
+    _mm_storeu_ps(max, max4);
+}
+
+void Bvh::Bounds::extend(const Bounds& b)
+{
+    _mm_storeu_ps(min, _mm_min_ps(_mm_loadu_ps(min), _mm_loadu_ps(b.min)));
+    _mm_storeu_ps(max, _mm_max_ps(_mm_loadu_ps(max), _mm_loadu_ps(b.max)));
+}
+
+float Bvh::Bounds::area() const
+{
+    float x = max[0] - min[0], y = max[1] - min[1], z = max[2] - min[2];
+    return x < 0 ? 0 : x * y + y * z + z * x;
+}
+
+Bvh::Bvh() :
+    m_vertices(nullptr),
+    m_indices(nullptr),
+    m_depth(0)
+{}
+
+bool Bvh::isEmpty() const
+{
+    return m_nodes.empty();
+}
+
+int Bvh::binsFor(int count)
+{
+    // Small nodes do not need all the candidate planes
+    return count < binCount ? std::max(count, 2) : int(binCount);
+}
+
+void Bvh::triangleBounds(int triangle, __m128& min, __m128& max) const
+{
+    const QVector3D& p0 = m_vertices[m_indices[triangle * 3]].pos;
+    const QVector3D& p1 = m_vertices[m_indices[triangle * 3 + 1]].pos;
+    const QVector3D& p2 = m_vertices[m_indices[triangle * 3 + 2]].pos;
+
+    __m128 v0 = _mm_setr_ps(p0.x(), p0.y(), p0.z(), 0);
+    __m128 v1 = _mm_setr_ps(p1.x(), p1.y(), p1.z(), 0);
+    __m128 v2 = _mm_setr_ps(p2.x(), p2.y(), p2.z(), 0);
+
+    min = _mm_min_ps(_mm_min_ps(v0, v1), v2);
+    max = _mm_max_ps(_mm_max_ps(v0, v1), v2);
+}
+
+void Bvh::binTriangles(const BuildTask& task, int first, int count, Bin bins[3][binCount]) const
+{
+    int n = binsFor(task.count);
+
+    for (int a = 0; a < 3; ++a)
+    {
+        for (int b = 0; b < n; ++b)
+        {
+            bins[a][b].bounds.reset();
+            bins[a][b].centroids.reset();
+            bins[a][b].count = 0;
+        }
+    }
+
+    __m128 origin = _mm_loadu_ps(task.centroids.min);
+    __m128 extent = _mm_sub_ps(_mm_loadu_ps(task.centroids.max), origin);
+    __m128 scale = _mm_and_ps(_mm_div_ps(_mm_set1_ps(n * 0.99999f), extent), _mm_cmpgt_ps(extent, _mm_setzero_ps()));
+
+    for (int i = first; i < first + count; ++i)
+    {
+        // Lane 3 of min holds the triangle id, it is never looked at
+        __m128 min = _mm_loadu_ps(m_references[i].min);
+        __m128 max = _mm_loadu_ps(m_references[i].max);
+        __m128 c = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+
+        alignas(16) int bin[4];
+        _mm_store_si128((__m128i*)bin, _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(c, origin), scale)));
+
+        for (int a = 0; a < 3; ++a)
+        {
+            Bin& b = bins[a][std::min(n - 1, bin[a])];
+            b.bounds.set(_mm_min_ps(_mm_loadu_ps(b.bounds.min), min), _mm_max_ps(_mm_loadu_ps(b.bounds.max), max));
+            b.centroids.set(_mm_min_ps(_mm_loadu_ps(b.centroids.min), c), _mm_max_ps(_mm_loadu_ps(b.centroids.max), c));
+            ++b.count;
+        }
+    }
+}
+
+bool Bvh::findSplit(const BuildTask& task, Bin bins[3][binCount], Split& split) const
+{
+    int n = binsFor(task.count);
+    float bestCost = FLT_MAX;
+
+    for (int a = 0; a < 3; ++a)
+    {
+        if (task.centroids.max[a] <= task.centroids.min[a])
+            continue;
+
+        // Sweep from the right to get the right side areas and counts of every plane
+        float rightArea[binCount];
+        int rightCount[binCount];
+        Bounds b;
+        b.reset();
+        int count = 0;
+        for (int i = n - 1; i > 0; --i)
+        {
+            b.extend(bins[a][i].bounds);
+            count += bins[a][i].count;
+            rightArea[i] = b.area();
+            rightCount[i] = count;
+        }
+
+        b.reset();
+        count = 0;
+        for (int i = 1; i < n; ++i)
+        {
+            b.extend(bins[a][i - 1].bounds);
+            count += bins[a][i - 1].count;
+
+            if (count == 0 || rightCount[i] == 0)
+                continue;
+
+            float cost = b.area() * count + rightArea[i] * rightCount[i];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                split.axis = a;
+                split.bin = i;
+                split.leftCount = count;
+            }
+        }
+    }
+
+    if (bestCost == FLT_MAX)
+        return false;
+
+    split.left.reset();
+    split.right.reset();
+    split.leftCentroids.reset();
+    split.rightCentroids.reset();
+
+    for (int i = 0; i < n; ++i)
+    {
+        const Bin& bin = bins[split.axis][i];
+        (i < split.bin ? split.left : split.right).extend(bin.bounds);
+        (i < split.bin ? split.leftCentroids : split.rightCentroids).extend(bin.centroids);
+    }
+
+    return true;
+}
+
+int Bvh::partition(const BuildTask& task, const Split& split)
+{
+    int a = split.axis;
+    int n = binsFor(task.count);
+    float extent = task.centroids.max[a] - task.centroids.min[a];
+    float scale = n * 0.99999f / extent;
+
+    // Same bin computation as binTriangles, so the sides match the bins
+    auto mid = std::partition(m_references.begin() + task.first, m_references.begin() + task.first + task.count, [&](const Reference& r)
+    {
+        float c = (r.min[a] + r.max[a]) * 0.5f;
+        return std::min(n - 1, (int)((c - task.centroids.min[a]) * scale)) < split.bin;
+    });
+
+    return int(mid - m_references.begin()) - task.first;
+}
+
+void Bvh::halve(const BuildTask& task, BuildTask& left, BuildTask& right) const
+{
+    // All centroids coincide, any split is as good as another
+    left.first = task.first;
+    left.count = task.count / 2;
+    right.first = task.first + left.count;
+    right.count = task.count - left.count;
+
+    for (BuildTask* t : { &left, &right })
+    {
+        t->bounds.reset();
+        for (int i = t->first; i < t->first + t->count; ++i)
+            t->bounds.set(_mm_min_ps(_mm_loadu_ps(t->bounds.min), _mm_loadu_ps(m_references[i].min)),
+                          _mm_max_ps(_mm_loadu_ps(t->bounds.max), _mm_loadu_ps(m_references[i].max)));
+        t->centroids = task.centroids;
+    }
+}
+
+void Bvh::setNode(Node& node, const BuildTask& task, bool leaf, int firstChild)
+{
+    std::copy(task.bounds.min, task.bounds.min + 3, node.min);
+    std::copy(task.bounds.max, task.bounds.max + 3, node.max);
+    node.leftFirst = leaf ? task.first : firstChild;
+    node.count = leaf ? task.count : 0;
+}
+
+void Bvh::buildSubtree(BuildTask root, std::vector<Node>& nodes)
+{
+    Bin bins[3][binCount];
+
+    std::vector<std::pair<int, BuildTask>> stack;
+    nodes.push_back(Node());
+    stack.push_back(std::make_pair(0, root));
+
+    while (!stack.empty())
+    {
+        int index = stack.back().first;
+        BuildTask task = stack.back().second;
+        stack.pop_back();
+
+        if (task.count <= maxLeafSize)
+        {
+            setNode(nodes[index], task, true);
+            continue;
+        }
+
+        BuildTask left, right;
+
+        Split split;
+        binTriangles(task, task.first, task.count, bins);
+        if (findSplit(task, bins, split))
+        {
+            left = { 0, task.first, partition(task, split), split.left, split.leftCentroids };
+            right = { 0, task.first + left.count, task.count - left.count, split.right, split.rightCentroids };
+        }
+        else
+            halve(task, left, right);
+
+        int child = (int)nodes.size();
+        setNode(nodes[index], task, false, child);
+
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        stack.push_back(std::make_pair(child, left));
+        stack.push_back(std::make_pair(child + 1, right));
+    }
+}
+
+bool Bvh::build(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::atomic<bool>& cancelled)
+{
+    m_vertices = vertices.data();
+    m_indices = indices.data();
+    m_nodes.clear();
+    m_triangles.clear();
+    m_depth = 0;
+
+    int triangleCount = (int)indices.size() / 3;
+    if (triangleCount == 0)
+        return true;
+
+    // Triangle bounds, root bounds and centroid bounds
+    m_references.resize(triangleCount);
+    std::vector<Bounds> chunkBounds((triangleCount + chunkSize - 1) / chunkSize);
+    std::vector<Bounds> chunkCentroids(chunkBounds.size());
+
+    bool done = parallelChunks(triangleCount, cancelled, [&](int chunk, int begin, int end)
+    {
+        __m128 boundsMin = _mm_set1_ps(FLT_MAX), boundsMax = _mm_set1_ps(-FLT_MAX);
+        __m128 centroidsMin = boundsMin, centroidsMax = boundsMax;
+
+        for (int i = begin; i < end; ++i)
+        {
+            __m128 min, max;
+            triangleBounds(i, min, max);
+
+            __m128 c = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+
+            Reference& r = m_references[i];
+            _mm_storeu_ps(r.min, min);
+            _mm_storeu_ps(r.max, max);
+            r.triangle = i;
+
+            boundsMin = _mm_min_ps(boundsMin, min);
+            boundsMax = _mm_max_ps(boundsMax, max);
+            centroidsMin = _mm_min_ps(centroidsMin, c);
+            centroidsMax = _mm_max_ps(centroidsMax, c);
+        }
+
+        chunkBounds[chunk].set(boundsMin, boundsMax);
+        chunkCentroids[chunk].set(centroidsMin, centroidsMax);
+    });
+
+    if (!done)
+        return false;
+
+    BuildTask root = { 0, 0, triangleCount, Bounds(), Bounds() };
+    root.bounds.reset();
+    root.centroids.reset();
+    for (size_t i = 0; i < chunkBounds.size(); ++i)
+    {
+        root.bounds.extend(chunkBounds[i]);
+        root.centroids.extend(chunkCentroids[i]);
+    }
+
+    m_nodes.push_back(Node());
+
+    // Split big nodes with parallel binning until they are small enough for one thread
+    std::vector<BuildTask> stack(1, root);
+    std::vector<BuildTask> subtrees;
+    std::vector<Bin> chunkBins;
+
+    while (!stack.empty())
+    {
+        BuildTask task = stack.back();
+        stack.pop_back();
+
+        if (task.count <= parallelThreshold)
+        {
+            subtrees.push_back(task);
+            continue;
+        }
+
+        int chunkCount = (task.count + chunkSize - 1) / chunkSize;
+        chunkBins.resize((size_t)chunkCount * 3 * binCount);
+
+        done = parallelChunks(task.count, cancelled, [&](int chunk, int begin, int end)
+        {
+            binTriangles(task, task.first + begin, end - begin, (Bin(*)[binCount])&chunkBins[(size_t)chunk * 3 * binCount]);
+        });
+
+        if (!done)
+            return false;
+
+        Bin bins[3][binCount];
+        for (int a = 0; a < 3; ++a)
+        {
+            for (int b = 0; b < binCount; ++b)
+            {
+                bins[a][b] = chunkBins[a * binCount + b];
+                for (int chunk = 1; chunk < chunkCount; ++chunk)
+                {
+                    const Bin& bin = chunkBins[((size_t)chunk * 3 + a) * binCount + b];
+                    bins[a][b].bounds.extend(bin.bounds);
+                    bins[a][b].centroids.extend(bin.centroids);
+                    bins[a][b].count += bin.count;
+                }
+            }
+        }
+
+        Split split;
+        if (!findSplit(task, bins, split))
+        {
+            // Degenerate centroids, the serial builder halves the range
+            subtrees.push_back(task);
+            continue;
+        }
+
+        int child = (int)m_nodes.size();
+        BuildTask left = { child, task.first, partition(task, split), split.left, split.leftCentroids };
+        BuildTask right = { child + 1, task.first + left.count, task.count - left.count, split.right, split.rightCentroids };
+
+        setNode(m_nodes[task.node], task, false, child);
+        m_nodes.push_back(Node());
+        m_nodes.push_back(Node());
+
+        stack.push_back(left);
+        stack.push_back(right);
+    }
+
+    // Build the subtrees a few at a time and splice them into the node array
+    int batch = 2 * (ThreadPool::instance()->getThreadCount() + 1);
+    std::vector<std::vector<Node>> local(batch);
+
+    for (int first = 0; first < (int)subtrees.size(); first += batch)
+    {
+        if (cancelled)
+            return false;
+
+        int count = std::min(batch, (int)subtrees.size() - first);
+
+        ThreadPool::instance()->parallelFor(count, [&](int i)
+        {
+            local[i].clear();
+            buildSubtree(subtrees[first + i], local[i]);
+        });
+
+        for (int i = 0; i < count; ++i)
+        {
+            // Local node j > 0 moves to offset + j
+            int offset = (int)m_nodes.size() - 1;
+
+            for (Node& node : local[i])
+            {
+                if (node.count == 0)
+                    node.leftFirst += offset;
+            }
+
+            m_nodes[subtrees[first + i].node] = local[i][0];
+            m_nodes.insert(m_nodes.end(), local[i].begin() + 1, local[i].end());
+        }
+    }
+
+    m_triangles.resize(triangleCount);
+    for (int i = 0; i < triangleCount; ++i)
+        m_triangles[i] = m_references[i].triangle;
+
+    std::vector<Reference>().swap(m_references);
+    m_depth = treeDepth();
+    return true;
+}
+
+int Bvh::treeDepth() const
+{
+    int depth = 0;
+    std::vector<std::pair<int, int>> stack(1, std::make_pair(0, 0));
+
+    while (!stack.empty())
+    {
+        const Node& node = m_nodes[stack.back().first];
+        int nodeDepth = stack.back().second;
+        stack.pop_back();
+
+        if (node.count > 0)
+        {
+            depth = std::max(depth, nodeDepth);
+            continue;
+        }
+
+        stack.push_back(std::make_pair(node.leftFirst, nodeDepth + 1));
+        stack.push_back(std::make_pair(node.leftFirst + 1, nodeDepth + 1));
+    }
+
+    return depth;
+}
+
+bool Bvh::intersect(const Ray& ray, RayHit& hit, float tMin, float tMax) const
+{
+    return traverse(ray, hit, tMin, tMax, false);
+}
+
+bool Bvh::occluded(const Ray& ray, float tMin, float tMax) const
+{
+    RayHit hit;
+    return traverse(ray, hit, tMin, tMax, true);
+}
+
+bool Bvh::traverse(const Ray& ray, RayHit& hit, float tMin, float tMax, bool anyHit) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    // Avoid 0 * inf in the slab test for axis aligned rays
+    float d[3] = { ray.direction.x(), ray.direction.y(), ray.direction.z() };
+    for (int a = 0; a < 3; ++a)
+        if (std::fabs(d[a]) < 1e-20f)
+            d[a] = d[a] < 0 ? -1e-20f : 1e-20f;
+
+    __m128 origin = _mm_setr_ps(ray.origin.x(), ray.origin.y(), ray.origin.z(), 0);
+    __m128 invDir = _mm_setr_ps(1 / d[0], 1 / d[1], 1 / d[2], 0);
+
+    __m128 ox = _mm_set1_ps(ray.origin.x()), oy = _mm_set1_ps(ray.origin.y()), oz = _mm_set1_ps(ray.origin.z());
+    __m128 dx = _mm_set1_ps(ray.direction.x()), dy = _mm_set1_ps(ray.direction.y()), dz = _mm_set1_ps(ray.direction.z());
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), epsilon = _mm_set1_ps(1e-12f);
+
+    hit.triangle = -1;
+    hit.t = tMax;
+
+    // Deferred far children with their entry distance, at most one per interior node on the path
+    int localStack[traversalStackSize];
+    float localStackNear[traversalStackSize];
+    std::vector<int> heapStack;
+    std::vector<float> heapStackNear;
+    int* stack = localStack;
+    float* stackNear = localStackNear;
+
+    if (m_depth > traversalStackSize)
+    {
+        heapStack.resize(m_depth);
+        heapStackNear.resize(m_depth);
+        stack = heapStack.data();
+        stackNear = heapStackNear.data();
+    }
+
+    int stackSize = 0;
+    int index = 0;
+
+    float tNear;
+    if (!intersectBox(m_nodes[0].min, m_nodes[0].max, origin, invDir, tMin, hit.t, tNear))
+        return false;
+
+    for (;;)
+    {
+        const Node& node = m_nodes[index];
+
+        if (node.count > 0)
+        {
+            // Four triangles at once, Moller-Trumbore in SoA form
+            alignas(16) float v[9][4];
+            int ids[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                int triangle = m_triangles[node.leftFirst + std::min(k, node.count - 1)];
+                ids[k] = triangle;
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    const QVector3D& p = m_vertices[m_indices[triangle * 3 + c]].pos;
+                    v[c * 3][k] = p.x();
+                    v[c * 3 + 1][k] = p.y();
+                    v[c * 3 + 2][k] = p.z();
+                }
+            }
+
+            __m128 v0x = _mm_load_ps(v[0]), v0y = _mm_load_ps(v[1]), v0z = _mm_load_ps(v[2]);
+            __m128 e1x = _mm_sub_ps(_mm_load_ps(v[3]), v0x), e1y = _mm_sub_ps(_mm_load_ps(v[4]), v0y), e1z = _mm_sub_ps(_mm_load_ps(v[5]), v0z);
+            __m128 e2x = _mm_sub_ps(_mm_load_ps(v[6]), v0x), e2y = _mm_sub_ps(_mm_load_ps(v[7]), v0y), e2z = _mm_sub_ps(_mm_load_ps(v[8]), v0z);
+
+            // p = d x e2
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+            __m128 invDet = _mm_div_ps(one, det);
+
+            __m128 tx = _mm_sub_ps(ox, v0x), ty = _mm_sub_ps(oy, v0y), tz = _mm_sub_ps(oz, v0z);
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+            // q = t x e1
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+            __m128 w = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+            __m128 absDet = _mm_max_ps(det, _mm_sub_ps(zero, det));
+            __m128 mask = _mm_cmpgt_ps(absDet, epsilon);
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+            mask = _mm_and_ps(mask, _mm_cmpge_ps(w, zero));
+            mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, w), one));
+            mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_set1_ps(tMin)));
+            mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+            int bits = _mm_movemask_ps(mask) & ((1 << node.count) - 1);
+            if (bits)
+            {
+                alignas(16) float ts[4], us[4], ws[4];
+                _mm_store_ps(ts, t);
+                _mm_store_ps(us, u);
+                _mm_store_ps(ws, w);
+
+                for (int k = 0; k < 4; ++k)
+                {
+                    if (bits & (1 << k) && ts[k] < hit.t)
+                    {
+                        hit.t = ts[k];
+                        hit.triangle = ids[k];
+                        hit.u = us[k];
+                        hit.v = ws[k];
+                    }
+                }
+
+                if (anyHit)
+                    return true;
+            }
+        }
+        else
+        {
+            // Visit the nearer child first
+            int child = node.leftFirst;
+            float tNear0, tNear1;
+            bool hit0 = intersectBox(m_nodes[child].min, m_nodes[child].max, origin, invDir, tMin, hit.t, tNear0);
+            bool hit1 = intersectBox(m_nodes[child + 1].min, m_nodes[child + 1].max, origin, invDir, tMin, hit.t, tNear1);
+
+            if (hit0 && hit1)
+            {
+                bool swap = tNear1 < tNear0;
+                stack[stackSize] = swap ? child : child + 1;
+                stackNear[stackSize++] = swap ? tNear0 : tNear1;
+                index = swap ? child + 1 : child;
+                continue;
+            }
+            else if (hit0 || hit1)
+            {
+                index = hit0 ? child : child + 1;
+                continue;
+            }
+        }
+
+        // Skip deferred nodes that start beyond the closest hit so far
+        while (stackSize > 0 && stackNear[stackSize - 1] > hit.t)
+            --stackSize;
+
+        if (stackSize == 0)
+            break;
+
+        index = stack[--stackSize];
+    }
+
+    return hit.triangle >= 0;
+}
@@ -0,0 +1,132 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <atomic>
+#include <cfloat>
+#include <vector>
+
+#include <emmintrin.h>
+
+#include "debug/Stable.h"
+
+#include <QVector3D>
+#include <QOpenGLFunctions>
+
+#include "vertex.h"
+
+struct Ray
+{
+    QVector3D origin;
+    QVector3D direction;
+};
+
+struct RayHit
+{
+    float t; // Hit point is origin + t * direction
+    int triangle;
+    float u, v; // Barycentric coordinates of the hit in the triangle
+};
+
+// Bounding volume hierarchy over the triangles of a mesh.
+// Built top-down with a binned SAH, large nodes are binned and subtrees
+// are built in parallel on the thread pool. Leaves hold up to four
+// triangles, tested against a ray at once with SSE.
+// The vertex and index arrays are referenced, not copied, and must outlive the tree.
+class Bvh
+{
+public:
+    Bvh();
+
+    // Returns false if cancelled
+    bool build(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::atomic<bool>& cancelled);
+
+    bool isEmpty() const;
+
+    // Closest hit with t in (tMin, tMax)
+    bool intersect(const Ray& ray, RayHit& hit, float tMin = 0, float tMax = FLT_MAX) const;
+
+    // Any hit with t in (tMin, tMax), cheaper than intersect for shadow and occlusion rays
+    bool occluded(const Ray& ray, float tMin = 0, float tMax = FLT_MAX) const;
+
+private:
+    static const int binCount = 16;
+    static const int maxLeafSize = 4;
+    static const int parallelThreshold = 1 << 16; // Smaller nodes become serial subtree jobs
+    static const int traversalStackSize = 64; // Deeper trees traverse with a heap stack
+
+    struct Node
+    {
+        float min[3];
+        int leftFirst; // First child for interior nodes, first triangle for leaves
+        float max[3];
+        int count; // Triangle count, 0 for interior nodes
+    };
+
+    // Fourth components are padding so the bounds load straight into SSE registers
+    struct Bounds
+    {
+        float min[4];
+        float max[4];
+
+        void reset();
+        void set(__m128 min4, __m128 max4);
+        void extend(const Bounds& b);
+        float area() const;
+    };
+
+    // Triangle bounds sorted along with the build so binning reads memory in order
+    struct Reference
+    {
+        float min[3];
+        int triangle;
+        float max[3];
+        float pad;
+    };
+
+    struct Bin
+    {
+        Bounds bounds; // Triangle bounds
+        Bounds centroids;
+        int count;
+    };
+
+    struct BuildTask
+    {
+        int node;
+        int first;
+        int count;
+        Bounds bounds;
+        Bounds centroids;
+    };
+
+    struct Split
+    {
+        int axis;
+        int bin; // Bins below go left
+        Bounds left, right;
+        Bounds leftCentroids, rightCentroids;
+        int leftCount;
+    };
+
+    static int binsFor(int count);
+
+    void triangleBounds(int triangle, __m128& min, __m128& max) const;
+    void binTriangles(const BuildTask& task, int first, int count, Bin bins[3][binCount]) const;
+    bool findSplit(const BuildTask& task, Bin bins[3][binCount], Split& split) const;
+    int partition(const BuildTask& task, const Split& split);
+    void halve(const BuildTask& task, BuildTask& left, BuildTask& right) const;
+    void setNode(Node& node, const BuildTask& task, bool leaf, int firstChild = 0);
+    void buildSubtree(BuildTask task, std::vector<Node>& nodes);
+    int treeDepth() const; // Interior nodes on the longest path from the root
+    bool traverse(const Ray& ray, RayHit& hit, float tMin, float tMax, bool anyHit) const;
+
+    const Vertex* m_vertices;
+    const GLuint* m_indices;
+
+    std::vector<Node> m_nodes;
+    int m_depth; // Bounds the deferred nodes of a traversal
+    std::vector<int> m_triangles; // Triangle ids in leaf order
+    std::vector<Reference> m_references; // Build only
+};
+
+#endif // BVH_H
@@ -0,0 +1,36 @@
+#include "debug/Stable.h"
+
+#include "BvhBuilder.h"
+
+BvhBuilder::BvhBuilder(const Model* model) :
+    QThread(),
+    m_model(model),
+    m_ready(false),
+    m_cancelled(false)
+{}
+
+bool BvhBuilder::isReady()
+{
+    return m_ready;
+}
+
+bool BvhBuilder::isCancelled()
+{
+    return m_cancelled;
+}
+
+void BvhBuilder::cancel()
+{
+    m_cancelled = true;
+}
+
+const Bvh& BvhBuilder::getBvh()
+{
+    return m_bvh;
+}
+
+void BvhBuilder::run()
+{
+    if (m_bvh.build(m_model->getVertices(), m_model->getIndices(), m_cancelled))
+        m_ready = true;
+}
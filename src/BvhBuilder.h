@@ -0,0 +1,38 @@
+#ifndef BVHBUILDER_H
+#define BVHBUILDER_H
+
+#include <atomic>
+
+#include "debug/Stable.h"
+
+#include <QThread>
+
+#include "model.h"
+#include "Bvh.h"
+
+// Builds the BVH of a loaded model in the background.
+// The model must outlive the builder, cancel() and wait() before deleting it.
+class BvhBuilder : public QThread
+{
+    Q_OBJECT
+
+public:
+    explicit BvhBuilder(const Model* model);
+
+    bool isReady();
+    bool isCancelled();
+    void cancel();
+
+    // Valid once isReady() returns true
+    const Bvh& getBvh();
+
+private:
+    void run() override;
+
+    const Model* m_model;
+    Bvh m_bvh;
+    std::atomic<bool> m_ready;
+    std::atomic<bool> m_cancelled;
+};
+
+#endif // BVHBUILDER_H
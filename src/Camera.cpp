@@ -0,0 +1,153 @@
+#include <cmath>
+
+#include "debug/Stable.h"
+
+#include <QtMath>
+
+#include "Camera.h"
+
+static const qreal fieldOfView = 45.0;
+static const qreal minScale = 0.05;
+
+// Velocity decays by e every 1 / damping seconds, below settleSpeed it stops
+static const qreal damping = 3.0;
+static const qreal settleSpeed = 5.0;
+
+Camera::Camera() :
+    m_translation(0, 0, -5),
+    m_translationSpeed(0.005),
+    m_scale(1)
+{}
+
+QMatrix4x4 Camera::getModelView(const QVector3D& pivot) const
+{
+    QMatrix4x4 modelView;
+    modelView.translate(m_translation);
+    modelView.translate(pivot);
+    modelView.rotate(m_rotation);
+    modelView.scale(m_scale);
+    modelView.translate(-pivot);
+    return modelView;
+}
+
+QMatrix4x4 Camera::getProjection(int w, int h) const
+{
+    // Calculate aspect ratio
+    qreal aspect = qreal(w) / qreal(h ? h : 1);
+
+    // Set near plane to 1.0, far plane to 200.0
+    const qreal zNear = 1.0, zFar = 200.0;
+
+    QMatrix4x4 projection;
+    projection.perspective(fieldOfView, aspect, zNear, zFar);
+    return projection;
+}
+
+void Camera::rotate(const QVector2D& diff)
+{
+    // Rotation axis is perpendicular to the mouse position difference vector
+    QVector3D n = QVector3D(diff.y(), diff.x(), 0.0).normalized();
+
+    qreal angle = diff.length() / 10.0;
+
+    m_rotation = QQuaternion::fromAxisAndAngle(n, angle) * m_rotation;
+}
+
+void Camera::pan(const QVector2D& diff)
+{
+    // Widget y axis points down
+    QVector3D d = QVector3D(diff.x(), -diff.y(), 0) * m_translationSpeed;
+    m_translation += d;
+}
+
+void Camera::zoom(qreal d)
+{
+    m_scale *= 1 + d / 100.;
+
+    if (m_scale < minScale)
+        m_scale = minScale;
+}
+
+void Camera::pan(const QVector2D& diff, qreal depth, int viewportHeight)
+{
+    // Eye space units per pixel at the given depth
+    qreal k = 2 * depth * std::tan(qDegreesToRadians(fieldOfView / 2)) / (viewportHeight ? viewportHeight : 1);
+
+    m_translation += QVector3D(diff.x() * k, -diff.y() * k, 0);
+}
+
+void Camera::zoomAt(qreal d, const QVector3D& point, const QVector3D& pivot)
+{
+    qreal scale = m_scale;
+    zoom(d);
+
+    // Eye position of a model point is translation + pivot + scale * rotation * (point - pivot)
+    m_translation += float(scale - m_scale) * m_rotation.rotatedVector(point - pivot);
+}
+
+void Camera::movePivot(const QVector3D& oldPivot, const QVector3D& newPivot)
+{
+    QVector3D d = oldPivot - newPivot;
+    m_translation += d - float(m_scale) * m_rotation.rotatedVector(d);
+}
+
+void Camera::fling(const QVector2D& velocity)
+{
+    m_angularVelocity = velocity.length() < settleSpeed ? QVector2D() : velocity;
+}
+
+bool Camera::coast(qreal dt)
+{
+    if (!isCoasting())
+        return false;
+
+    // Exact exponential decay so the motion doesn't depend on the frame rate
+    qreal decay = std::exp(-damping * dt);
+    rotate(m_angularVelocity * ((1 - decay) / damping));
+    m_angularVelocity *= decay;
+
+    if (m_angularVelocity.length() < settleSpeed)
+        m_angularVelocity = QVector2D();
+
+    return isCoasting();
+}
+
+bool Camera::isCoasting() const
+{
+    return !m_angularVelocity.isNull();
+}
+
+void Camera::stopCoasting()
+{
+    m_angularVelocity = QVector2D();
+}
+
+QQuaternion Camera::getRotation() const
+{
+    return m_rotation;
+}
+
+QVector3D Camera::getTranslation() const
+{
+    return m_translation;
+}
+
+qreal Camera::getScale() const
+{
+    return m_scale;
+}
+
+void Camera::setRotation(const QQuaternion& rotation)
+{
+    m_rotation = rotation;
+}
+
+void Camera::setTranslation(const QVector3D& translation)
+{
+    m_translation = translation;
+}
+
+void Camera::setScale(qreal scale)
+{
+    m_scale = scale;
+}
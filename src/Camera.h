@@ -0,0 +1,58 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include "debug/Stable.h"
+
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector2D>
+#include <QVector3D>
+
+// Orbit camera shared by the OpenGL and software viewports
+class Camera
+{
+public:
+    Camera();
+
+    // Rotates and scales the model about pivot
+    QMatrix4x4 getModelView(const QVector3D& pivot) const;
+    QMatrix4x4 getProjection(int w, int h) const;
+
+    // Mouse interaction, diff is the cursor movement in widget pixels
+    void rotate(const QVector2D& diff);
+    void pan(const QVector2D& diff);
+    void zoom(qreal d);
+
+    // Anchored variants, points are in model coordinates.
+    // pan moves a point at the given eye space depth along with the cursor,
+    // zoomAt keeps point in place on screen.
+    void pan(const QVector2D& diff, qreal depth, int viewportHeight);
+    void zoomAt(qreal d, const QVector3D& point, const QVector3D& pivot);
+
+    // Changes the rotation pivot without moving the view
+    void movePivot(const QVector3D& oldPivot, const QVector3D& newPivot);
+
+    // Inertia, the rotation keeps going after release and decays until it settles.
+    // Velocity is in widget pixels per second like the rotate() diff.
+    void fling(const QVector2D& velocity);
+    bool coast(qreal dt); // Advances dt seconds, false once settled
+    bool isCoasting() const;
+    void stopCoasting();
+
+    QQuaternion getRotation() const;
+    QVector3D getTranslation() const;
+    qreal getScale() const;
+
+    void setRotation(const QQuaternion&);
+    void setTranslation(const QVector3D&);
+    void setScale(qreal);
+
+private:
+    QQuaternion m_rotation;
+    QVector2D m_angularVelocity; // Pixels per second, zero when settled
+    QVector3D m_translation;
+    qreal m_translationSpeed;
+    qreal m_scale;
+};
+
+#endif // CAMERA_H
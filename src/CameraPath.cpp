@@ -0,0 +1,133 @@
+#include <algorithm>
+
+#include "debug/Stable.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include "CameraPath.h"
+
+CameraPath::CameraPath()
+{}
+
+static QVector3D readVector(const QJsonValue& value, QVector3D def)
+{
+    QJsonArray a = value.toArray();
+    if (a.size() != 3)
+        return def;
+
+    return QVector3D(a[0].toDouble(), a[1].toDouble(), a[2].toDouble());
+}
+
+bool CameraPath::load(QString fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        qDebug() << "CameraPath: cannot open" << fileName;
+        return false;
+    }
+
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
+    if (doc.isNull())
+    {
+        qDebug() << "CameraPath:" << fileName << error.errorString();
+        return false;
+    }
+
+    Camera defaults;
+    CameraKey key;
+    key.time = 0;
+    key.rotation = defaults.getRotation();
+    key.translation = defaults.getTranslation();
+    key.scale = defaults.getScale();
+
+    m_keys.clear();
+
+    for (const QJsonValue& v : doc.object()["keys"].toArray())
+    {
+        QJsonObject o = v.toObject();
+
+        key.time = o["time"].toDouble(key.time);
+
+        if (o.contains("axis") || o.contains("angle"))
+            key.rotation = QQuaternion::fromAxisAndAngle(readVector(o["axis"], QVector3D(0, 1, 0)), o["angle"].toDouble());
+
+        key.translation = readVector(o["translation"], key.translation);
+        key.scale = o["scale"].toDouble(key.scale);
+
+        addKey(key);
+    }
+
+    if (m_keys.empty())
+    {
+        qDebug() << "CameraPath:" << fileName << "has no keys";
+        return false;
+    }
+
+    return true;
+}
+
+void CameraPath::addKey(const CameraKey& key)
+{
+    auto it = std::upper_bound(m_keys.begin(), m_keys.end(), key.time,
+        [](double t, const CameraKey& k) { return t < k.time; });
+    m_keys.insert(it, key);
+}
+
+CameraPath CameraPath::turntable(const Camera& camera, double duration)
+{
+    CameraPath path;
+
+    // Quarter turns, slerp takes the short way so a single key per turn would not move
+    for (int i = 0; i <= 4; ++i)
+    {
+        CameraKey key;
+        key.time = duration * i / 4;
+        key.rotation = QQuaternion::fromAxisAndAngle(0, 1, 0, 90 * i) * camera.getRotation();
+        key.translation = camera.getTranslation();
+        key.scale = camera.getScale();
+        path.addKey(key);
+    }
+
+    return path;
+}
+
+bool CameraPath::isEmpty() const
+{
+    return m_keys.empty();
+}
+
+double CameraPath::getDuration() const
+{
+    return m_keys.empty() ? 0 : m_keys.back().time;
+}
+
+void CameraPath::apply(double time, Camera& camera) const
+{
+    if (m_keys.empty())
+        return;
+
+    auto next = std::upper_bound(m_keys.begin(), m_keys.end(), time,
+        [](double t, const CameraKey& k) { return t < k.time; });
+
+    if (next == m_keys.begin() || next == m_keys.end())
+    {
+        const CameraKey& k = next == m_keys.begin() ? m_keys.front() : m_keys.back();
+        camera.setRotation(k.rotation);
+        camera.setTranslation(k.translation);
+        camera.setScale(k.scale);
+        return;
+    }
+
+    const CameraKey& a = *(next - 1);
+    const CameraKey& b = *next;
+    float t = float((time - a.time) / (b.time - a.time));
+
+    camera.setRotation(QQuaternion::slerp(a.rotation, b.rotation, t));
+    camera.setTranslation(a.translation + (b.translation - a.translation) * t);
+    camera.setScale(a.scale + (b.scale - a.scale) * t);
+}
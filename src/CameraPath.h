@@ -0,0 +1,46 @@
+#ifndef CAMERAPATH_H
+#define CAMERAPATH_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QQuaternion>
+#include <QVector3D>
+
+#include "Camera.h"
+
+// Camera state at a point in time, in seconds
+struct CameraKey
+{
+    double time;
+    QQuaternion rotation;
+    QVector3D translation;
+    qreal scale;
+};
+
+// Keyframed camera animation, rotation is slerped and the rest lerped between keys.
+//
+// JSON files hold a list of keys, missing fields repeat the previous key:
+// { "keys": [ { "time": 0, "axis": [0, 1, 0], "angle": 0, "translation": [0, 0, -5], "scale": 1 }, ... ] }
+class CameraPath
+{
+public:
+    CameraPath();
+
+    bool load(QString fileName);
+    void addKey(const CameraKey&);
+
+    // One full turn around the vertical axis starting from the camera's state
+    static CameraPath turntable(const Camera&, double duration);
+
+    bool isEmpty() const;
+    double getDuration() const;
+    void apply(double time, Camera&) const;
+
+private:
+    std::vector<CameraKey> m_keys;
+};
+
+#endif // CAMERAPATH_H
@@ -0,0 +1,595 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+
+#include "debug/Stable.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include "ChunkBuilder.h"
+
+namespace
+{
+    // Progress stages: vertex scan, triangle sort, chunk build
+    const int stageEnd[3] = { 300, 600, 1000 };
+
+    struct PositionKey
+    {
+        float x, y, z;
+
+        bool operator==(const PositionKey& k) const
+        {
+            return x == k.x && y == k.y && z == k.z;
+        }
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const PositionKey& k) const
+        {
+            quint32 b[3];
+            memcpy(b, &k, sizeof(b));
+            return (size_t)b[0] * 73856093u ^ (size_t)b[1] * 19349663u ^ (size_t)b[2] * 83492791u;
+        }
+    };
+
+    struct CellKey
+    {
+        qint32 x, y, z;
+
+        bool operator==(const CellKey& k) const
+        {
+            return x == k.x && y == k.y && z == k.z;
+        }
+    };
+
+    struct CellHash
+    {
+        size_t operator()(const CellKey& k) const
+        {
+            return (size_t)k.x * 73856093u ^ (size_t)k.y * 19349663u ^ (size_t)k.z * 83492791u;
+        }
+    };
+
+    // Area weighted vertex normals
+    void computeNormals(std::vector<Vertex>& vertices, const std::vector<GLuint>& indices)
+    {
+        for (Vertex& v : vertices)
+            v.norm = QVector3D();
+
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            Vertex& a = vertices[indices[i]];
+            Vertex& b = vertices[indices[i + 1]];
+            Vertex& c = vertices[indices[i + 2]];
+
+            QVector3D n = QVector3D::crossProduct(b.pos - a.pos, c.pos - a.pos);
+            a.norm += n;
+            b.norm += n;
+            c.norm += n;
+        }
+
+        for (Vertex& v : vertices)
+            v.norm.normalize();
+    }
+
+    // Parses an OBJ face index, "7", "7/1" or "7/1/3", into an absolute 0-based index
+    bool parseIndex(const char*& s, quint64 vertexCount, quint64& index)
+    {
+        char* end;
+        long long i = strtoll(s, &end, 10);
+        if (end == s)
+            return false;
+
+        s = end;
+        while (*s && !isspace((unsigned char)*s))
+            ++s;
+
+        if (i < 0)
+            i += (long long)vertexCount;
+        else
+            --i;
+
+        if (i < 0 || (quint64)i >= vertexCount)
+            return false;
+
+        index = (quint64)i;
+        return true;
+    }
+}
+
+ChunkBuilder::ChunkBuilder(QString objFileName, QString chunkFileName) :
+    QThread(),
+    m_objFileName(objFileName),
+    m_chunkFileName(chunkFileName),
+    m_positionsFileName(chunkFileName + ".positions.tmp"),
+    m_bucketsFileName(chunkFileName + ".buckets.tmp"),
+    m_ready(false),
+    m_cancelled(false),
+    m_progress(0),
+    m_vertexCount(0),
+    m_triangleCount(0),
+    m_objSize(0),
+    m_cellSize(1)
+{}
+
+bool ChunkBuilder::isReady()
+{
+    return m_ready;
+}
+
+bool ChunkBuilder::isCancelled()
+{
+    return m_cancelled;
+}
+
+int ChunkBuilder::getProgress()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_progress;
+}
+
+int ChunkBuilder::getMaxProgress()
+{
+    return stageEnd[2];
+}
+
+void ChunkBuilder::cancel()
+{
+    m_cancelled = true;
+}
+
+void ChunkBuilder::setProgress(int stage, double fraction)
+{
+    int begin = stage ? stageEnd[stage - 1] : 0;
+
+    QMutexLocker lck(&m_mutex);
+    m_progress = begin + int((stageEnd[stage] - begin) * std::min(fraction, 1.0));
+}
+
+void ChunkBuilder::run()
+{
+    m_objSize = QFileInfo(m_objFileName).size();
+
+    bool done = scanVertices() && sortTriangles() && buildChunks();
+
+    m_buckets.close();
+    QFile::remove(m_positionsFileName);
+    QFile::remove(m_bucketsFileName);
+
+    if (!done)
+    {
+        m_out.close();
+        QFile::remove(m_chunkFileName);
+        return;
+    }
+
+    std::cout << m_triangleCount << " triangles in " << m_records.size() << " chunks" << std::endl;
+    m_ready = true;
+}
+
+template <typename V, typename F>
+bool ChunkBuilder::parseObj(int stage, V vertexFn, F faceFn)
+{
+    std::ifstream in(m_objFileName.toStdString(), std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Cannot open " << m_objFileName.toStdString() << std::endl;
+        return false;
+    }
+
+    quint64 vertexCount = 0;
+    quint64 lineCount = 0;
+    std::string line;
+
+    while (std::getline(in, line))
+    {
+        const char* s = line.c_str();
+        while (*s == ' ' || *s == '\t')
+            ++s;
+
+        if (s[0] == 'v' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            char* end;
+            float x = strtof(s + 2, &end);
+            float y = strtof(end, &end);
+            float z = strtof(end, &end);
+
+            vertexFn(QVector3D(x, y, z));
+            ++vertexCount;
+        }
+        else if (s[0] == 'f' && (s[1] == ' ' || s[1] == '\t'))
+        {
+            // Polygons are split into fans
+            s += 2;
+            quint64 first = 0, previous = 0, index;
+            int n = 0;
+
+            for (;;)
+            {
+                while (*s == ' ' || *s == '\t' || *s == '\r')
+                    ++s;
+                if (!*s)
+                    break;
+
+                if (!parseIndex(s, vertexCount, index))
+                {
+                    std::cerr << "ERROR: invalid model file.\n";
+                    return false;
+                }
+
+                if (n == 0)
+                    first = index;
+                else if (n >= 2)
+                    faceFn(first, previous, index);
+
+                previous = index;
+                ++n;
+            }
+        }
+
+        // Progress and cancellation every few thousand lines
+        if (++lineCount % 8192 == 0)
+        {
+            if (m_cancelled)
+                return false;
+
+            setProgress(stage, m_objSize ? double(in.tellg()) / m_objSize : 0);
+        }
+    }
+
+    return true;
+}
+
+bool ChunkBuilder::scanVertices()
+{
+    std::ofstream positions(m_positionsFileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!positions)
+    {
+        std::cerr << "Cannot write " << m_positionsFileName.toStdString() << std::endl;
+        return false;
+    }
+
+    bool done = parseObj(0, [&](const QVector3D& p)
+    {
+        float xyz[3] = { p.x(), p.y(), p.z() };
+        positions.write((const char*)xyz, sizeof(xyz));
+        m_bbox.extend(p);
+        ++m_vertexCount;
+    },
+    [&](quint64, quint64, quint64)
+    {
+        ++m_triangleCount;
+    });
+
+    return done && positions.good() && m_triangleCount > 0;
+}
+
+bool ChunkBuilder::sortTriangles()
+{
+    // Roughly cubic cells with cellTriangles triangles on average, flat models get fewer layers
+    QVector3D size = m_bbox.size();
+    float extent = std::max(std::max(size.x(), size.y()), std::max(size.z(), 1e-6f));
+    float volume = 1;
+    for (int a = 0; a < 3; ++a)
+        volume *= std::max(size[a], extent * 1e-3f);
+
+    quint64 cells = std::min<quint64>(std::max<quint64>(m_triangleCount / cellTriangles, 1), maxCells);
+    m_cellSize = std::cbrt(volume / cells);
+
+    for (;;)
+    {
+        quint64 total = 1;
+        for (int a = 0; a < 3; ++a)
+        {
+            m_grid[a] = std::max(1, (int)std::ceil(size[a] / m_cellSize));
+            total *= m_grid[a];
+        }
+
+        if (total <= (quint64)maxCells)
+            break;
+
+        m_cellSize *= 1.25f;
+    }
+
+    m_cells.resize((size_t)m_grid[0] * m_grid[1] * m_grid[2]);
+
+    m_buckets.open(m_bucketsFileName.toStdString(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_buckets)
+    {
+        std::cerr << "Cannot write " << m_bucketsFileName.toStdString() << std::endl;
+        return false;
+    }
+
+    // Vertices are looked up at random, let the OS page them in
+    QFile positionsFile(m_positionsFileName);
+    if (!positionsFile.open(QIODevice::ReadOnly))
+        return false;
+
+    const float* positions = (const float*)positionsFile.map(0, positionsFile.size());
+    if (!positions)
+    {
+        std::cerr << "Cannot map " << m_positionsFileName.toStdString() << std::endl;
+        return false;
+    }
+
+    bool done = parseObj(1, [](const QVector3D&) {}, [&](quint64 a, quint64 b, quint64 c)
+    {
+        Triangle t;
+        t.p[0] = QVector3D(positions[a * 3], positions[a * 3 + 1], positions[a * 3 + 2]);
+        t.p[1] = QVector3D(positions[b * 3], positions[b * 3 + 1], positions[b * 3 + 2]);
+        t.p[2] = QVector3D(positions[c * 3], positions[c * 3 + 1], positions[c * 3 + 2]);
+
+        QVector3D centroid = (t.p[0] + t.p[1] + t.p[2]) / 3 - m_bbox.min;
+        int i[3];
+        for (int k = 0; k < 3; ++k)
+            i[k] = std::min(std::max((int)(centroid[k] / m_cellSize), 0), m_grid[k] - 1);
+
+        Cell& cell = m_cells[((size_t)i[2] * m_grid[1] + i[1]) * m_grid[0] + i[0]];
+        cell.pending.push_back(t);
+        ++cell.count;
+
+        if (cell.pending.size() == blockTriangles)
+            flushCell(cell);
+    });
+
+    for (Cell& cell : m_cells)
+    {
+        if (!cell.pending.empty())
+            flushCell(cell);
+        std::vector<Triangle>().swap(cell.pending);
+    }
+
+    return done && m_buckets.good();
+}
+
+void ChunkBuilder::flushCell(Cell& cell)
+{
+    m_buckets.seekp(0, std::ios::end);
+    cell.blocks.push_back((quint64)m_buckets.tellp());
+    m_buckets.write((const char*)cell.pending.data(), cell.pending.size() * sizeof(Triangle));
+    cell.pending.clear();
+}
+
+bool ChunkBuilder::buildChunks()
+{
+    m_out.open(m_chunkFileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_out)
+    {
+        std::cerr << "Cannot write " << m_chunkFileName.toStdString() << std::endl;
+        return false;
+    }
+
+    // Written again with the record offset at the end
+    ChunkFileHeader header = {};
+    m_out.write((const char*)&header, sizeof(header));
+
+    size_t occupied = 0, processed = 0;
+    for (const Cell& cell : m_cells)
+        occupied += cell.count ? 1 : 0;
+
+    std::vector<Triangle> triangles;
+
+    for (Cell& cell : m_cells)
+    {
+        if (!cell.count)
+            continue;
+
+        triangles.resize(cell.count);
+
+        for (size_t b = 0; b < cell.blocks.size(); ++b)
+        {
+            size_t first = b * blockTriangles;
+            size_t n = std::min<size_t>(blockTriangles, cell.count - first);
+
+            m_buckets.seekg(cell.blocks[b]);
+            m_buckets.read((char*)&triangles[first], n * sizeof(Triangle));
+        }
+
+        if (!m_buckets)
+        {
+            std::cerr << "Cannot read " << m_bucketsFileName.toStdString() << std::endl;
+            return false;
+        }
+
+        splitChunk(triangles, 0, triangles.size());
+
+        std::vector<quint64>().swap(cell.blocks);
+
+        setProgress(2, double(++processed) / occupied);
+        if (m_cancelled)
+            return false;
+    }
+
+    header.magic = chunkFileMagic;
+    header.version = chunkFileVersion;
+    header.chunkCount = (quint32)m_records.size();
+    header.recordsOffset = (quint64)m_out.tellp();
+    header.triangleCount = m_triangleCount;
+    for (int a = 0; a < 3; ++a)
+    {
+        header.bboxMin[a] = m_bbox.min[a];
+        header.bboxMax[a] = m_bbox.max[a];
+    }
+
+    m_out.write((const char*)m_records.data(), m_records.size() * sizeof(ChunkRecord));
+    m_out.seekp(0);
+    m_out.write((const char*)&header, sizeof(header));
+    m_out.close();
+
+    return !m_out.fail();
+}
+
+void ChunkBuilder::splitChunk(std::vector<Triangle>& triangles, size_t first, size_t count)
+{
+    if (count <= (size_t)maxChunkTriangles)
+    {
+        writeChunk(triangles, first, count);
+        return;
+    }
+
+    // Median split along the longest axis of the centroids
+    BoundingBox centroids;
+    for (size_t i = first; i < first + count; ++i)
+        centroids.extend(triangles[i].p[0] + triangles[i].p[1] + triangles[i].p[2]);
+
+    QVector3D size = centroids.size();
+    int axis = size.x() > size.y() ? (size.x() > size.z() ? 0 : 2) : (size.y() > size.z() ? 1 : 2);
+
+    size_t half = count / 2;
+    std::nth_element(triangles.begin() + first, triangles.begin() + first + half, triangles.begin() + first + count,
+        [axis](const Triangle& a, const Triangle& b)
+        {
+            return a.p[0][axis] + a.p[1][axis] + a.p[2][axis] < b.p[0][axis] + b.p[1][axis] + b.p[2][axis];
+        });
+
+    splitChunk(triangles, first, half);
+    splitChunk(triangles, first + half, count - half);
+}
+
+void ChunkBuilder::writeChunk(const std::vector<Triangle>& triangles, size_t first, size_t count)
+{
+    ChunkRecord record = {};
+    BoundingBox bbox;
+
+    // Weld identical positions
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::unordered_map<PositionKey, GLuint, PositionHash> welded;
+    welded.reserve(count);
+    indices.reserve(count * 3);
+
+    double edgeLength = 0;
+
+    for (size_t i = first; i < first + count; ++i)
+    {
+        const Triangle& t = triangles[i];
+
+        for (int k = 0; k < 3; ++k)
+        {
+            PositionKey key = { t.p[k].x(), t.p[k].y(), t.p[k].z() };
+            auto r = welded.insert(std::make_pair(key, (GLuint)vertices.size()));
+            if (r.second)
+            {
+                Vertex v;
+                v.pos = t.p[k];
+                vertices.push_back(v);
+                bbox.extend(t.p[k]);
+            }
+
+            indices.push_back(r.first->second);
+        }
+
+        edgeLength += (t.p[1] - t.p[0]).length() + (t.p[2] - t.p[1]).length() + (t.p[0] - t.p[2]).length();
+    }
+
+    computeNormals(vertices, indices);
+    writeLod(record, 0, vertices, indices, 0);
+
+    // Coarser LODs by vertex clustering. The grid is aligned to the model bounds so
+    // neighbouring chunks at the same LOD snap their common border to the same points.
+    float clusterSize = std::max(float(2 * edgeLength / (3 * count)), bbox.size().length() * 1e-4f);
+    clusterSize = std::max(clusterSize, 1e-12f);
+
+    std::vector<Vertex> lodVertices;
+    std::vector<GLuint> lodIndices;
+    std::vector<GLuint> remap(vertices.size());
+    std::unordered_map<CellKey, GLuint, CellHash> clusters;
+    size_t lastTriangles = count;
+
+    while ((int)record.lodCount < maxChunkLods && lastTriangles > (size_t)minLodTriangles)
+    {
+        clusters.clear();
+        lodVertices.clear();
+        lodIndices.clear();
+
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            QVector3D c = (vertices[i].pos - m_bbox.min) / clusterSize;
+            CellKey key = { (qint32)std::floor(c.x()), (qint32)std::floor(c.y()), (qint32)std::floor(c.z()) };
+
+            auto r = clusters.insert(std::make_pair(key, (GLuint)lodVertices.size()));
+            if (r.second)
+            {
+                Vertex v;
+                v.pos = m_bbox.min + (QVector3D(key.x, key.y, key.z) + QVector3D(0.5f, 0.5f, 0.5f)) * clusterSize;
+                lodVertices.push_back(v);
+            }
+
+            // Clusters keep the average full resolution normal, the collapsed triangles would give a poor one
+            lodVertices[r.first->second].norm += vertices[i].norm;
+            remap[i] = r.first->second;
+        }
+
+        // Drop triangles that collapsed
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            GLuint a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+            if (a != b && b != c && c != a)
+            {
+                lodIndices.push_back(a);
+                lodIndices.push_back(b);
+                lodIndices.push_back(c);
+            }
+        }
+
+        size_t n = lodIndices.size() / 3;
+        float error = clusterSize * 0.8660254f; // Half the cluster diagonal
+        clusterSize *= 2;
+
+        if (n == 0)
+            break;
+
+        // Not worth a level, try a coarser grid
+        if (n > lastTriangles * 4 / 5)
+            continue;
+
+        // Keep only the clusters that are still referenced
+        std::vector<GLuint> used(lodVertices.size(), GLuint(-1));
+        std::vector<Vertex> compacted;
+        for (GLuint& i : lodIndices)
+        {
+            if (used[i] == GLuint(-1))
+            {
+                used[i] = (GLuint)compacted.size();
+                compacted.push_back(lodVertices[i]);
+            }
+            i = used[i];
+        }
+
+        for (Vertex& v : compacted)
+            v.norm.normalize();
+
+        writeLod(record, record.lodCount, compacted, lodIndices, error);
+        lastTriangles = n;
+    }
+
+    for (int a = 0; a < 3; ++a)
+    {
+        record.bboxMin[a] = bbox.min[a];
+        record.bboxMax[a] = bbox.max[a];
+    }
+
+    m_records.push_back(record);
+}
+
+void ChunkBuilder::writeLod(ChunkRecord& record, int lod, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, float error)
+{
+    ChunkLod& l = record.lods[lod];
+    l.offset = (quint64)m_out.tellp();
+    l.vertexCount = (quint32)vertices.size();
+    l.indexCount = (quint32)indices.size();
+    l.error = error;
+
+    m_out.write((const char*)vertices.data(), vertices.size() * sizeof(Vertex));
+    m_out.write((const char*)indices.data(), indices.size() * sizeof(GLuint));
+
+    record.lodCount = lod + 1;
+}
@@ -0,0 +1,95 @@
+#ifndef CHUNKBUILDER_H
+#define CHUNKBUILDER_H
+
+#include <atomic>
+#include <fstream>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QVector3D>
+#include <QOpenGLFunctions>
+
+#include "vertex.h"
+#include "BoundingBox.h"
+#include "ChunkFile.h"
+
+// Preprocesses an OBJ file of any size into a chunk file for out-of-core rendering.
+// The model is streamed twice: the first pass spills vertex positions to a
+// temporary file, the second sorts triangles into grid cells on disk. Cells are
+// then loaded one at a time, split into chunks and simplified into LODs, so memory
+// use depends on the cell size and not on the model size.
+// Progress is reported like ModelLoader, in thousandths.
+class ChunkBuilder : public QThread
+{
+    Q_OBJECT
+
+public:
+    ChunkBuilder(QString objFileName, QString chunkFileName);
+
+    bool isReady();
+    bool isCancelled();
+    int getProgress();
+    int getMaxProgress();
+    void cancel();
+
+private:
+    static const int maxChunkTriangles = 65536;
+    static const int cellTriangles = 16384; // Average triangles per grid cell
+    static const int blockTriangles = 256; // Cell bucket block size on disk
+    static const int minLodTriangles = 256;
+    static const int maxCells = 1 << 15;
+
+    struct Triangle
+    {
+        QVector3D p[3];
+    };
+
+    // Bucket of one grid cell, blocks are spread over the bucket file
+    struct Cell
+    {
+        std::vector<quint64> blocks;
+        std::vector<Triangle> pending;
+        quint64 count = 0;
+    };
+
+    void run() override;
+    bool scanVertices();
+    bool sortTriangles();
+    bool buildChunks();
+
+    template <typename V, typename F> bool parseObj(int stage, V vertexFn, F faceFn);
+    void flushCell(Cell& cell);
+    void splitChunk(std::vector<Triangle>& triangles, size_t first, size_t count);
+    void writeChunk(const std::vector<Triangle>& triangles, size_t first, size_t count);
+    void writeLod(ChunkRecord& record, int lod, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, float error);
+    void setProgress(int stage, double fraction);
+
+    QString m_objFileName;
+    QString m_chunkFileName;
+    QString m_positionsFileName;
+    QString m_bucketsFileName;
+
+    std::atomic<bool> m_ready;
+    std::atomic<bool> m_cancelled;
+    int m_progress;
+    QMutex m_mutex;
+
+    quint64 m_vertexCount;
+    quint64 m_triangleCount;
+    qint64 m_objSize;
+    BoundingBox m_bbox;
+
+    int m_grid[3];
+    float m_cellSize;
+    std::vector<Cell> m_cells;
+    std::fstream m_buckets;
+
+    std::ofstream m_out;
+    std::vector<ChunkRecord> m_records;
+};
+
+#endif // CHUNKBUILDER_H
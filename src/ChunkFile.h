@@ -0,0 +1,46 @@
+#ifndef CHUNKFILE_H
+#define CHUNKFILE_H
+
+#include "debug/Stable.h"
+
+#include <QtGlobal>
+
+// Layout of an out-of-core model written by ChunkBuilder and streamed by ChunkedModel:
+// ChunkFileHeader, the vertex and index blocks of every chunk LOD, then ChunkRecord[chunkCount].
+// A block is vertexCount Vertex structs followed by indexCount GLuint indices.
+
+static const quint32 chunkFileMagic = 0x4b4e4843; // "CHNK"
+static const quint32 chunkFileVersion = 1;
+static const int maxChunkLods = 8;
+
+struct ChunkFileHeader
+{
+    quint32 magic;
+    quint32 version;
+    quint32 chunkCount;
+    quint32 pad;
+    quint64 recordsOffset;
+    quint64 triangleCount;
+    float bboxMin[3];
+    float bboxMax[3];
+};
+
+struct ChunkLod
+{
+    quint64 offset;
+    quint32 vertexCount;
+    quint32 indexCount;
+    float error; // Largest distance a vertex moved from the full resolution mesh, in model units
+    quint32 pad;
+};
+
+struct ChunkRecord
+{
+    float bboxMin[3];
+    float bboxMax[3];
+    quint32 lodCount; // LOD 0 is the full resolution mesh, each next one is coarser
+    quint32 pad;
+    ChunkLod lods[maxChunkLods];
+};
+
+#endif // CHUNKFILE_H
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "debug/Stable.h"
+
+#include "ChunkStreamer.h"
+
+ChunkStreamer::ChunkStreamer(QString fileName, const std::vector<ChunkRecord>& records, int threadCount, qint64 memoryBudget) :
+    m_fileName(fileName.toStdString()),
+    m_records(records),
+    m_memoryBudget(memoryBudget),
+    m_resultBytes(0),
+    m_quit(false)
+{
+    for (int i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&ChunkStreamer::workerLoop, this);
+}
+
+ChunkStreamer::~ChunkStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t : m_workers)
+        t.join();
+}
+
+qint64 ChunkStreamer::key(int chunk, int lod)
+{
+    return (qint64)chunk * maxChunkLods + lod;
+}
+
+void ChunkStreamer::setRequests(std::vector<Request>& requests)
+{
+    // Sorted so that the most important request is at the back
+    std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b)
+    {
+        if (a.urgent != b.urgent)
+            return b.urgent;
+        return a.distance > b.distance;
+    });
+
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+
+        m_queue.clear();
+        for (const Request& r : requests)
+        {
+            qint64 k = key(r.chunk, r.lod);
+            if (!m_loading.count(k) && !m_failed.count(k))
+                m_queue.push_back(r);
+        }
+    }
+
+    m_wake.notify_all();
+}
+
+void ChunkStreamer::takeResults(std::vector<Result>& results, qint64 maxBytes)
+{
+    results.clear();
+    qint64 bytes = 0;
+
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+
+        while (!m_results.empty() && (results.empty() || bytes < maxBytes))
+        {
+            Result& r = m_results.front();
+            qint64 size = (qint64)(r.vertices.size() * sizeof(Vertex) + r.indices.size() * sizeof(GLuint));
+
+            bytes += size;
+            m_resultBytes -= size;
+            m_loading.erase(key(r.chunk, r.lod));
+
+            results.push_back(std::move(r));
+            m_results.pop_front();
+        }
+    }
+
+    // Room for more
+    if (!results.empty())
+        m_wake.notify_all();
+}
+
+bool ChunkStreamer::isBusy()
+{
+    std::lock_guard<std::mutex> lck(m_mutex);
+    return !m_queue.empty() || !m_loading.empty();
+}
+
+void ChunkStreamer::workerLoop()
+{
+    std::ifstream in(m_fileName, std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Cannot open " << m_fileName << std::endl;
+        return;
+    }
+
+    for (;;)
+    {
+        Request request;
+
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+
+            // Stop reading ahead while the render thread is behind with uploads
+            m_wake.wait(lck, [this] { return m_quit || (!m_queue.empty() && m_resultBytes < m_memoryBudget); });
+
+            if (m_quit)
+                return;
+
+            request = m_queue.back();
+            m_queue.pop_back();
+            m_loading.insert(key(request.chunk, request.lod));
+        }
+
+        const ChunkLod& lod = m_records[request.chunk].lods[request.lod];
+
+        Result result;
+        result.chunk = request.chunk;
+        result.lod = request.lod;
+        result.vertices.resize(lod.vertexCount);
+        result.indices.resize(lod.indexCount);
+
+        in.clear();
+        in.seekg(lod.offset);
+        in.read((char*)result.vertices.data(), result.vertices.size() * sizeof(Vertex));
+        in.read((char*)result.indices.data(), result.indices.size() * sizeof(GLuint));
+
+        std::lock_guard<std::mutex> lck(m_mutex);
+
+        if (!in)
+        {
+            std::cerr << "Cannot read chunk " << request.chunk << " from " << m_fileName << std::endl;
+            m_loading.erase(key(request.chunk, request.lod));
+            m_failed.insert(key(request.chunk, request.lod));
+            continue;
+        }
+
+        m_resultBytes += (qint64)(result.vertices.size() * sizeof(Vertex) + result.indices.size() * sizeof(GLuint));
+        m_results.push_back(std::move(result));
+    }
+}
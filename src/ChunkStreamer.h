@@ -0,0 +1,75 @@
+#ifndef CHUNKSTREAMER_H
+#define CHUNKSTREAMER_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QVector3D>
+#include <QOpenGLFunctions>
+
+#include "vertex.h"
+#include "ChunkFile.h"
+
+// Reads chunk LODs from a chunk file on a few I/O threads.
+// The request queue is replaced every frame so loads follow the camera,
+// loaded data waits in system memory until the render thread takes it.
+class ChunkStreamer
+{
+public:
+    struct Request
+    {
+        int chunk;
+        int lod;
+        bool urgent; // Nothing of the chunk is resident yet
+        float distance;
+    };
+
+    struct Result
+    {
+        int chunk;
+        int lod;
+        std::vector<Vertex> vertices;
+        std::vector<GLuint> indices;
+    };
+
+    ChunkStreamer(QString fileName, const std::vector<ChunkRecord>& records, int threadCount = 4, qint64 memoryBudget = 256 << 20);
+    ~ChunkStreamer();
+
+    // Urgent requests load first, then the nearest. LODs already being loaded are skipped.
+    void setRequests(std::vector<Request>& requests);
+
+    // Takes loaded LODs up to maxBytes, at least one if any is ready
+    void takeResults(std::vector<Result>& results, qint64 maxBytes);
+
+    // Requests are queued, loading or waiting to be taken
+    bool isBusy();
+
+private:
+    static qint64 key(int chunk, int lod);
+
+    void workerLoop();
+
+    std::string m_fileName;
+    const std::vector<ChunkRecord>& m_records;
+    qint64 m_memoryBudget;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+
+    std::vector<Request> m_queue; // Most important last
+    std::unordered_set<qint64> m_loading; // Being read or waiting in m_results
+    std::unordered_set<qint64> m_failed;
+    std::deque<Result> m_results;
+    qint64 m_resultBytes;
+    bool m_quit;
+};
+
+#endif // CHUNKSTREAMER_H
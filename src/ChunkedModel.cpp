@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+
+#include "ChunkedModel.h"
+#include "GpuBudget.h"
+#include "LodMetric.h"
+
+const float ChunkedModel::maxPixelError = 1.f;
+
+ChunkedModel::ChunkedModel() :
+    m_streamer(nullptr),
+    m_gpuBytes(0),
+    m_gpuBudget(qint64(1024) << 20),
+    m_errorScale(1),
+    m_frame(0)
+{
+    initializeOpenGLFunctions();
+}
+
+ChunkedModel::~ChunkedModel()
+{
+    // Stop the I/O threads before the records they read go away
+    delete m_streamer;
+
+    for (Chunk& c : m_chunks)
+        for (GpuLod* lod : c.lods)
+            delete lod;
+}
+
+bool ChunkedModel::open(QString fileName)
+{
+    std::ifstream in(fileName.toStdString(), std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        std::cerr << "Cannot open " << fileName.toStdString() << std::endl;
+        return false;
+    }
+
+    ChunkFileHeader header;
+    in.read((char*)&header, sizeof(header));
+
+    if (!in || header.magic != chunkFileMagic || header.version != chunkFileVersion)
+    {
+        std::cerr << "ERROR: invalid chunk file.\n";
+        return false;
+    }
+
+    m_records.resize(header.chunkCount);
+    in.seekg(header.recordsOffset);
+    in.read((char*)m_records.data(), m_records.size() * sizeof(ChunkRecord));
+
+    if (!in)
+    {
+        std::cerr << "ERROR: invalid chunk file.\n";
+        return false;
+    }
+
+    m_bbox.min = QVector3D(header.bboxMin[0], header.bboxMin[1], header.bboxMin[2]);
+    m_bbox.max = QVector3D(header.bboxMax[0], header.bboxMax[1], header.bboxMax[2]);
+
+    m_chunks.resize(m_records.size());
+    for (size_t i = 0; i < m_records.size(); ++i)
+    {
+        const ChunkRecord& r = m_records[i];
+        m_chunks[i].bbox.min = QVector3D(r.bboxMin[0], r.bboxMin[1], r.bboxMin[2]);
+        m_chunks[i].bbox.max = QVector3D(r.bboxMax[0], r.bboxMax[1], r.bboxMax[2]);
+        std::fill(m_chunks[i].lods, m_chunks[i].lods + maxChunkLods, nullptr);
+    }
+
+    m_streamer = new ChunkStreamer(fileName, m_records);
+    return true;
+}
+
+void ChunkedModel::setGpuBudget(qint64 bytes)
+{
+    m_gpuBudget = bytes;
+}
+
+QVector3D ChunkedModel::getPivot() const
+{
+    return m_bbox.center();
+}
+
+bool ChunkedModel::isStreaming()
+{
+    return m_streamer && m_streamer->isBusy();
+}
+
+void ChunkedModel::update(const QMatrix4x4& modelView, const QMatrix4x4& projection, int viewportHeight, FrameStats& stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ++m_frame;
+
+    if (m_streamer)
+    {
+        // Upload a bounded amount per frame so that interaction stays smooth
+        m_streamer->takeResults(m_results, uploadBudget);
+        for (ChunkStreamer::Result& r : m_results)
+            upload(r);
+    }
+
+    QMatrix4x4 mvp = projection * modelView;
+    LodMetric metric(modelView, projection, viewportHeight);
+    float maxError = maxPixelError * m_errorScale;
+
+    m_requests.clear();
+    m_drawList.clear();
+
+    stats = FrameStats();
+    stats.partsTotal = (int)m_chunks.size();
+
+    for (int i = 0; i < (int)m_chunks.size(); ++i)
+    {
+        Chunk& c = m_chunks[i];
+        const ChunkRecord& r = m_records[i];
+
+        if (!c.bbox.intersectsFrustum(mvp))
+        {
+            ++stats.partsFrustumCulled;
+            continue;
+        }
+
+        float distance = metric.distance(c.bbox);
+
+        // Coarsest LOD with an error under maxError pixels
+        int wanted = 0;
+        for (int l = (int)r.lodCount - 1; l > 0; --l)
+        {
+            if (metric.pixels(r.lods[l].error, distance) <= maxError)
+            {
+                wanted = l;
+                break;
+            }
+        }
+
+        // Draw the closest resident LOD until the wanted one arrives, coarser first
+        GpuLod* draw = c.lods[wanted];
+        for (int d = 1; !draw && d < maxChunkLods; ++d)
+        {
+            if (wanted + d < (int)r.lodCount && c.lods[wanted + d])
+                draw = c.lods[wanted + d];
+            else if (wanted - d >= 0 && c.lods[wanted - d])
+                draw = c.lods[wanted - d];
+        }
+
+        if (!c.lods[wanted])
+        {
+            ChunkStreamer::Request request = { i, wanted, false, distance };
+            m_requests.push_back(request);
+
+            // Fill holes with the coarsest LOD first, it is the quickest to load
+            if (!draw && wanted != (int)r.lodCount - 1)
+            {
+                ChunkStreamer::Request coarse = { i, (int)r.lodCount - 1, true, distance };
+                m_requests.push_back(coarse);
+            }
+        }
+
+        if (draw)
+        {
+            draw->lastUsed = m_frame;
+            m_drawList.push_back(draw);
+            stats.trianglesDrawn += draw->indexCount / 3;
+        }
+    }
+
+    if (m_streamer)
+        m_streamer->setRequests(m_requests);
+
+    evict();
+
+    stats.partsDrawn = (int)m_drawList.size();
+    stats.chunksPending = (int)m_requests.size();
+    stats.residentBytes = m_gpuBytes;
+    stats.cullTime = timer.nsecsElapsed() / 1e6;
+}
+
+void ChunkedModel::draw()
+{
+    for (GpuLod* lod : m_drawList)
+    {
+        lod->vertexArray.bind();
+        glDrawElements(GL_TRIANGLES, lod->indexCount, GL_UNSIGNED_INT, 0);
+    }
+
+    // Any of them unbinds
+    if (!m_drawList.empty())
+        m_drawList.back()->vertexArray.release();
+}
+
+void ChunkedModel::upload(ChunkStreamer::Result& result)
+{
+    Chunk& c = m_chunks[result.chunk];
+    if (c.lods[result.lod])
+        return;
+
+    GpuLod* lod = new GpuLod();
+    lod->indexCount = (int)result.indices.size();
+    lod->bytes = (qint64)(result.vertices.size() * sizeof(Vertex) + result.indices.size() * sizeof(GLuint));
+    lod->lastUsed = m_frame;
+
+    lod->vertexBuf.create();
+    lod->vertexBuf.bind();
+    lod->vertexBuf.allocate(result.vertices.data(), (int)(result.vertices.size() * sizeof(Vertex)));
+
+    lod->indexBuf.create();
+    lod->indexBuf.bind();
+    lod->indexBuf.allocate(result.indices.data(), (int)(result.indices.size() * sizeof(GLuint)));
+
+    // No baked occlusion for out-of-core models, the occlusion attribute stays disabled
+    lod->vertexArray.create();
+    lod->vertexArray.bind();
+    lod->vertexBuf.bind();
+    lod->indexBuf.bind();
+
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_POSITION);
+    glVertexAttribPointer(VERTEX_ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_NORMAL);
+    glVertexAttribPointer(VERTEX_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)sizeof(QVector3D));
+
+    lod->vertexArray.release();
+
+    c.lods[result.lod] = lod;
+    m_gpuBytes += lod->bytes;
+}
+
+void ChunkedModel::evict()
+{
+    if (m_gpuBytes > m_gpuBudget)
+    {
+        std::vector<GpuLod**> slots;
+        for (Chunk& c : m_chunks)
+            for (GpuLod*& lod : c.lods)
+                slots.push_back(&lod);
+
+        evictLeastRecentlyUsed(slots, m_frame, m_gpuBytes, m_gpuBudget, [](GpuLod* lod)
+        {
+            lod->vertexBuf.destroy();
+            lod->indexBuf.destroy();
+            delete lod;
+        });
+    }
+
+    // The frame alone does not fit, settle for coarser LODs until it does
+    if (m_gpuBytes > m_gpuBudget)
+        m_errorScale = std::min(m_errorScale * 1.25f, 1024.f);
+    else if (m_gpuBytes < m_gpuBudget * 3 / 4)
+        m_errorScale = std::max(m_errorScale / 1.05f, 1.f);
+}
@@ -0,0 +1,83 @@
+#ifndef CHUNKEDMODEL_H
+#define CHUNKEDMODEL_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QString>
+
+#include "BoundingBox.h"
+#include "ChunkFile.h"
+#include "ChunkStreamer.h"
+#include "FrameStats.h"
+
+// Out-of-core model read from a chunk file written by ChunkBuilder.
+// Every frame each visible chunk gets the coarsest LOD whose error stays under a
+// pixel on screen. Missing LODs are streamed in the background while the best
+// resident LOD is drawn, and least recently used LODs are evicted to keep the
+// GPU memory under budget. All calls need the context the model is drawn in to be current.
+class ChunkedModel : protected QOpenGLFunctions
+{
+public:
+    ChunkedModel();
+    ~ChunkedModel();
+
+    bool open(QString fileName);
+
+    // Picks LODs, requests missing ones and uploads loaded ones, call once per frame before draw
+    void update(const QMatrix4x4& modelView, const QMatrix4x4& projection, int viewportHeight, FrameStats& stats);
+    void draw(); // With a mesh program bound
+
+    // More data is on the way, keep drawing frames to show it
+    bool isStreaming();
+
+    void setGpuBudget(qint64 bytes);
+    QVector3D getPivot() const;
+
+private:
+    static const qint64 uploadBudget = 32 << 20; // Bytes uploaded per frame
+    static const float maxPixelError;
+
+    struct GpuLod
+    {
+        GpuLod() : indexBuf(QOpenGLBuffer::IndexBuffer) {}
+
+        QOpenGLBuffer vertexBuf;
+        QOpenGLBuffer indexBuf;
+        QOpenGLVertexArrayObject vertexArray;
+        int indexCount;
+        qint64 bytes;
+        quint64 lastUsed; // Frame
+    };
+
+    struct Chunk
+    {
+        BoundingBox bbox;
+        GpuLod* lods[maxChunkLods];
+    };
+
+    void upload(ChunkStreamer::Result& result);
+    void evict();
+
+    std::vector<ChunkRecord> m_records;
+    std::vector<Chunk> m_chunks;
+    BoundingBox m_bbox;
+    ChunkStreamer* m_streamer;
+
+    std::vector<ChunkStreamer::Request> m_requests;
+    std::vector<ChunkStreamer::Result> m_results;
+    std::vector<GpuLod*> m_drawList;
+
+    qint64 m_gpuBytes;
+    qint64 m_gpuBudget;
+    float m_errorScale; // Raised while the budget can't hold the wanted LODs
+    quint64 m_frame;
+};
+
+#endif // CHUNKEDMODEL_H
@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <vector>
+
+extern "C"
+{
+#include "libavutil/mathematics.h"
+#include "libswscale/swscale.h"
+}
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+
+#include "ConversionBenchmark.h"
+#include "I420Converter.h"
+#include "ThreadPool.h"
+#include "VideoWriter.h"
+
+namespace
+{
+    const qint64 minTime = 1000; // ms per method
+    const int minFrames = 10;
+
+    const int recordFrames = 300;
+    const int recordWarmupFrames = 100; // Longer than any encoder delay
+    const int recordFps = 60;
+
+    // Smooth gradients with noise, the kernels do the same work for any content
+    std::vector<uchar> makeFrame(int width, int height, int index)
+    {
+        std::vector<uchar> pixels((size_t)width * height * 4);
+        quint32 seed = 1 + index;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                seed = seed * 1664525 + 1013904223;
+                uchar* p = &pixels[((size_t)y * width + x) * 4];
+                p[0] = (uchar)(x * 255 / width + (seed >> 28));
+                p[1] = (uchar)(y * 255 / height + (seed >> 24 & 15));
+                p[2] = (uchar)((x + y) * 127 / (width + height) + (seed >> 20 & 15));
+                p[3] = 255;
+            }
+        }
+
+        return pixels;
+    }
+}
+
+ConversionBenchmark::ConversionBenchmark(QString reportFileName) :
+    m_reportFileName(reportFileName)
+{}
+
+bool ConversionBenchmark::exec()
+{
+    QJsonArray sizes;
+    sizes.append(run(1920, 1080));
+    sizes.append(run(3840, 2160));
+
+    QJsonObject report;
+    report["threads"] = ThreadPool::instance()->getThreadCount() + 1;
+    report["bestKernel"] = I420Converter::getKernelName(I420Converter::getBestKernel());
+    report["sizes"] = sizes;
+    report["recording"] = record(1920, 1080);
+
+    QFile file(m_reportFileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "ConversionBenchmark: cannot write" << m_reportFileName;
+        return false;
+    }
+
+    file.write(QJsonDocument(report).toJson());
+    return true;
+}
+
+QJsonObject ConversionBenchmark::run(int width, int height)
+{
+    std::vector<uchar> pixels = makeFrame(width, height, 0);
+
+    std::vector<uchar> yuv((size_t)width * height * 3 / 2);
+    uchar* planes[3] = { yuv.data(), yuv.data() + (size_t)width * height, yuv.data() + (size_t)width * height * 5 / 4 };
+    int strides[3] = { width, width / 2, width / 2 };
+
+    QJsonArray results;
+
+    // The previous path, one bicubic context on one thread
+    SwsContext* context = sws_getContext(width, height, AV_PIX_FMT_BGRA, width, height, AV_PIX_FMT_YUV420P,
+        SWS_BICUBIC, nullptr, nullptr, nullptr);
+
+    if (context)
+    {
+        const uint8_t* src[4] = { pixels.data(), nullptr, nullptr, nullptr };
+        int srcStride[4] = { width * 4, 0, 0, 0 };
+
+        results.append(time("swscale", 1, [&]()
+        {
+            return sws_scale(context, src, srcStride, 0, height, planes, strides) > 0;
+        }));
+
+        sws_freeContext(context);
+    }
+
+    I420Converter::convert(pixels.data(), width * 4, width, height, planes, strides, CONVERT_KERNEL_SCALAR, false);
+    std::vector<uchar> reference = yuv;
+
+    int threads = ThreadPool::instance()->getThreadCount() + 1;
+
+    for (ConvertKernel kernel : { CONVERT_KERNEL_SCALAR, CONVERT_KERNEL_SSE41, CONVERT_KERNEL_AVX2 })
+    {
+        if (!I420Converter::isSupported(kernel))
+            continue;
+
+        for (bool parallel : { false, true })
+        {
+            QJsonObject result = time(I420Converter::getKernelName(kernel), parallel ? threads : 1, [&]()
+            {
+                return I420Converter::convert(pixels.data(), width * 4, width, height, planes, strides, kernel, parallel);
+            });
+
+            result["matchesScalar"] = yuv == reference;
+            results.append(result);
+        }
+    }
+
+    for (const QJsonValue& r : results)
+    {
+        QJsonObject o = r.toObject();
+        qDebug() << "ConversionBenchmark:" << width << "x" << height << o["method"].toString() << "on" << o["threads"].toInt()
+                 << "threads:" << o["fps"].toDouble() << "fps," << o["ms"].toDouble() << "ms"
+                 << (o.contains("matchesScalar") && !o["matchesScalar"].toBool() ? "MISMATCH" : "");
+    }
+
+    QJsonObject size;
+    size["width"] = width;
+    size["height"] = height;
+    size["results"] = results;
+    return size;
+}
+
+QJsonObject ConversionBenchmark::record(int width, int height)
+{
+    QJsonObject result;
+    result["width"] = width;
+    result["height"] = height;
+
+    QTemporaryDir dir;
+    if (!dir.isValid())
+        return result;
+
+    VideoWriter::initAv();
+    VideoWriter writer(width, height, recordFps, 20000000);
+    if (!writer.open((dir.path() + "/benchmark.mkv").toStdString()))
+    {
+        qDebug() << "ConversionBenchmark: cannot open a video";
+        return result;
+    }
+
+    // Captures differ, so the encoder does real work
+    std::vector<std::vector<uchar>> captures;
+    for (int i = 0; i < 4; ++i)
+        captures.push_back(makeFrame(width, height, i));
+
+    // Frames and packets go through the writer the way VideoRecorder passes them on, on one thread
+    std::vector<AVFrame*> frames;
+    for (int i = 0; i < 3; ++i)
+        frames.push_back(writer.createVideoFrame());
+
+    std::vector<AVPacket*> packets;
+    int warmupAllocations = 0;
+    bool ok = true;
+
+    QElapsedTimer timer;
+
+    for (int i = 0; i < recordFrames && ok; ++i)
+    {
+        if (i == recordWarmupFrames)
+        {
+            warmupAllocations = writer.getAllocationCount();
+            timer.start();
+        }
+
+        AVFrame* frame = frames[i % frames.size()];
+        ok = frame && writer.convertFrame(captures[i % captures.size()].data(), width, height, width * 4, frame) &&
+            writer.encodeVideoFrame(frame, av_rescale(i, 1000, recordFps), packets);
+
+        for (AVPacket* packet : packets)
+            ok = writer.writePacket(packet) && ok;
+        packets.clear();
+    }
+
+    int steadyAllocations = writer.getAllocationCount() - warmupAllocations;
+    double ms = timer.nsecsElapsed() / 1e6 / (recordFrames - recordWarmupFrames);
+
+    for (AVFrame* frame : frames)
+        writer.destroyVideoFrame(frame);
+    writer.close();
+
+    result["frames"] = recordFrames - recordWarmupFrames;
+    result["fps"] = ok ? 1000 / ms : 0.;
+    result["warmupAllocations"] = warmupAllocations;
+    result["steadyAllocations"] = steadyAllocations;
+
+    qDebug() << "ConversionBenchmark: recording" << width << "x" << height << (ok ? "" : "FAILED") << result["fps"].toDouble() << "fps,"
+             << warmupAllocations << "allocations while warming up," << steadyAllocations << "over the next" << recordFrames - recordWarmupFrames << "frames";
+    return result;
+}
+
+QJsonObject ConversionBenchmark::time(QString method, int threads, const std::function<bool()>& convert)
+{
+    // One untimed frame touches the memory and builds any tables
+    bool ok = convert();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int frames = 0;
+    while (ok && (frames < minFrames || timer.elapsed() < minTime))
+    {
+        ok = convert();
+        ++frames;
+    }
+
+    double ms = timer.nsecsElapsed() / 1e6 / std::max(frames, 1);
+
+    QJsonObject result;
+    result["method"] = method;
+    result["threads"] = threads;
+    result["ms"] = ms;
+    result["fps"] = ok ? 1000 / ms : 0.;
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef CONVERSIONBENCHMARK_H
+#define CONVERSIONBENCHMARK_H
+
+#include <functional>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QJsonObject>
+
+// Times the BGRA to YUV 4:2:0 conversion of recorded frames at 1080p and 4K:
+// swscale as VideoWriter used it before, then every I420Converter kernel the CPU has,
+// on one thread and on the thread pool. Kernel outputs are checked against the scalar one.
+// Then records a 1080p video into a temporary file and counts the frame buffers and packets
+// allocated after warming up, which should be none.
+class ConversionBenchmark
+{
+public:
+    explicit ConversionBenchmark(QString reportFileName);
+
+    bool exec();
+
+private:
+    QJsonObject run(int width, int height);
+    QJsonObject record(int width, int height);
+    static QJsonObject time(QString method, int threads, const std::function<bool()>& convert);
+
+    QString m_reportFileName;
+};
+
+#endif // CONVERSIONBENCHMARK_H
@@ -0,0 +1,25 @@
+#ifndef FRAMESINK_H
+#define FRAMESINK_H
+
+#include <QtGlobal>
+#include <QSize>
+
+// Receives captured frames straight from the memory they were read back into.
+// Pixels are BGRA bytes (QImage::Format_RGB32), rows start at pixels and are stride
+// bytes apart, a negative stride for images stored bottom row first. They are only
+// valid during the call, which comes on the thread that captured the frame.
+class FrameSink
+{
+public:
+    virtual ~FrameSink() {}
+
+    // time is the render time, ms since epoch
+    virtual void consumeFrame(const uchar* pixels, int width, int height, int stride, qint64 time) = 0;
+
+    // Views that can convert on the GPU pass YUV 4:2:0 at this size instead, U and V
+    // at half of it. Empty for BGRA only. Fixed while the sink is set.
+    virtual QSize getYuvSize() = 0;
+    virtual void consumeYuvFrame(const uchar* const planes[3], const int strides[3], int width, int height, qint64 time) = 0;
+};
+
+#endif // FRAMESINK_H
@@ -0,0 +1,26 @@
+#ifndef FRAMESTATS_H
+#define FRAMESTATS_H
+
+#include <QtGlobal>
+
+// Per-frame counters filled by Renderer::paintGL
+struct FrameStats
+{
+    int partsTotal = 0;
+    int partsFrustumCulled = 0;
+    int partsOcclusionCulled = 0;
+    int partsDrawn = 0;
+
+    int occluders = 0;
+    int occluderTriangles = 0;
+    int trianglesDrawn = 0;
+    int pointsDrawn = 0;
+
+    // Out-of-core models and point clouds
+    int chunksPending = 0;
+    qint64 residentBytes = 0;
+
+    double cullTime = 0; // ms
+};
+
+#endif // FRAMESTATS_H
@@ -0,0 +1,34 @@
+#ifndef GPUBUDGET_H
+#define GPUBUDGET_H
+
+#include <algorithm>
+#include <vector>
+
+#include <QtGlobal>
+
+// Frees the least recently drawn resources until bytes fit in budget, never what is drawn this frame.
+// Slots hold nullptr or a T with lastUsed and bytes members, freed slots are set to nullptr.
+template <typename T, typename Release>
+void evictLeastRecentlyUsed(const std::vector<T**>& slots, quint64 frame, qint64& bytes, qint64 budget, Release release)
+{
+    if (bytes <= budget)
+        return;
+
+    std::vector<std::pair<quint64, T**>> candidates;
+    for (T** slot : slots)
+        if (*slot && (*slot)->lastUsed != frame)
+            candidates.push_back(std::make_pair((*slot)->lastUsed, slot));
+
+    std::sort(candidates.begin(), candidates.end(),
+        [](const std::pair<quint64, T**>& a, const std::pair<quint64, T**>& b) { return a.first < b.first; });
+
+    for (size_t i = 0; i < candidates.size() && bytes > budget; ++i)
+    {
+        T*& resource = *candidates[i].second;
+        bytes -= resource->bytes;
+        release(resource);
+        resource = nullptr;
+    }
+}
+
+#endif // GPUBUDGET_H
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstring>
+
+#include "debug/Stable.h"
+
+#include "GpuProfiler.h"
+
+GpuProfiler::GpuProfiler() :
+    m_queryCount(0),
+    m_supported(false)
+{
+    m_active.query = nullptr;
+    m_active.stage = nullptr;
+}
+
+GpuProfiler::~GpuProfiler()
+{
+    destroy();
+}
+
+bool GpuProfiler::initialize()
+{
+    destroy();
+
+    // Creating a query fails when the context has no timer queries
+    QOpenGLTimerQuery* query = new QOpenGLTimerQuery();
+    m_supported = query->create();
+
+    if (m_supported)
+    {
+        m_free.push_back(query);
+        m_queryCount = 1;
+    }
+    else
+        delete query;
+
+    return m_supported;
+}
+
+void GpuProfiler::destroy()
+{
+    if (m_active.query)
+        m_free.push_back(m_active.query);
+
+    for (const Query& q : m_pending)
+        m_free.push_back(q.query);
+
+    for (QOpenGLTimerQuery* q : m_free)
+    {
+        q->destroy();
+        delete q;
+    }
+
+    m_free.clear();
+    m_pending.clear();
+    m_lastTimes.clear();
+    m_active.query = nullptr;
+    m_queryCount = 0;
+    m_supported = false;
+}
+
+void GpuProfiler::begin(const char* stage)
+{
+    if (!m_supported || m_active.query)
+        return;
+
+    if (m_free.empty())
+    {
+        // Results lag behind, skip the stage rather than pile up queries
+        if (m_queryCount >= maxQueries)
+            return;
+
+        QOpenGLTimerQuery* query = new QOpenGLTimerQuery();
+        query->create();
+        m_free.push_back(query);
+        ++m_queryCount;
+    }
+
+    m_active.query = m_free.back();
+    m_active.stage = stage;
+    m_free.pop_back();
+
+    m_active.query->begin();
+}
+
+void GpuProfiler::end()
+{
+    if (!m_active.query)
+        return;
+
+    m_active.query->end();
+    m_pending.push_back(m_active);
+    m_active.query = nullptr;
+}
+
+void GpuProfiler::collect()
+{
+    // Queries finish in order
+    while (!m_pending.empty() && m_pending.front().query->isResultAvailable())
+    {
+        Query q = m_pending.front();
+        m_pending.pop_front();
+
+        double time = q.query->waitForResult() / 1e6;
+        Profiler::instance()->addSample(q.stage, PROFILE_CLOCK_GPU, time);
+        m_free.push_back(q.query);
+
+        auto it = std::find_if(m_lastTimes.begin(), m_lastTimes.end(),
+            [&q](const Result& r) { return !strcmp(r.stage, q.stage); });
+        if (it != m_lastTimes.end())
+            it->time = time;
+        else
+            m_lastTimes.push_back({ q.stage, time });
+    }
+}
+
+double GpuProfiler::getLastTime(const char* stage) const
+{
+    for (const Result& r : m_lastTimes)
+        if (!strcmp(r.stage, stage))
+            return r.time;
+
+    return -1;
+}
@@ -0,0 +1,57 @@
+#ifndef GPUPROFILER_H
+#define GPUPROFILER_H
+
+#include <deque>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QOpenGLTimerQuery>
+
+#include "Profiler.h"
+
+// Times GPU stages with GL_TIME_ELAPSED queries and feeds them to the Profiler.
+// Results are collected a few frames later so that the CPU never waits for the GPU.
+// Stages can't nest. All calls need the same context to be current.
+class GpuProfiler
+{
+public:
+    GpuProfiler();
+    ~GpuProfiler();
+
+    bool initialize(); // False without timer query support, the other calls then do nothing
+    void destroy();
+
+    void begin(const char* stage);
+    void end();
+
+    // Passes finished queries on to the Profiler, call once per frame
+    void collect();
+
+    // Latest collected time of a stage in ms, -1 if none yet
+    double getLastTime(const char* stage) const;
+
+private:
+    static const int maxQueries = 32; // Stages in flight
+
+    struct Query
+    {
+        QOpenGLTimerQuery* query;
+        const char* stage;
+    };
+
+    struct Result
+    {
+        const char* stage;
+        double time;
+    };
+
+    std::vector<QOpenGLTimerQuery*> m_free;
+    std::deque<Query> m_pending;
+    std::vector<Result> m_lastTimes;
+    Query m_active;
+    int m_queryCount;
+    bool m_supported;
+};
+
+#endif // GPUPROFILER_H
@@ -0,0 +1,84 @@
+#include <cmath>
+#include <algorithm>
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+
+#include "HeadlessRecorder.h"
+#include "OffscreenRenderer.h"
+#include "CameraPath.h"
+#include "VideoWriter.h"
+#include "Profiler.h"
+
+HeadlessRecorder::HeadlessRecorder(const HeadlessRecorderSettings& settings) :
+    m_settings(settings)
+{}
+
+bool HeadlessRecorder::exec()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    OffscreenRenderer renderer(m_settings.width, m_settings.height);
+    if (!renderer.initialize())
+        return false;
+
+    renderer.setLightColor(m_settings.lightColor);
+    renderer.setModelColor(m_settings.modelColor);
+    renderer.setOcclusionCulling(m_settings.occlusionCulling);
+
+    if (!renderer.loadModel(m_settings.modelFileName))
+    {
+        qDebug() << "HeadlessRecorder: cannot load" << m_settings.modelFileName;
+        return false;
+    }
+
+    qDebug() << "HeadlessRecorder: model loaded in" << timer.elapsed() << "ms";
+
+    Camera camera;
+    CameraPath path;
+
+    if (m_settings.cameraPathFileName.isEmpty())
+        path = CameraPath::turntable(camera, m_settings.duration > 0 ? m_settings.duration : 10);
+    else if (!path.load(m_settings.cameraPathFileName))
+        return false;
+
+    double duration = m_settings.duration > 0 ? m_settings.duration : path.getDuration();
+    int frameCount = std::max(1, (int)std::lround(duration * m_settings.fps));
+
+    VideoWriter::initAv();
+    VideoWriter writer(m_settings.width, m_settings.height, m_settings.fps, m_settings.bitRate, m_settings.codecId);
+    if (!writer.open(m_settings.outputFileName.toStdString()))
+    {
+        qDebug() << "HeadlessRecorder: cannot open" << m_settings.outputFileName;
+        return false;
+    }
+
+    timer.restart();
+
+    // Frame times come from the frame index, not the wall clock
+    for (int i = 0; i < frameCount; ++i)
+    {
+        path.apply(double(i) / m_settings.fps, camera);
+
+        QImage frame = renderer.render(camera);
+        if (frame.isNull() || !writer.writeVideoFrame(frame))
+        {
+            qDebug() << "HeadlessRecorder: failed to write frame" << i;
+            writer.close();
+            return false;
+        }
+
+        if ((i + 1) % m_settings.fps == 0 || i + 1 == frameCount)
+            qDebug() << "HeadlessRecorder: frame" << i + 1 << "/" << frameCount
+                     << "," << (i + 1) * 1000. / std::max<qint64>(timer.elapsed(), 1) << "fps";
+    }
+
+    writer.close();
+
+    for (const ProfileStats& s : Profiler::instance()->getStats())
+        qDebug() << "HeadlessRecorder:" << s.stage << "avg" << s.average << "ms, p95" << s.p95 << "ms, max" << s.max << "ms";
+
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef HEADLESSRECORDER_H
+#define HEADLESSRECORDER_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QColor>
+
+struct HeadlessRecorderSettings
+{
+    QString modelFileName;
+    QString cameraPathFileName; // Empty for a turntable
+    QString outputFileName;
+    int width;
+    int height;
+    int fps;
+    int bitRate;
+    AVCodecID codecId; // AV_CODEC_ID_NONE picks the container default
+    double duration; // Seconds, 0 to use the camera path duration
+    QColor lightColor;
+    QColor modelColor;
+    bool occlusionCulling;
+};
+
+// Renders a camera path offscreen and encodes every frame, as fast as the machine allows
+class HeadlessRecorder
+{
+public:
+    explicit HeadlessRecorder(const HeadlessRecorderSettings&);
+
+    bool exec();
+
+private:
+    HeadlessRecorderSettings m_settings;
+};
+
+#endif // HEADLESSRECORDER_H
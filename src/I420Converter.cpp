@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+
+#include "debug/Stable.h"
+
+#include "I420Converter.h"
+#include "ThreadPool.h"
+
+#ifdef __GNUC__
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+// MSVC compiles any intrinsic, the kernels only run where isSupported() found the instructions
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+namespace
+{
+    // 8 bit fixed point of the yuvfshader.glsl coefficients
+    const int yB = 25, yG = 129, yR = 66;
+    const int uB = 112, uG = -74, uR = -38;
+    const int vB = -18, vG = -94, vR = 112;
+
+    // Offsets and rounding. Chroma is computed from sums of 4 pixels, 2 more bits.
+    // Results stay within [16, 240], nothing is clamped or saturated.
+    const int yBias = (16 << 8) + 128;
+    const int cBias = (128 << 10) + 512;
+
+    const int sliceRows = 32; // Per thread pool job, even
+
+    struct CpuFeatures
+    {
+        bool sse41;
+        bool avx2;
+    };
+
+    CpuFeatures detectCpuFeatures()
+    {
+        CpuFeatures features = { false, false };
+
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int leafCount = info[0];
+
+        __cpuid(info, 1);
+        features.sse41 = (info[2] >> 19) & 1;
+
+        // AVX state has to be saved by the OS too
+        bool avx = (info[2] >> 27 & 1) && (info[2] >> 28 & 1) && (_xgetbv(0) & 6) == 6;
+        if (avx && leafCount >= 7)
+        {
+            __cpuidex(info, 7, 0);
+            features.avx2 = (info[1] >> 5) & 1;
+        }
+#else
+        __builtin_cpu_init();
+        features.sse41 = __builtin_cpu_supports("sse4.1");
+        features.avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+        return features;
+    }
+
+    const CpuFeatures& getCpuFeatures()
+    {
+        static const CpuFeatures features = detectCpuFeatures();
+        return features;
+    }
+
+    // Two 16 bit lanes in 32 bits, lo first
+    int pair16(int lo, int hi)
+    {
+        return (int)(((unsigned)hi << 16) | ((unsigned)lo & 0xffff));
+    }
+
+    // Converts columns [x, width) of two rows into two rows of luma and one row of each chroma plane
+    typedef void (*RowPairKernel)(const uchar* a, const uchar* b, int x, int width, uchar* ya, uchar* yb, uchar* u, uchar* v);
+
+    inline uchar luma(const uchar* p)
+    {
+        return (uchar)((yB * p[0] + yG * p[1] + yR * p[2] + yBias) >> 8);
+    }
+
+    void convertRowsScalar(const uchar* a, const uchar* b, int x, int width, uchar* ya, uchar* yb, uchar* u, uchar* v)
+    {
+        for (; x < width; x += 2)
+        {
+            const uchar* p = a + x * 4;
+            const uchar* q = b + x * 4;
+
+            ya[x] = luma(p);
+            ya[x + 1] = luma(p + 4);
+            yb[x] = luma(q);
+            yb[x + 1] = luma(q + 4);
+
+            int sb = p[0] + p[4] + q[0] + q[4];
+            int sg = p[1] + p[5] + q[1] + q[5];
+            int sr = p[2] + p[6] + q[2] + q[6];
+
+            u[x / 2] = (uchar)((uB * sb + uG * sg + uR * sr + cBias) >> 10);
+            v[x / 2] = (uchar)((vB * sb + vG * sg + vR * sr + cBias) >> 10);
+        }
+    }
+
+    // The SIMD kernels split BGRA pixels into (B, R) and (G, A) pairs of 16 bit lanes,
+    // so that a multiply-add per pair gives each pixel's 32 bit sum in pixel order.
+
+    TARGET_SSE41 inline __m128i luma4(__m128i p)
+    {
+        __m128i br = _mm_and_si128(p, _mm_set1_epi16(0xff));
+        __m128i ga = _mm_srli_epi16(p, 8);
+
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(br, _mm_set1_epi32(pair16(yB, yR))), _mm_madd_epi16(ga, _mm_set1_epi32(pair16(yG, 0))));
+        return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(yBias)), 8);
+    }
+
+    // Channel sums of the 2x2 quads of 4 columns in the low 32 bits of each 64
+    TARGET_SSE41 inline void quadSums4(__m128i p, __m128i q, __m128i& br, __m128i& ga)
+    {
+        const __m128i lowBytes = _mm_set1_epi16(0xff);
+
+        br = _mm_add_epi16(_mm_and_si128(p, lowBytes), _mm_and_si128(q, lowBytes));
+        ga = _mm_add_epi16(_mm_srli_epi16(p, 8), _mm_srli_epi16(q, 8));
+
+        br = _mm_add_epi16(br, _mm_srli_epi64(br, 32));
+        ga = _mm_add_epi16(ga, _mm_srli_epi64(ga, 32));
+    }
+
+    TARGET_SSE41 inline __m128i chroma4(__m128i br, __m128i ga, int cb, int cg, int cr)
+    {
+        __m128i sum = _mm_add_epi32(_mm_madd_epi16(br, _mm_set1_epi32(pair16(cb, cr))), _mm_madd_epi16(ga, _mm_set1_epi32(pair16(cg, 0))));
+        return _mm_srli_epi32(_mm_add_epi32(sum, _mm_set1_epi32(cBias)), 10);
+    }
+
+    // 8 columns at a time
+    TARGET_SSE41 void convertRowsSse41(const uchar* a, const uchar* b, int x, int width, uchar* ya, uchar* yb, uchar* u, uchar* v)
+    {
+        for (; x + 8 <= width; x += 8)
+        {
+            __m128i a0 = _mm_loadu_si128((const __m128i*)(a + x * 4));
+            __m128i a1 = _mm_loadu_si128((const __m128i*)(a + x * 4 + 16));
+            __m128i b0 = _mm_loadu_si128((const __m128i*)(b + x * 4));
+            __m128i b1 = _mm_loadu_si128((const __m128i*)(b + x * 4 + 16));
+
+            // Row a in the low 8 bytes, row b in the high ones
+            __m128i y = _mm_packus_epi16(_mm_packus_epi32(luma4(a0), luma4(a1)), _mm_packus_epi32(luma4(b0), luma4(b1)));
+            _mm_storel_epi64((__m128i*)(ya + x), y);
+            _mm_storel_epi64((__m128i*)(yb + x), _mm_unpackhi_epi64(y, y));
+
+            __m128i br0, ga0, br1, ga1;
+            quadSums4(a0, b0, br0, ga0);
+            quadSums4(a1, b1, br1, ga1);
+
+            // Quads 0 2 1 3 after the blend, in order after the shuffle
+            __m128i br = _mm_shuffle_epi32(_mm_blend_epi16(br0, _mm_slli_epi64(br1, 32), 0xcc), _MM_SHUFFLE(3, 1, 2, 0));
+            __m128i ga = _mm_shuffle_epi32(_mm_blend_epi16(ga0, _mm_slli_epi64(ga1, 32), 0xcc), _MM_SHUFFLE(3, 1, 2, 0));
+
+            // U in the first 4 bytes, V in the next 4
+            __m128i uv = _mm_packus_epi32(chroma4(br, ga, uB, uG, uR), chroma4(br, ga, vB, vG, vR));
+            uv = _mm_packus_epi16(uv, uv);
+
+            int u4 = _mm_cvtsi128_si32(uv);
+            int v4 = _mm_extract_epi32(uv, 1);
+            memcpy(u + x / 2, &u4, 4);
+            memcpy(v + x / 2, &v4, 4);
+        }
+
+        convertRowsScalar(a, b, x, width, ya, yb, u, v);
+    }
+
+    TARGET_AVX2 inline __m256i luma8(__m256i p)
+    {
+        __m256i br = _mm256_and_si256(p, _mm256_set1_epi16(0xff));
+        __m256i ga = _mm256_srli_epi16(p, 8);
+
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(br, _mm256_set1_epi32(pair16(yB, yR))), _mm256_madd_epi16(ga, _mm256_set1_epi32(pair16(yG, 0))));
+        return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(yBias)), 8);
+    }
+
+    TARGET_AVX2 inline void quadSums8(__m256i p, __m256i q, __m256i& br, __m256i& ga)
+    {
+        const __m256i lowBytes = _mm256_set1_epi16(0xff);
+
+        br = _mm256_add_epi16(_mm256_and_si256(p, lowBytes), _mm256_and_si256(q, lowBytes));
+        ga = _mm256_add_epi16(_mm256_srli_epi16(p, 8), _mm256_srli_epi16(q, 8));
+
+        br = _mm256_add_epi16(br, _mm256_srli_epi64(br, 32));
+        ga = _mm256_add_epi16(ga, _mm256_srli_epi64(ga, 32));
+    }
+
+    TARGET_AVX2 inline __m256i chroma8(__m256i br, __m256i ga, int cb, int cg, int cr)
+    {
+        __m256i sum = _mm256_add_epi32(_mm256_madd_epi16(br, _mm256_set1_epi32(pair16(cb, cr))), _mm256_madd_epi16(ga, _mm256_set1_epi32(pair16(cg, 0))));
+        return _mm256_srli_epi32(_mm256_add_epi32(sum, _mm256_set1_epi32(cBias)), 10);
+    }
+
+    // 16 columns at a time. Packing works within 128 bit lanes, a permute puts the results back in order.
+    TARGET_AVX2 void convertRowsAvx2(const uchar* a, const uchar* b, int x, int width, uchar* ya, uchar* yb, uchar* u, uchar* v)
+    {
+        const __m256i lumaOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        const __m256i quadOrder = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+
+        for (; x + 16 <= width; x += 16)
+        {
+            __m256i a0 = _mm256_loadu_si256((const __m256i*)(a + x * 4));
+            __m256i a1 = _mm256_loadu_si256((const __m256i*)(a + x * 4 + 32));
+            __m256i b0 = _mm256_loadu_si256((const __m256i*)(b + x * 4));
+            __m256i b1 = _mm256_loadu_si256((const __m256i*)(b + x * 4 + 32));
+
+            // Row a in the low 16 bytes, row b in the high ones
+            __m256i y = _mm256_packus_epi16(_mm256_packus_epi32(luma8(a0), luma8(a1)), _mm256_packus_epi32(luma8(b0), luma8(b1)));
+            y = _mm256_permutevar8x32_epi32(y, lumaOrder);
+            _mm_storeu_si128((__m128i*)(ya + x), _mm256_castsi256_si128(y));
+            _mm_storeu_si128((__m128i*)(yb + x), _mm256_extracti128_si256(y, 1));
+
+            __m256i br0, ga0, br1, ga1;
+            quadSums8(a0, b0, br0, ga0);
+            quadSums8(a1, b1, br1, ga1);
+
+            __m256i br = _mm256_permutevar8x32_epi32(_mm256_blend_epi32(br0, _mm256_slli_epi64(br1, 32), 0xaa), quadOrder);
+            __m256i ga = _mm256_permutevar8x32_epi32(_mm256_blend_epi32(ga0, _mm256_slli_epi64(ga1, 32), 0xaa), quadOrder);
+
+            // U in the first 8 bytes, V in the next 8
+            __m256i uv = _mm256_packus_epi32(chroma8(br, ga, uB, uG, uR), chroma8(br, ga, vB, vG, vR));
+            uv = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(uv, uv), lumaOrder);
+
+            __m128i uv16 = _mm256_castsi256_si128(uv);
+            _mm_storel_epi64((__m128i*)(u + x / 2), uv16);
+            _mm_storel_epi64((__m128i*)(v + x / 2), _mm_unpackhi_epi64(uv16, uv16));
+        }
+
+        convertRowsScalar(a, b, x, width, ya, yb, u, v);
+    }
+}
+
+ConvertKernel I420Converter::getBestKernel()
+{
+    static const ConvertKernel kernel =
+        isSupported(CONVERT_KERNEL_AVX2) ? CONVERT_KERNEL_AVX2 :
+        isSupported(CONVERT_KERNEL_SSE41) ? CONVERT_KERNEL_SSE41 : CONVERT_KERNEL_SCALAR;
+    return kernel;
+}
+
+bool I420Converter::isSupported(ConvertKernel kernel)
+{
+    switch (kernel)
+    {
+    case CONVERT_KERNEL_SCALAR:
+        return true;
+    case CONVERT_KERNEL_SSE41:
+        return getCpuFeatures().sse41;
+    case CONVERT_KERNEL_AVX2:
+        return getCpuFeatures().avx2;
+    }
+
+    return false;
+}
+
+const char* I420Converter::getKernelName(ConvertKernel kernel)
+{
+    switch (kernel)
+    {
+    case CONVERT_KERNEL_SCALAR:
+        return "scalar";
+    case CONVERT_KERNEL_SSE41:
+        return "sse4.1";
+    case CONVERT_KERNEL_AVX2:
+        return "avx2";
+    }
+
+    return "";
+}
+
+bool I420Converter::convert(const uchar* pixels, int stride, int width, int height, uchar* const planes[3], const int strides[3])
+{
+    return convert(pixels, stride, width, height, planes, strides, getBestKernel(), true);
+}
+
+bool I420Converter::convert(const uchar* pixels, int stride, int width, int height, uchar* const planes[3], const int strides[3],
+    ConvertKernel kernel, bool parallel)
+{
+    if (width <= 0 || height <= 0 || width % 2 || height % 2 || !isSupported(kernel))
+        return false;
+
+    RowPairKernel convertRows = convertRowsScalar;
+    if (kernel == CONVERT_KERNEL_AVX2)
+        convertRows = convertRowsAvx2;
+    else if (kernel == CONVERT_KERNEL_SSE41)
+        convertRows = convertRowsSse41;
+
+    int pairs = height / 2;
+    int slicePairs = sliceRows / 2;
+    int slices = (pairs + slicePairs - 1) / slicePairs;
+
+    auto convertSlice = [&](int slice)
+    {
+        int end = std::min(pairs, (slice + 1) * slicePairs);
+
+        for (int pair = slice * slicePairs; pair < end; ++pair)
+        {
+            int y = pair * 2;
+            const uchar* a = pixels + (ptrdiff_t)y * stride;
+
+            convertRows(a, a + stride, 0, width,
+                planes[0] + (ptrdiff_t)y * strides[0], planes[0] + (ptrdiff_t)(y + 1) * strides[0],
+                planes[1] + (ptrdiff_t)pair * strides[1], planes[2] + (ptrdiff_t)pair * strides[2]);
+        }
+    };
+
+    if (parallel)
+        ThreadPool::instance()->parallelFor(slices, convertSlice);
+    else
+        for (int slice = 0; slice < slices; ++slice)
+            convertSlice(slice);
+
+    return true;
+}
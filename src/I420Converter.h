@@ -0,0 +1,32 @@
+#ifndef I420CONVERTER_H
+#define I420CONVERTER_H
+
+#include "debug/Stable.h"
+
+#include <QtGlobal>
+
+enum ConvertKernel
+{
+    CONVERT_KERNEL_SCALAR,
+    CONVERT_KERNEL_SSE41,
+    CONVERT_KERNEL_AVX2
+};
+
+// Converts BGRA images (QImage::Format_RGB32 in memory) to YUV 4:2:0 planes of the same size,
+// BT.601 limited range with chroma averaged over 2x2 pixels, like YuvConverter does on the GPU.
+// Slices of rows are converted on the thread pool by the widest kernel the CPU has,
+// every kernel gives the same output. Scaling is left to swscale.
+class I420Converter
+{
+public:
+    static ConvertKernel getBestKernel(); // Detected once
+    static bool isSupported(ConvertKernel);
+    static const char* getKernelName(ConvertKernel);
+
+    // Rows of pixels are stride bytes apart, negative for bottom-up images. False for odd sizes.
+    static bool convert(const uchar* pixels, int stride, int width, int height, uchar* const planes[3], const int strides[3]);
+    static bool convert(const uchar* pixels, int stride, int width, int height, uchar* const planes[3], const int strides[3],
+        ConvertKernel kernel, bool parallel);
+};
+
+#endif // I420CONVERTER_H
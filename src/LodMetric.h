@@ -0,0 +1,42 @@
+#ifndef LODMETRIC_H
+#define LODMETRIC_H
+
+#include <algorithm>
+
+#include <QMatrix4x4>
+
+#include "BoundingBox.h"
+
+// Screen size of model space lengths for one frame, the out-of-core models pick their detail by it
+struct LodMetric
+{
+    LodMetric(const QMatrix4x4& view, const QMatrix4x4& projection, int viewportHeight) :
+        modelView(view),
+        scale(view.column(0).toVector3D().length()),
+        pixelsPerUnit(scale * projection(1, 1) * viewportHeight / 2)
+    {}
+
+    // Of the bounding sphere, in eye units
+    float radius(const BoundingBox& bbox) const
+    {
+        return bbox.size().length() / 2 * scale;
+    }
+
+    // To the nearest point of the bounding sphere, in eye units
+    float distance(const BoundingBox& bbox) const
+    {
+        return std::max(modelView.map(bbox.center()).length() - radius(bbox), 1e-3f);
+    }
+
+    // Pixels covered by a model space length at an eye distance
+    float pixels(float length, float distance) const
+    {
+        return length * pixelsPerUnit / distance;
+    }
+
+    QMatrix4x4 modelView;
+    float scale; // Model units to eye units
+    float pixelsPerUnit; // Model units to pixels at eye distance 1
+};
+
+#endif // LODMETRIC_H
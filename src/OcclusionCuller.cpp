@@ -0,0 +1,498 @@
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+
+#include "OcclusionCuller.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const int subcells = 8; // Per side of a buffer pixel in the coverage masks
+    const quint64 fullCoverage = ~(quint64)0;
+
+    // Subcells of pixel (x, y) whose centers are inside the triangle with edge functions a * x + b * y + c,
+    // a row of 8 bits per subcell row. In a convex triangle the covered cells of a row are contiguous.
+    // Samples on a shared edge count for both triangles, so a tessellated surface leaves no holes.
+    quint64 coverageMask(const float a[3], const float b[3], const float c[3], int x, int y)
+    {
+        quint64 mask = 0;
+
+        for (int row = 0; row < subcells; ++row)
+        {
+            float cy = y + (row + 0.5f) / subcells;
+            float lo = 0, hi = subcells - 1;
+
+            for (int k = 0; k < 3 && lo <= hi; ++k)
+            {
+                float r = b[k] * cy + c[k];
+
+                // Subcell i is inside where a * (x + (i + 0.5) / subcells) + r >= 0
+                if (a[k] > 0)
+                    lo = std::max(lo, std::ceil((-r / a[k] - x) * subcells - 0.5f));
+                else if (a[k] < 0)
+                    hi = std::min(hi, std::floor((-r / a[k] - x) * subcells - 0.5f));
+                else if (r < 0)
+                    hi = -1;
+            }
+
+            if (lo <= hi)
+            {
+                int first = (int)lo, last = (int)hi;
+                mask |= (quint64)((0xffu >> (subcells - 1 - last)) & (0xffu << first)) << (row * subcells);
+            }
+        }
+
+        return mask;
+    }
+}
+
+enum PartState
+{
+    PART_VISIBLE,
+    PART_FRUSTUM_CULLED,
+    PART_OCCLUSION_CULLED
+};
+
+OcclusionCuller::OcclusionCuller(int width, int height) :
+    m_width(width),
+    m_height(height),
+    m_tilesX((width + tileWidth - 1) / tileWidth),
+    m_tilesY((height + tileHeight - 1) / tileHeight),
+    m_enabled(true),
+    m_minOccluderArea(0.01f),
+    m_maxOccluderTriangles(65536),
+    m_depth(width * height),
+    m_layerMask(width * height),
+    m_layerDepth(width * height),
+    m_tileMaxDepth(m_tilesX * m_tilesY),
+    m_bins(m_tilesX * m_tilesY)
+{}
+
+void OcclusionCuller::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool OcclusionCuller::isEnabled()
+{
+    return m_enabled;
+}
+
+void OcclusionCuller::cull(const Model& model, const QMatrix4x4& mvp, std::vector<int>& visibleParts, FrameStats& stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const std::vector<Part>& parts = model.getParts();
+    int partCount = (int)parts.size();
+
+    m_boxes.resize(partCount);
+    m_partState.assign(partCount, PART_VISIBLE);
+
+    // Frustum culling
+    for (int i = 0; i < partCount; ++i)
+    {
+        if (!projectBox(parts[i].bbox, mvp, m_boxes[i]))
+            m_partState[i] = PART_FRUSTUM_CULLED;
+    }
+
+    std::vector<int> occluders;
+    m_triangles.clear();
+
+    if (m_enabled)
+    {
+        // Pick the parts that cover the most of the screen as occluders
+        std::vector<std::pair<float, int>> candidates;
+        float screenArea = (float)(m_width * m_height);
+
+        for (int i = 0; i < partCount; ++i)
+        {
+            const ScreenBox& b = m_boxes[i];
+
+            if (m_partState[i] != PART_VISIBLE || b.nearClipped)
+                continue;
+
+            float area = (b.maxX - b.minX) * (b.maxY - b.minY) / screenArea;
+            if (area >= m_minOccluderArea)
+                candidates.push_back(std::make_pair(area, i));
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [](const std::pair<float, int>& a, const std::pair<float, int>& b) { return a.first > b.first; });
+
+        int triangles = 0;
+        for (const std::pair<float, int>& c : candidates)
+        {
+            int n = parts[c.second].indexCount / 3;
+            if (triangles + n > m_maxOccluderTriangles)
+                continue;
+
+            triangles += n;
+            occluders.push_back(c.second);
+        }
+
+        rasterizeOccluders(model, mvp, occluders);
+
+        // Test bounding boxes in batches
+        const int batch = 64;
+        ThreadPool::instance()->parallelFor((partCount + batch - 1) / batch, [&](int b)
+        {
+            int end = std::min(partCount, (b + 1) * batch);
+
+            for (int i = b * batch; i < end; ++i)
+            {
+                if (m_partState[i] == PART_VISIBLE && !m_boxes[i].nearClipped && isOccluded(m_boxes[i]))
+                    m_partState[i] = PART_OCCLUSION_CULLED;
+            }
+        });
+    }
+
+    visibleParts.clear();
+
+    stats.partsTotal = partCount;
+    stats.partsFrustumCulled = 0;
+    stats.partsOcclusionCulled = 0;
+    stats.trianglesDrawn = 0;
+
+    for (int i = 0; i < partCount; ++i)
+    {
+        switch (m_partState[i])
+        {
+        case PART_VISIBLE:
+            visibleParts.push_back(i);
+            stats.trianglesDrawn += parts[i].indexCount / 3;
+            break;
+
+        case PART_FRUSTUM_CULLED:
+            ++stats.partsFrustumCulled;
+            break;
+
+        case PART_OCCLUSION_CULLED:
+            ++stats.partsOcclusionCulled;
+            break;
+        }
+    }
+
+    stats.partsDrawn = (int)visibleParts.size();
+    stats.occluders = (int)occluders.size();
+    stats.occluderTriangles = 0;
+    for (const ScreenTriangle& t : m_triangles)
+        stats.occluderTriangles += t.valid;
+
+    stats.cullTime = timer.nsecsElapsed() / 1e6;
+}
+
+bool OcclusionCuller::projectBox(const BoundingBox& bbox, const QMatrix4x4& mvp, ScreenBox& box)
+{
+    // Outcodes for the six clip planes, a box is outside if all corners are outside one plane
+    int outsideAll = 0x3f;
+
+    box.minX = box.minY = box.minZ = FLT_MAX;
+    box.maxX = box.maxY = -FLT_MAX;
+    box.nearClipped = false;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        QVector4D c = mvp * QVector4D(bbox.corner(i), 1.f);
+        float w = c.w();
+
+        int out = 0;
+        if (c.x() < -w) out |= 1;
+        if (c.x() > w) out |= 2;
+        if (c.y() < -w) out |= 4;
+        if (c.y() > w) out |= 8;
+        if (c.z() < -w) out |= 16;
+        if (c.z() > w) out |= 32;
+        outsideAll &= out;
+
+        if (out & 16 || w <= 0)
+        {
+            box.nearClipped = true;
+            continue;
+        }
+
+        float x = (c.x() / w * 0.5f + 0.5f) * m_width;
+        float y = (c.y() / w * 0.5f + 0.5f) * m_height;
+        float z = c.z() / w * 0.5f + 0.5f;
+
+        box.minX = std::min(box.minX, x);
+        box.maxX = std::max(box.maxX, x);
+        box.minY = std::min(box.minY, y);
+        box.maxY = std::max(box.maxY, y);
+        box.minZ = std::min(box.minZ, z);
+    }
+
+    return outsideAll == 0;
+}
+
+void OcclusionCuller::rasterizeOccluders(const Model& model, const QMatrix4x4& mvp, const std::vector<int>& occluders)
+{
+    const std::vector<Vertex>& vertices = model.getVertices();
+    const std::vector<GLuint>& indices = model.getIndices();
+    const std::vector<Part>& parts = model.getParts();
+
+    std::vector<int> offsets(occluders.size() + 1, 0);
+    for (int i = 0; i < (int)occluders.size(); ++i)
+        offsets[i + 1] = offsets[i] + parts[occluders[i]].indexCount / 3;
+
+    m_triangles.resize(offsets.back());
+
+    // Transform occluder triangles to screen space
+    ThreadPool::instance()->parallelFor((int)occluders.size(), [&](int o)
+    {
+        const Part& part = parts[occluders[o]];
+
+        for (int t = 0; t < part.indexCount / 3; ++t)
+        {
+            ScreenTriangle& tri = m_triangles[offsets[o] + t];
+            tri.valid = true;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                QVector4D c = mvp * QVector4D(vertices[indices[part.firstIndex + t * 3 + k]].pos, 1.f);
+
+                // Dropping an occluder is always safe
+                if (c.z() < -c.w() || c.w() <= 0)
+                {
+                    tri.valid = false;
+                    break;
+                }
+
+                tri.x[k] = (c.x() / c.w() * 0.5f + 0.5f) * m_width;
+                tri.y[k] = (c.y() / c.w() * 0.5f + 0.5f) * m_height;
+                tri.z[k] = c.z() / c.w() * 0.5f + 0.5f;
+            }
+
+            if (!tri.valid)
+                continue;
+
+            float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+
+            if (std::fabs(area) < 1e-6f)
+                tri.valid = false;
+            else if (area < 0)
+            {
+                std::swap(tri.x[1], tri.x[2]);
+                std::swap(tri.y[1], tri.y[2]);
+                std::swap(tri.z[1], tri.z[2]);
+            }
+        }
+    });
+
+    // Bin triangles into screen tiles
+    for (std::vector<int>& bin : m_bins)
+        bin.clear();
+
+    for (int i = 0; i < (int)m_triangles.size(); ++i)
+    {
+        const ScreenTriangle& t = m_triangles[i];
+        if (!t.valid)
+            continue;
+
+        float minX = std::min(std::min(t.x[0], t.x[1]), t.x[2]);
+        float maxX = std::max(std::max(t.x[0], t.x[1]), t.x[2]);
+        float minY = std::min(std::min(t.y[0], t.y[1]), t.y[2]);
+        float maxY = std::max(std::max(t.y[0], t.y[1]), t.y[2]);
+
+        if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+            continue;
+
+        int tx0 = std::max(0, (int)minX / tileWidth);
+        int tx1 = std::min(m_tilesX - 1, (int)maxX / tileWidth);
+        int ty0 = std::max(0, (int)minY / tileHeight);
+        int ty1 = std::min(m_tilesY - 1, (int)maxY / tileHeight);
+
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx)
+                m_bins[ty * m_tilesX + tx].push_back(i);
+    }
+
+    // Every tile is owned by one job so there are no write conflicts
+    ThreadPool::instance()->parallelFor(m_tilesX * m_tilesY, [this](int tile) { rasterizeTile(tile); });
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+    int tileX0 = (tile % m_tilesX) * tileWidth;
+    int tileY0 = (tile / m_tilesX) * tileHeight;
+    int tileX1 = std::min(tileX0 + tileWidth, m_width);
+    int tileY1 = std::min(tileY0 + tileHeight, m_height);
+
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+
+    for (int y = tileY0; y < tileY1; ++y)
+    {
+        for (int x = tileX0; x < tileX1; x += 4)
+            _mm_storeu_ps(&m_depth[y * m_width + x], one);
+
+        std::fill(&m_layerMask[y * m_width + tileX0], &m_layerMask[y * m_width + tileX1], 0);
+        std::fill(&m_layerDepth[y * m_width + tileX0], &m_layerDepth[y * m_width + tileX1], 0.f);
+    }
+
+    for (int i : m_bins[tile])
+    {
+        const ScreenTriangle& t = m_triangles[i];
+
+        // Edge functions E(x, y) = a * x + b * y + c, positive inside
+        float a[3], b[3], c[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            int n = (k + 1) % 3;
+            a[k] = t.y[k] - t.y[n];
+            b[k] = t.x[n] - t.x[k];
+            c[k] = t.y[n] * t.x[k] - t.x[n] * t.y[k];
+        }
+
+        // Depth plane from barycentrics, edge k is opposite vertex (k + 2) % 3
+        float area = c[0] + c[1] + c[2];
+        float za = (a[1] * t.z[0] + a[2] * t.z[1] + a[0] * t.z[2]) / area;
+        float zb = (b[1] * t.z[0] + b[2] * t.z[1] + b[0] * t.z[2]) / area;
+        float zc = (c[1] * t.z[0] + c[2] * t.z[1] + c[0] * t.z[2]) / area;
+
+        // A buffer pixel spans several screen pixels. Pixels the triangle covers entirely are written at the
+        // farthest depth it reaches over them, edges tested at the pixel corner farthest inside. Pixels it
+        // only touches merge its subcell coverage at that depth, see mergeCoverage().
+        float h[3];
+        for (int k = 0; k < 3; ++k)
+            h[k] = 0.5f * (std::fabs(a[k]) + std::fabs(b[k]));
+        float farZc = zc + 0.5f * (std::fabs(za) + std::fabs(zb));
+
+        int x0 = std::max(tileX0, (int)std::floor(std::min(std::min(t.x[0], t.x[1]), t.x[2]))) & ~3;
+        int x1 = std::min(tileX1, (int)std::ceil(std::max(std::max(t.x[0], t.x[1]), t.x[2])) + 1);
+        int y0 = std::max(tileY0, (int)std::floor(std::min(std::min(t.y[0], t.y[1]), t.y[2])));
+        int y1 = std::min(tileY1, (int)std::ceil(std::max(std::max(t.y[0], t.y[1]), t.y[2])) + 1);
+
+        __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+        __m128 stepE0 = _mm_set1_ps(a[0] * 4), stepE1 = _mm_set1_ps(a[1] * 4), stepE2 = _mm_set1_ps(a[2] * 4);
+        __m128 stepZ = _mm_set1_ps(za * 4);
+        __m128 h0 = _mm_set1_ps(h[0]), h1 = _mm_set1_ps(h[1]), h2 = _mm_set1_ps(h[2]);
+        __m128 nh0 = _mm_set1_ps(-h[0]), nh1 = _mm_set1_ps(-h[1]), nh2 = _mm_set1_ps(-h[2]);
+
+        for (int y = y0; y < y1; ++y)
+        {
+            float py = y + 0.5f;
+            __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), laneOffset);
+
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), _mm_set1_ps(b[0] * py + c[0]));
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), _mm_set1_ps(b[1] * py + c[1]));
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), _mm_set1_ps(b[2] * py + c[2]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), _mm_set1_ps(zb * py + farZc));
+
+            float* row = &m_depth[y * m_width];
+
+            for (int x = x0; x < x1; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, h0), _mm_cmpge_ps(e1, h1)), _mm_cmpge_ps(e2, h2));
+                __m128 touched = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(e0, nh0), _mm_cmpgt_ps(e1, nh1)), _mm_cmpgt_ps(e2, nh2));
+
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 d = _mm_loadu_ps(row + x);
+                    __m128 nd = _mm_min_ps(d, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nd), _mm_andnot_ps(inside, d)));
+                }
+
+                int partial = _mm_movemask_ps(_mm_andnot_ps(inside, touched));
+                if (partial)
+                {
+                    float farZ[4];
+                    _mm_storeu_ps(farZ, z);
+
+                    for (int lane = 0; lane < 4; ++lane)
+                    {
+                        if (partial & (1 << lane))
+                            mergeCoverage(y * m_width + x + lane, coverageMask(a, b, c, x + lane, y), farZ[lane]);
+                    }
+                }
+
+                e0 = _mm_add_ps(e0, stepE0);
+                e1 = _mm_add_ps(e1, stepE1);
+                e2 = _mm_add_ps(e2, stepE2);
+                z = _mm_add_ps(z, stepZ);
+            }
+        }
+    }
+
+    // Farthest occluder depth in the tile, used to reject whole tiles in the box test
+    __m128 maxDepth = zero;
+    for (int y = tileY0; y < tileY1; ++y)
+        for (int x = tileX0; x < tileX1; x += 4)
+            maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(&m_depth[y * m_width + x]));
+
+    maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(1, 0, 3, 2)));
+    maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(2, 3, 0, 1)));
+    _mm_store_ss(&m_tileMaxDepth[tile], maxDepth);
+}
+
+void OcclusionCuller::mergeCoverage(int pixel, quint64 mask, float z)
+{
+    // Behind what already covers the pixel
+    if (!mask || z >= m_depth[pixel])
+        return;
+
+    // One layer per pixel that only ever gets farther, like masked occlusion culling without the second layer.
+    // Once its subcells cover the whole pixel, the pixel is covered at the layer's depth.
+    m_layerMask[pixel] |= mask;
+    m_layerDepth[pixel] = std::max(m_layerDepth[pixel], z);
+
+    if (m_layerMask[pixel] == fullCoverage)
+    {
+        m_depth[pixel] = std::min(m_depth[pixel], m_layerDepth[pixel]);
+        m_layerMask[pixel] = 0;
+        m_layerDepth[pixel] = 0;
+    }
+}
+
+bool OcclusionCuller::isOccluded(const ScreenBox& box)
+{
+    int x0 = std::max(0, (int)std::floor(box.minX));
+    int x1 = std::min(m_width - 1, (int)std::floor(box.maxX));
+    int y0 = std::max(0, (int)std::floor(box.minY));
+    int y1 = std::min(m_height - 1, (int)std::floor(box.maxY));
+
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    __m128 z = _mm_set1_ps(box.minZ);
+
+    for (int ty = y0 / tileHeight; ty <= y1 / tileHeight; ++ty)
+    {
+        for (int tx = x0 / tileWidth; tx <= x1 / tileWidth; ++tx)
+        {
+            // Every pixel of the tile is in front of the box
+            if (m_tileMaxDepth[ty * m_tilesX + tx] <= box.minZ)
+                continue;
+
+            int px0 = std::max(x0, tx * tileWidth);
+            int px1 = std::min(x1, tx * tileWidth + tileWidth - 1);
+            int py0 = std::max(y0, ty * tileHeight);
+            int py1 = std::min(y1, ty * tileHeight + tileHeight - 1);
+
+            for (int y = py0; y <= py1; ++y)
+            {
+                const float* row = &m_depth[y * m_width];
+                int x = px0;
+
+                for (; x + 3 <= px1; x += 4)
+                {
+                    if (_mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row + x), z)))
+                        return false;
+                }
+
+                for (; x <= px1; ++x)
+                {
+                    if (row[x] > box.minZ)
+                        return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
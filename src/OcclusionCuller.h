@@ -0,0 +1,74 @@
+#ifndef OCCLUSIONCULLER_H
+#define OCCLUSIONCULLER_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QMatrix4x4>
+
+#include "model.h"
+#include "FrameStats.h"
+
+// CPU occlusion culling in the spirit of masked occlusion culling:
+// the biggest parts on screen are rasterized into a small depth buffer
+// by an SSE tile rasterizer, then every part's bounding box is tested against it.
+// A buffer pixel is filled once occluders cover it entirely, at the farthest depth they reach
+// over it. Coverage is merged from several triangles on a grid of 8x8 samples per pixel, about
+// one per screen pixel at 1080p, so dense meshes of small triangles occlude too. Only gaps
+// narrower than a sample can be missed, as in masked occlusion culling.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(int width = 256, int height = 128);
+
+    void setEnabled(bool);
+    bool isEnabled();
+
+    // Fills visibleParts with the indices of parts that pass the frustum and occlusion tests
+    void cull(const Model& model, const QMatrix4x4& mvp, std::vector<int>& visibleParts, FrameStats& stats);
+
+private:
+    static const int tileWidth = 32;
+    static const int tileHeight = 16;
+
+    struct ScreenBox
+    {
+        float minX, minY, maxX, maxY;
+        float minZ;
+        bool nearClipped; // Crosses the near plane, can't be tested
+    };
+
+    struct ScreenTriangle
+    {
+        float x[3], y[3], z[3];
+        bool valid;
+    };
+
+    bool projectBox(const BoundingBox&, const QMatrix4x4& mvp, ScreenBox&);
+    void rasterizeOccluders(const Model&, const QMatrix4x4& mvp, const std::vector<int>& occluders);
+    void rasterizeTile(int tile);
+    void mergeCoverage(int pixel, quint64 mask, float z); // Subcells of a pixel covered no farther than z
+    bool isOccluded(const ScreenBox&);
+
+    int m_width;
+    int m_height;
+    int m_tilesX;
+    int m_tilesY;
+
+    bool m_enabled;
+    float m_minOccluderArea; // Fraction of the screen
+    int m_maxOccluderTriangles;
+
+    std::vector<float> m_depth;
+    std::vector<quint64> m_layerMask; // Subcells covered by occluders that did not cover the whole pixel
+    std::vector<float> m_layerDepth; // Farthest depth of those occluders
+    std::vector<float> m_tileMaxDepth;
+    std::vector<ScreenTriangle> m_triangles;
+    std::vector<std::vector<int>> m_bins;
+
+    std::vector<ScreenBox> m_boxes;
+    std::vector<char> m_partState;
+};
+
+#endif // OCCLUSIONCULLER_H
@@ -0,0 +1,209 @@
+#include "debug/Stable.h"
+
+#include <QOpenGLFunctions>
+
+#include "OffscreenRenderer.h"
+#include "ModelLoader.h"
+#include "AoBaker.h"
+#include "Profiler.h"
+#include "PosterRenderer.h"
+
+OffscreenRenderer::OffscreenRenderer(int w, int h) :
+    m_width(w),
+    m_height(h),
+    m_fbo(nullptr),
+    m_model(nullptr),
+    m_pointCloud(nullptr),
+    m_lightColor(Qt::white),
+    m_modelColor(Qt::white)
+{}
+
+OffscreenRenderer::~OffscreenRenderer()
+{
+    // Buffers belong to the offscreen context
+    if (m_context.isValid())
+        m_context.makeCurrent(&m_surface);
+
+    m_scene.destroy();
+    delete m_model;
+    delete m_pointCloud;
+    delete m_fbo;
+
+    m_context.doneCurrent();
+}
+
+bool OffscreenRenderer::initialize()
+{
+    m_surface.setFormat(QSurfaceFormat::defaultFormat());
+    m_surface.create();
+
+    m_context.setFormat(QSurfaceFormat::defaultFormat());
+    if (!m_context.create() || !m_context.makeCurrent(&m_surface))
+    {
+        qDebug() << "OffscreenRenderer: cannot create OpenGL context";
+        return false;
+    }
+
+    qDebug() << "OffscreenRenderer:" << (const char*)m_context.functions()->glGetString(GL_RENDERER);
+
+    if (!m_scene.initialize())
+        return false;
+
+    m_scene.resize(m_width, m_height);
+    m_model = new Model();
+
+    m_context.doneCurrent();
+    return true;
+}
+
+bool OffscreenRenderer::loadModel(QString fileName)
+{
+    ModelLoader loader(fileName);
+    loader.start();
+    loader.wait();
+
+    if (!loader.isReady())
+        return false;
+
+    m_context.makeCurrent(&m_surface);
+
+    delete m_model;
+    m_model = new Model();
+
+    delete m_pointCloud;
+    m_pointCloud = nullptr;
+
+    if (loader.isPointCloud())
+    {
+        PointOctree octree;
+        loader.read(octree);
+
+        m_pointCloud = new PointCloud();
+        m_pointCloud->load(octree);
+
+        m_context.doneCurrent();
+        return true;
+    }
+
+    loader.read(m_model);
+
+    // Same shading as the viewport, usually read back from the cache
+    AoBaker baker(m_model, nullptr, fileName);
+    baker.start();
+    baker.wait();
+    baker.read(m_model);
+
+    m_context.doneCurrent();
+    return true;
+}
+
+void OffscreenRenderer::setLightColor(QColor c)
+{
+    m_lightColor = c;
+}
+
+void OffscreenRenderer::setModelColor(QColor c)
+{
+    m_modelColor = c;
+}
+
+void OffscreenRenderer::setOcclusionCulling(bool enabled)
+{
+    m_scene.setOcclusionCulling(enabled);
+}
+
+QImage OffscreenRenderer::render(const Camera& camera)
+{
+    m_context.makeCurrent(&m_surface);
+
+    if (!draw(camera))
+    {
+        m_context.doneCurrent();
+        return QImage();
+    }
+
+    // Top row first, the same layout the widget read back produces
+    ProfileScope scope("Readback");
+    QImage img = m_fbo->toImage();
+
+    m_fbo->release();
+    m_context.doneCurrent();
+
+    return img;
+}
+
+bool OffscreenRenderer::draw(const Camera& camera)
+{
+    if (!m_fbo)
+    {
+        m_fbo = new QOpenGLFramebufferObject(m_width, m_height, QOpenGLFramebufferObject::Depth);
+        if (!m_fbo->isValid())
+        {
+            qDebug() << "OffscreenRenderer: cannot create" << m_width << "x" << m_height << "framebuffer";
+            delete m_fbo;
+            m_fbo = nullptr;
+            return false;
+        }
+    }
+
+    m_fbo->bind();
+
+    m_context.functions()->glViewport(0, 0, m_width, m_height);
+    if (m_pointCloud)
+    {
+        // Every frame is complete, upload until nothing is missing
+        do
+            m_scene.render(m_pointCloud, camera, m_lightColor, m_modelColor);
+        while (m_pointCloud->isStreaming());
+    }
+    else
+        m_scene.render(m_model, camera, m_lightColor, m_modelColor);
+
+    return true;
+}
+
+void OffscreenRenderer::makeCurrent()
+{
+    m_context.makeCurrent(&m_surface);
+}
+
+void OffscreenRenderer::doneCurrent()
+{
+    m_context.doneCurrent();
+}
+
+FrameStats OffscreenRenderer::getFrameStats() const
+{
+    return m_scene.getFrameStats();
+}
+
+bool OffscreenRenderer::renderPoster(const Camera& camera, QString fileName)
+{
+    m_context.makeCurrent(&m_surface);
+
+    PosterRenderer poster;
+    bool ok = poster.render(m_scene, m_width, m_height, fileName, [this, &camera]()
+    {
+        if (m_pointCloud)
+        {
+            m_scene.render(m_pointCloud, camera, m_lightColor, m_modelColor);
+            return m_pointCloud->isStreaming();
+        }
+
+        m_scene.render(m_model, camera, m_lightColor, m_modelColor);
+        return false;
+    });
+
+    m_context.doneCurrent();
+    return ok;
+}
+
+int OffscreenRenderer::getWidth() const
+{
+    return m_width;
+}
+
+int OffscreenRenderer::getHeight() const
+{
+    return m_height;
+}
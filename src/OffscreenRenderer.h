@@ -0,0 +1,60 @@
+#ifndef OFFSCREENRENDERER_H
+#define OFFSCREENRENDERER_H
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QImage>
+#include <QColor>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+
+#include "model.h"
+#include "PointCloud.h"
+#include "Camera.h"
+#include "SceneRenderer.h"
+
+// Renders into an FBO on a hidden surface, no window or widget needed.
+// The framebuffer is created with the first frame, posters render in tiles of their own.
+class OffscreenRenderer
+{
+public:
+    OffscreenRenderer(int w, int h);
+    ~OffscreenRenderer();
+
+    bool initialize();
+    bool loadModel(QString fileName); // Blocks until the model is loaded
+
+    void setLightColor(QColor);
+    void setModelColor(QColor);
+    void setOcclusionCulling(bool);
+
+    QImage render(const Camera&); // Null if the framebuffer cannot be created
+
+    // Renders without reading back, for timing. Needs makeCurrent().
+    bool draw(const Camera&);
+    void makeCurrent();
+    void doneCurrent();
+    FrameStats getFrameStats() const;
+    bool renderPoster(const Camera&, QString fileName); // TIFF file
+
+    int getWidth() const;
+    int getHeight() const;
+
+private:
+    int m_width;
+    int m_height;
+
+    QOffscreenSurface m_surface;
+    QOpenGLContext m_context;
+    QOpenGLFramebufferObject* m_fbo;
+    SceneRenderer m_scene;
+    Model* m_model;
+    PointCloud* m_pointCloud;
+
+    QColor m_lightColor;
+    QColor m_modelColor;
+};
+
+#endif // OFFSCREENRENDERER_H
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+
+#include "PointCloud.h"
+#include "GpuBudget.h"
+#include "LodMetric.h"
+
+const float PointCloud::targetSpacing = 1.f;
+const float PointCloud::maxPointSize = 8.f;
+
+PointCloud::PointCloud() :
+    m_pointBudget(3000000),
+    m_gpuBytes(0),
+    m_gpuBudget(qint64(1024) << 20),
+    m_frame(0),
+    m_pending(false)
+{
+    initializeOpenGLFunctions();
+}
+
+PointCloud::~PointCloud()
+{
+    for (GpuNode* node : m_gpuNodes)
+        delete node;
+}
+
+void PointCloud::load(PointOctree& octree)
+{
+    std::swap(m_octree, octree);
+
+    m_gpuNodes.assign(m_octree.getNodes().size(), nullptr);
+    m_drawn.assign(m_octree.getNodes().size(), 0);
+    m_pending = true;
+}
+
+void PointCloud::setPointBudget(int points)
+{
+    m_pointBudget = points;
+}
+
+void PointCloud::setGpuBudget(qint64 bytes)
+{
+    m_gpuBudget = bytes;
+}
+
+QVector3D PointCloud::getPivot() const
+{
+    return m_octree.getBounds().center();
+}
+
+bool PointCloud::isStreaming()
+{
+    return m_pending;
+}
+
+void PointCloud::update(const QMatrix4x4& modelView, const QMatrix4x4& projection, int viewportHeight, FrameStats& stats)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    ++m_frame;
+
+    const std::vector<PointOctree::Node>& nodes = m_octree.getNodes();
+    QMatrix4x4 mvp = projection * modelView;
+    LodMetric metric(modelView, projection, viewportHeight);
+
+    stats = FrameStats();
+    stats.partsTotal = (int)nodes.size();
+
+    for (const DrawItem& item : m_drawList)
+        m_drawn[item.node] = 0;
+
+    m_drawList.clear();
+    m_queue.clear();
+    m_pending = false;
+
+    if (!nodes.empty())
+        m_queue.push_back(std::make_pair(0.f, 0));
+
+    qint64 uploadLeft = uploadBudget;
+    int points = 0;
+
+    // Biggest on screen first, so the budget goes where it is seen
+    while (!m_queue.empty())
+    {
+        std::pop_heap(m_queue.begin(), m_queue.end());
+        int i = m_queue.back().second;
+        m_queue.pop_back();
+
+        const PointOctree::Node& node = nodes[i];
+
+        if (!node.bbox.intersectsFrustum(mvp))
+        {
+            ++stats.partsFrustumCulled;
+            continue;
+        }
+
+        if (points + node.pointCount > m_pointBudget)
+            break;
+
+        // Children only add detail to what their parent already shows
+        if (!upload(i, uploadLeft))
+        {
+            m_pending = true;
+            continue;
+        }
+
+        float spacing = metric.pixels(node.spacing, metric.distance(node.bbox));
+
+        m_gpuNodes[i]->lastUsed = m_frame;
+        m_drawn[i] = 1;
+        m_drawList.push_back(DrawItem { i, spacing });
+        points += node.pointCount;
+
+        if (spacing <= targetSpacing)
+            continue;
+
+        for (int c : node.children)
+        {
+            if (c < 0)
+                continue;
+
+            const BoundingBox& bbox = nodes[c].bbox;
+            m_queue.push_back(std::make_pair(metric.radius(bbox) / metric.distance(bbox), c));
+            std::push_heap(m_queue.begin(), m_queue.end());
+        }
+    }
+
+    evict();
+
+    stats.partsDrawn = (int)m_drawList.size();
+    stats.pointsDrawn = points;
+    stats.residentBytes = m_gpuBytes;
+    stats.cullTime = timer.nsecsElapsed() / 1e6;
+}
+
+void PointCloud::draw(QOpenGLShaderProgram *program, int pointSizeLocation)
+{
+    const std::vector<PointOctree::Node>& nodes = m_octree.getNodes();
+
+    for (const DrawItem& item : m_drawList)
+    {
+        const PointOctree::Node& node = nodes[item.node];
+
+        // Where all children are drawn the gaps are half as wide
+        bool refined = true;
+        for (int c : node.children)
+            if (c >= 0 && !m_drawn[c])
+                refined = false;
+
+        float size = refined ? item.spacing / 2 : item.spacing;
+        program->setUniformValue(pointSizeLocation, std::min(std::max(size, 1.f), maxPointSize));
+
+        m_gpuNodes[item.node]->vertexArray.bind();
+        glDrawArrays(GL_POINTS, 0, node.pointCount);
+    }
+
+    // Any of them unbinds
+    if (!m_drawList.empty())
+        m_gpuNodes[m_drawList.back().node]->vertexArray.release();
+}
+
+bool PointCloud::upload(int i, qint64& budget)
+{
+    if (m_gpuNodes[i])
+        return true;
+
+    const PointOctree::Node& node = m_octree.getNodes()[i];
+    qint64 bytes = (qint64)node.pointCount * sizeof(QVector3D);
+
+    // Always let one node through so that huge nodes can't stall
+    if (bytes > budget && budget < uploadBudget)
+        return false;
+
+    GpuNode* gpu = new GpuNode();
+    gpu->bytes = bytes;
+    gpu->lastUsed = m_frame;
+
+    gpu->buf.create();
+    gpu->buf.bind();
+    gpu->buf.allocate(&m_octree.getPoints()[node.firstPoint], (int)bytes);
+
+    gpu->vertexArray.create();
+    gpu->vertexArray.bind();
+    glEnableVertexAttribArray(VERTEX_ATTRIBUTE_POSITION);
+    glVertexAttribPointer(VERTEX_ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(QVector3D), 0);
+    gpu->vertexArray.release();
+
+    m_gpuNodes[i] = gpu;
+    m_gpuBytes += bytes;
+    budget -= bytes;
+
+    return true;
+}
+
+void PointCloud::evict()
+{
+    if (m_gpuBytes <= m_gpuBudget)
+        return;
+
+    std::vector<GpuNode**> slots;
+    for (GpuNode*& node : m_gpuNodes)
+        slots.push_back(&node);
+
+    evictLeastRecentlyUsed(slots, m_frame, m_gpuBytes, m_gpuBudget, [](GpuNode* node)
+    {
+        node->buf.destroy();
+        delete node;
+    });
+}
@@ -0,0 +1,78 @@
+#ifndef POINTCLOUD_H
+#define POINTCLOUD_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+
+#include "BoundingBox.h"
+#include "FrameStats.h"
+#include "PointOctree.h"
+
+// Point cloud drawn from a PointOctree with GL_POINTS.
+// Every frame the visible nodes are walked biggest on screen first and refined until
+// the points are about a pixel apart or the point budget is used up. Point sizes grow
+// to cover the gaps where refinement stopped. Nodes are uploaded the first time they
+// are drawn and least recently used ones are evicted to keep the GPU memory under budget.
+// All calls need the context the cloud is drawn in to be current.
+class PointCloud : protected QOpenGLFunctions
+{
+public:
+    PointCloud();
+    ~PointCloud();
+
+    void load(PointOctree& octree); // Takes the contents of the octree
+
+    // Picks and uploads nodes, call once per frame before draw
+    void update(const QMatrix4x4& modelView, const QMatrix4x4& projection, int viewportHeight, FrameStats& stats);
+    void draw(QOpenGLShaderProgram *program, int pointSizeLocation); // With the point program bound
+
+    // Nodes are still waiting to be uploaded, keep drawing frames to show them
+    bool isStreaming();
+
+    void setPointBudget(int points);
+    void setGpuBudget(qint64 bytes);
+    QVector3D getPivot() const;
+
+private:
+    static const qint64 uploadBudget = 32 << 20; // Bytes uploaded per frame
+    static const float targetSpacing; // Pixels between points where refinement stops
+    static const float maxPointSize;
+
+    struct GpuNode
+    {
+        QOpenGLBuffer buf;
+        QOpenGLVertexArrayObject vertexArray;
+        qint64 bytes;
+        quint64 lastUsed; // Frame
+    };
+
+    struct DrawItem
+    {
+        int node;
+        float spacing; // Pixels
+    };
+
+    bool upload(int node, qint64& budget);
+    void evict();
+
+    PointOctree m_octree;
+    std::vector<GpuNode*> m_gpuNodes;
+    std::vector<char> m_drawn;
+    std::vector<DrawItem> m_drawList;
+    std::vector<std::pair<float, int>> m_queue; // Heap of projected size and node
+
+    int m_pointBudget;
+    qint64 m_gpuBytes;
+    qint64 m_gpuBudget;
+    quint64 m_frame;
+    bool m_pending;
+};
+
+#endif // POINTCLOUD_H
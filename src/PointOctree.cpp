@@ -0,0 +1,279 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug/Stable.h"
+
+#include "PointOctree.h"
+#include "ThreadPool.h"
+
+PointOctree::PointOctree()
+{}
+
+bool PointOctree::isEmpty() const
+{
+    return m_nodes.empty();
+}
+
+void PointOctree::clear()
+{
+    std::vector<QVector3D>().swap(m_points);
+    std::vector<Node>().swap(m_nodes);
+    m_bounds = BoundingBox();
+}
+
+const std::vector<QVector3D>& PointOctree::getPoints() const
+{
+    return m_points;
+}
+
+const std::vector<PointOctree::Node>& PointOctree::getNodes() const
+{
+    return m_nodes;
+}
+
+const BoundingBox& PointOctree::getBounds() const
+{
+    return m_bounds;
+}
+
+bool PointOctree::build(const std::vector<Vertex>& vertices, const std::atomic<bool>& cancelled)
+{
+    clear();
+
+    int count = (int)vertices.size();
+    if (count == 0)
+        return true;
+
+    ThreadPool* pool = ThreadPool::instance();
+
+    // Copy the positions and find the bounds in blocks
+    const int blockSize = 1 << 16;
+    int blockCount = (count + blockSize - 1) / blockSize;
+    std::vector<BoundingBox> blockBounds(blockCount);
+
+    m_points.resize(count);
+    m_order.resize(count);
+    m_scratch.resize(count);
+
+    pool->parallelFor(blockCount, [&](int b)
+    {
+        int end = std::min(count, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i)
+        {
+            m_points[i] = vertices[i].pos;
+            m_order[i] = (GLuint)i;
+            blockBounds[b].extend(m_points[i]);
+        }
+    });
+
+    for (const BoundingBox& b : blockBounds)
+        m_bounds.extend(b);
+
+    // Cubic cells keep the spacing the same along every axis
+    QVector3D size = m_bounds.size();
+    float half = std::max(std::max(size.x(), size.y()), std::max(size.z(), 1e-6f)) / 2;
+
+    Node root;
+    root.bbox.min = m_bounds.center() - QVector3D(half, half, half);
+    root.bbox.max = m_bounds.center() + QVector3D(half, half, half);
+    m_nodes.push_back(root);
+
+    // Split level by level, big nodes with the whole pool, small ones side by side
+    std::vector<Task> tasks(1, Task { 0, 0, count, 0 });
+    std::vector<Task> next;
+    std::vector<Task> big, small;
+    std::vector<std::vector<Task>> bigChildren, smallChildren;
+
+    while (!tasks.empty())
+    {
+        if (cancelled)
+        {
+            clear();
+            return false;
+        }
+
+        big.clear();
+        small.clear();
+
+        for (const Task& t : tasks)
+        {
+            Node& node = m_nodes[t.node];
+            node.firstPoint = t.first;
+            node.pointCount = t.count;
+            std::fill(node.children, node.children + 8, -1);
+
+            if (t.count <= leafSize || t.depth >= maxDepth)
+            {
+                float edge = node.bbox.size().x();
+                node.spacing = std::min(edge / std::sqrt((float)t.count), edge / gridSize);
+            }
+            else if (t.count >= parallelThreshold)
+                big.push_back(t);
+            else
+                small.push_back(t);
+        }
+
+        bigChildren.assign(big.size(), std::vector<Task>());
+        smallChildren.assign(small.size(), std::vector<Task>());
+
+        for (size_t i = 0; i < big.size(); ++i)
+            split(big[i], pool->getThreadCount() * 4 + 1, bigChildren[i]);
+
+        pool->parallelFor((int)small.size(), [&](int i)
+        {
+            split(small[i], 1, smallChildren[i]);
+        });
+
+        // Nodes are only added here, the splits above read m_nodes concurrently
+        next.clear();
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            const std::vector<Task>& parents = pass == 0 ? big : small;
+            std::vector<std::vector<Task>>& children = pass == 0 ? bigChildren : smallChildren;
+
+            for (size_t i = 0; i < parents.size(); ++i)
+            {
+                for (Task& child : children[i])
+                {
+                    int octant = child.node;
+                    const Node& parent = m_nodes[parents[i].node];
+                    QVector3D center = parent.bbox.center();
+
+                    Node n;
+                    n.bbox.min = QVector3D(octant & 1 ? center.x() : parent.bbox.min.x(),
+                                           octant & 2 ? center.y() : parent.bbox.min.y(),
+                                           octant & 4 ? center.z() : parent.bbox.min.z());
+                    n.bbox.max = n.bbox.min + parent.bbox.size() / 2;
+
+                    child.node = (int)m_nodes.size();
+                    m_nodes[parents[i].node].children[octant] = child.node;
+                    m_nodes.push_back(n);
+                    next.push_back(child);
+                }
+            }
+        }
+
+        tasks.swap(next);
+    }
+
+    // Store the points in node order
+    std::vector<QVector3D> sorted(count);
+    pool->parallelFor(blockCount, [&](int b)
+    {
+        int end = std::min(count, (b + 1) * blockSize);
+        for (int i = b * blockSize; i < end; ++i)
+            sorted[i] = m_points[m_order[i]];
+    });
+
+    m_points.swap(sorted);
+    std::vector<GLuint>().swap(m_order);
+    std::vector<GLuint>().swap(m_scratch);
+
+    return true;
+}
+
+// Keeps the first point found in each grid cell and partitions the rest by octant.
+// The kept points stay at the front of the range, children follow in octant order.
+// Children are returned with the octant in place of the node index.
+void PointOctree::split(const Task& task, int sliceCount, std::vector<Task>& children)
+{
+    Node& node = m_nodes[task.node];
+    QVector3D origin = node.bbox.min;
+    QVector3D center = node.bbox.center();
+    float edge = node.bbox.size().x();
+    float cellScale = gridSize / edge;
+
+    const int cellCount = gridSize * gridSize * gridSize;
+    std::vector<std::atomic<quint32>> occupied(cellCount / 32);
+    std::vector<quint8> codes(task.count); // Octant or 8 for kept points
+    std::vector<int> counts(sliceCount * 9, 0);
+
+    int sliceSize = (task.count + sliceCount - 1) / sliceCount;
+    ThreadPool* pool = ThreadPool::instance();
+
+    pool->parallelFor(sliceCount, [&](int s)
+    {
+        int begin = s * sliceSize;
+        int end = std::min(task.count, begin + sliceSize);
+        int* sliceCounts = &counts[s * 9];
+
+        for (int i = begin; i < end; ++i)
+        {
+            const QVector3D& p = m_points[m_order[task.first + i]];
+
+            int x = std::min(std::max((int)((p.x() - origin.x()) * cellScale), 0), gridSize - 1);
+            int y = std::min(std::max((int)((p.y() - origin.y()) * cellScale), 0), gridSize - 1);
+            int z = std::min(std::max((int)((p.z() - origin.z()) * cellScale), 0), gridSize - 1);
+            int cell = (z * gridSize + y) * gridSize + x;
+
+            quint32 bit = 1u << (cell & 31);
+            quint8 code;
+
+            if (!(occupied[cell >> 5].fetch_or(bit, std::memory_order_relaxed) & bit))
+                code = 8;
+            else
+                code = (p.x() >= center.x()) | (p.y() >= center.y()) << 1 | (p.z() >= center.z()) << 2;
+
+            codes[i] = code;
+            ++sliceCounts[code];
+        }
+    });
+
+    // Kept points first, then the octants
+    int totals[9] = {};
+    for (int s = 0; s < sliceCount; ++s)
+        for (int c = 0; c < 9; ++c)
+            totals[c] += counts[s * 9 + c];
+
+    int starts[9];
+    starts[8] = 0;
+    for (int c = 0, offset = totals[8]; c < 8; ++c)
+    {
+        starts[c] = offset;
+        offset += totals[c];
+    }
+
+    // Turn the counts into each slice's first destination
+    for (int c = 0; c < 9; ++c)
+    {
+        int offset = starts[c];
+        for (int s = 0; s < sliceCount; ++s)
+        {
+            int n = counts[s * 9 + c];
+            counts[s * 9 + c] = offset;
+            offset += n;
+        }
+    }
+
+    GLuint* order = &m_order[task.first];
+    GLuint* scratch = &m_scratch[task.first];
+
+    pool->parallelFor(sliceCount, [&](int s)
+    {
+        int begin = s * sliceSize;
+        int end = std::min(task.count, begin + sliceSize);
+        int* offsets = &counts[s * 9];
+
+        for (int i = begin; i < end; ++i)
+            scratch[offsets[codes[i]]++] = order[i];
+    });
+
+    pool->parallelFor(sliceCount, [&](int s)
+    {
+        int begin = s * sliceSize;
+        int end = std::min(task.count, begin + sliceSize);
+        std::copy(scratch + begin, scratch + end, order + begin);
+    });
+
+    node.pointCount = totals[8];
+    node.spacing = edge / gridSize;
+
+    for (int c = 0; c < 8; ++c)
+    {
+        if (totals[c] > 0)
+        {
+            Task child = { c, task.first + starts[c], totals[c], task.depth + 1 };
+            children.push_back(child);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef POINTOCTREE_H
+#define POINTOCTREE_H
+
+#include <atomic>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QVector3D>
+#include <QOpenGLFunctions>
+
+#include "vertex.h"
+#include "BoundingBox.h"
+
+// Multi-resolution octree over a point cloud.
+// Every interior node keeps at most one point per cell of a gridSize^3 grid over its
+// cube and passes the rest down, so drawing a node and its ancestors gives a roughly
+// uniform density that doubles with each level. Leaves keep all of their points.
+// The points are reordered so that the points of each node are contiguous.
+class PointOctree
+{
+public:
+    struct Node
+    {
+        BoundingBox bbox; // Cube the node subdivides, not the tight bounds of its points
+        float spacing; // Typical distance between the points of the node and its ancestors
+        int firstPoint;
+        int pointCount;
+        int children[8]; // -1 if empty
+    };
+
+    PointOctree();
+
+    // Takes the positions, returns false if cancelled
+    bool build(const std::vector<Vertex>& vertices, const std::atomic<bool>& cancelled);
+
+    bool isEmpty() const;
+    void clear();
+
+    const std::vector<QVector3D>& getPoints() const;
+    const std::vector<Node>& getNodes() const; // Root first
+    const BoundingBox& getBounds() const; // Tight bounds of all points
+
+private:
+    static const int gridSize = 64;
+    static const int leafSize = 32768;
+    static const int maxDepth = 20; // Stops splitting coincident points
+    static const int parallelThreshold = 1 << 18; // Bigger nodes are split with the whole pool
+
+    struct Task
+    {
+        int node;
+        int first;
+        int count;
+        int depth;
+    };
+
+    void split(const Task& task, int sliceCount, std::vector<Task>& children);
+
+    std::vector<QVector3D> m_points;
+    std::vector<Node> m_nodes;
+    BoundingBox m_bounds;
+
+    std::vector<GLuint> m_order; // Build only
+    std::vector<GLuint> m_scratch;
+};
+
+#endif // POINTOCTREE_H
@@ -0,0 +1,161 @@
+#include <algorithm>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QOpenGLBuffer>
+#include <QOpenGLFramebufferObject>
+
+#include "PosterRenderer.h"
+#include "TiffWriter.h"
+#include "Profiler.h"
+
+PosterRenderer::PosterRenderer(int tileSize) :
+    m_tileSize(tileSize)
+{}
+
+bool PosterRenderer::render(SceneRenderer& scene, int width, int height, QString fileName, const std::function<bool()>& draw)
+{
+    initializeOpenGLFunctions();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    GLint maxViewport[2] = { 0, 0 };
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, maxViewport);
+    int tileSize = std::min(m_tileSize, (int)std::min(maxViewport[0], maxViewport[1]));
+
+    QOpenGLFramebufferObject fbo(tileSize, tileSize, QOpenGLFramebufferObject::Depth);
+    if (!fbo.isValid())
+    {
+        qDebug() << "PosterRenderer: cannot create" << tileSize << "x" << tileSize << "framebuffer";
+        return false;
+    }
+
+    TiffWriter writer(width, height);
+    if (!writer.open(fileName))
+        return false;
+
+    // Tiles alternate between the buffers, one is read into while the other is copied out
+    QOpenGLBuffer pixBufObjs[2] = { QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer), QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer) };
+    for (QOpenGLBuffer& buffer : pixBufObjs)
+    {
+        buffer.create();
+        buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+        buffer.bind();
+        buffer.allocate(tileSize * tileSize * 4);
+        buffer.release();
+    }
+
+    struct Tile
+    {
+        int buffer;
+        int x; // Left column in the image
+        int width;
+        int height;
+    };
+
+    // One row of tiles, top row first
+    std::vector<unsigned char> band((size_t)width * tileSize * 3);
+
+    auto copyTile = [&](const Tile& tile)
+    {
+        ProfileScope scope("Poster copy");
+
+        QOpenGLBuffer& buffer = pixBufObjs[tile.buffer];
+        buffer.bind();
+
+        const unsigned char* pixels = (const unsigned char*)buffer.map(QOpenGLBuffer::ReadOnly);
+        if (pixels)
+        {
+            // Bottom row first in the buffer, RGBA to RGB
+            for (int y = 0; y < tile.height; ++y)
+            {
+                const unsigned char* src = pixels + (size_t)(tile.height - 1 - y) * tile.width * 4;
+                unsigned char* dst = band.data() + ((size_t)y * width + tile.x) * 3;
+
+                for (int x = 0; x < tile.width; ++x, src += 4, dst += 3)
+                {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                }
+            }
+
+            buffer.unmap();
+        }
+        else
+            qDebug() << "PosterRenderer: failed map";
+
+        buffer.release();
+        return pixels != nullptr;
+    };
+
+    int sceneWidth = scene.getWidth();
+    int sceneHeight = scene.getHeight();
+    scene.resize(width, height);
+
+    fbo.bind();
+    glViewport(0, 0, tileSize, tileSize);
+
+    int columns = (width + tileSize - 1) / tileSize;
+    int bands = (height + tileSize - 1) / tileSize;
+    int tileIndex = 0;
+    bool ok = true;
+
+    for (int b = 0; b < bands && ok; ++b)
+    {
+        int top = b * tileSize;
+        int rows = std::min(tileSize, height - top);
+
+        Tile pending = { 0, 0, 0, 0 };
+        bool hasPending = false;
+
+        for (int c = 0; c < columns && ok; ++c)
+        {
+            // Tiles past the right and bottom edges are only partly read back
+            Tile tile = { tileIndex++ & 1, c * tileSize, std::min(tileSize, width - c * tileSize), rows };
+
+            scene.setTile(QRect(tile.x, top, tileSize, tileSize));
+
+            // Every tile is complete, upload until nothing is missing
+            while (draw())
+                ;
+
+            // Asynchronous into the buffer, the previous tile is copied out meanwhile
+            pixBufObjs[tile.buffer].bind();
+            glReadPixels(0, tileSize - rows, tile.width, rows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            pixBufObjs[tile.buffer].release();
+
+            if (hasPending)
+                ok = copyTile(pending);
+
+            pending = tile;
+            hasPending = true;
+        }
+
+        if (ok && hasPending)
+            ok = copyTile(pending);
+
+        if (ok)
+            ok = writer.writeRows(band.data(), rows);
+
+        qDebug() << "PosterRenderer: rows" << top + rows << "/" << height;
+    }
+
+    fbo.release();
+
+    scene.setTile(QRect());
+    scene.resize(sceneWidth, sceneHeight);
+
+    for (QOpenGLBuffer& buffer : pixBufObjs)
+        buffer.destroy();
+
+    ok = writer.close() && ok;
+
+    qDebug() << "PosterRenderer:" << fileName << width << "x" << height << (ok ? "written in" : "failed after")
+             << timer.elapsed() << "ms";
+    return ok;
+}
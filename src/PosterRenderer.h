@@ -0,0 +1,32 @@
+#ifndef POSTERRENDERER_H
+#define POSTERRENDERER_H
+
+#include <functional>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QOpenGLExtraFunctions>
+
+#include "SceneRenderer.h"
+
+// Renders images far larger than any framebuffer into a TIFF file.
+// The view is split into tiles drawn with sub-frustums of the full projection.
+// Each tile is read back asynchronously while the next one renders, a band of
+// tiles at a time goes to the TiffWriter, so the image is never held in memory.
+// Needs the scene's context to be current.
+class PosterRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    explicit PosterRenderer(int tileSize = 1024);
+
+    // draw() renders the scene for the tile set on it and returns true while
+    // it still streams data in, it is then called again for the same tile.
+    // The scene size and tile are restored afterwards.
+    bool render(SceneRenderer& scene, int width, int height, QString fileName, const std::function<bool()>& draw);
+
+private:
+    int m_tileSize;
+};
+
+#endif // POSTERRENDERER_H
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstring>
+
+#include "debug/Stable.h"
+
+#include <QMutexLocker>
+
+#include "Profiler.h"
+
+Profiler::Profiler()
+{
+    m_uptime.start();
+}
+
+Profiler* Profiler::instance()
+{
+    static Profiler profiler;
+    return &profiler;
+}
+
+qint64 Profiler::getUptime()
+{
+    return m_uptime.elapsed();
+}
+
+void Profiler::addSample(const char* stage, ProfileClock clock, double ms)
+{
+    QMutexLocker lck(&m_mutex);
+
+    Stage* s = nullptr;
+    for (Stage& t : m_stages)
+    {
+        if (t.clock == clock && (t.name == stage || !strcmp(t.name, stage)))
+        {
+            s = &t;
+            break;
+        }
+    }
+
+    if (!s)
+    {
+        m_stages.push_back(Stage());
+        s = &m_stages.back();
+        s->name = stage;
+        s->clock = clock;
+        s->samples.reserve(windowSize);
+        s->next = 0;
+    }
+
+    if ((int)s->samples.size() < windowSize)
+        s->samples.push_back(ms);
+    else
+        s->samples[s->next] = ms;
+
+    s->next = (s->next + 1) % windowSize;
+}
+
+std::vector<ProfileStats> Profiler::getStats()
+{
+    QMutexLocker lck(&m_mutex);
+
+    std::vector<ProfileStats> stats;
+    std::vector<double> sorted;
+
+    for (const Stage& s : m_stages)
+    {
+        if (s.samples.empty())
+            continue;
+
+        sorted = s.samples;
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0;
+        for (double v : sorted)
+            sum += v;
+
+        ProfileStats st;
+        st.stage = QString::fromLatin1(s.name);
+        st.clock = s.clock;
+        st.samples = (int)sorted.size();
+        st.last = s.samples[(s.next + windowSize - 1) % windowSize];
+        st.average = sum / sorted.size();
+        st.p95 = sorted[std::min(sorted.size() - 1, sorted.size() * 95 / 100)];
+        st.max = sorted.back();
+        stats.push_back(st);
+    }
+
+    return stats;
+}
+
+void Profiler::reset()
+{
+    QMutexLocker lck(&m_mutex);
+    m_stages.clear();
+}
+
+ProfileScope::ProfileScope(const char* stage) :
+    m_stage(stage)
+{
+    m_timer.start();
+}
+
+ProfileScope::~ProfileScope()
+{
+    Profiler::instance()->addSample(m_stage, PROFILE_CLOCK_CPU, m_timer.nsecsElapsed() / 1e6);
+}
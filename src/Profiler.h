@@ -0,0 +1,78 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+
+enum ProfileClock
+{
+    PROFILE_CLOCK_CPU,
+    PROFILE_CLOCK_GPU
+};
+
+struct ProfileStats
+{
+    QString stage;
+    ProfileClock clock;
+    int samples;
+
+    // Milliseconds over the last samples
+    double last;
+    double average;
+    double p95;
+    double max;
+};
+
+// Rolling timings of named frame stages, fed from any thread.
+// CPU stages are timed with ProfileScope and GPU stages with GpuProfiler.
+class Profiler
+{
+public:
+    static Profiler* instance();
+
+    // Stage names are string literals
+    void addSample(const char* stage, ProfileClock clock, double ms);
+
+    // In the order the stages were first seen
+    std::vector<ProfileStats> getStats();
+    void reset();
+
+    // Milliseconds since the profiler was first used, main() does so right away
+    qint64 getUptime();
+
+private:
+    static const int windowSize = 240; // Samples kept per stage
+
+    struct Stage
+    {
+        const char* name;
+        ProfileClock clock;
+        std::vector<double> samples; // Ring buffer
+        int next;
+    };
+
+    Profiler();
+
+    QMutex m_mutex;
+    std::vector<Stage> m_stages;
+    QElapsedTimer m_uptime;
+};
+
+// Adds the CPU time until the end of the scope to a stage
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* stage);
+    ~ProfileScope();
+
+private:
+    const char* m_stage;
+    QElapsedTimer m_timer;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,46 @@
+#include "debug/Stable.h"
+
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QPainter>
+
+#include "ProfilerHud.h"
+
+ProfilerHud::ProfilerHud(QWidget* parent) :
+    QWidget(parent)
+{
+    setAttribute(Qt::WA_TransparentForMouseEvents);
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+}
+
+void ProfilerHud::refresh()
+{
+    m_stats = Profiler::instance()->getStats();
+
+    // Header plus one row per stage
+    QFontMetrics fm(font());
+    resize(fm.width(QString(48, 'M')) + 16, fm.height() * ((int)m_stats.size() + 1) + 12);
+    update();
+}
+
+void ProfilerHud::paintEvent(QPaintEvent*)
+{
+    QPainter p(this);
+    p.fillRect(rect(), QColor(0, 0, 0, 160));
+    p.setPen(Qt::white);
+
+    QFontMetrics fm(font());
+    int y = 6 + fm.ascent();
+
+    p.drawText(8, y, QString("%1 %2 %3 %4 %5")
+        .arg("Stage", -16).arg("", 3).arg("avg", 8).arg("p95", 8).arg("max", 8));
+
+    for (const ProfileStats& s : m_stats)
+    {
+        y += fm.height();
+        p.drawText(8, y, QString("%1 %2 %3 %4 %5")
+            .arg(s.stage.left(16), -16)
+            .arg(s.clock == PROFILE_CLOCK_GPU ? "GPU" : "CPU")
+            .arg(s.average, 8, 'f', 2).arg(s.p95, 8, 'f', 2).arg(s.max, 8, 'f', 2));
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PROFILERHUD_H
+#define PROFILERHUD_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QWidget>
+
+#include "Profiler.h"
+
+// Translucent table of the Profiler stages drawn over the viewport.
+// Call refresh() periodically, the overlay lets mouse events through.
+class ProfilerHud : public QWidget
+{
+public:
+    explicit ProfilerHud(QWidget* parent = 0);
+
+    void refresh();
+
+protected:
+    void paintEvent(QPaintEvent*) override;
+
+private:
+    std::vector<ProfileStats> m_stats;
+};
+
+#endif // PROFILERHUD_H
@@ -0,0 +1,177 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+#include "ProgramCache.h"
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+namespace
+{
+    const quint32 cacheMagic = 0x31475250; // "PRG1"
+
+    struct CacheHeader
+    {
+        quint32 magic;
+        quint32 format; // Driver specific binary format
+        quint64 size;
+        char key[20]; // SHA-1 of the driver strings and the sources
+    };
+
+    QByteArray readSource(const QString& fileName, const QByteArray& defines)
+    {
+        QFile file(fileName);
+        if (!file.open(QIODevice::ReadOnly))
+            return QByteArray();
+
+        QByteArray source = file.readAll();
+
+        // #version has to stay the first statement
+        int line = source.startsWith("#version") ? source.indexOf('\n') + 1 : 0;
+        return source.insert(line, defines);
+    }
+}
+
+ProgramCache::ProgramCache() :
+    m_supported(false)
+{
+    initializeOpenGLFunctions();
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    m_supported = formats > 0;
+
+    // Binaries only load into the driver build that produced them
+    m_driver = QByteArray((const char*)glGetString(GL_VENDOR)) + '\n' +
+        (const char*)glGetString(GL_RENDERER) + '\n' + (const char*)glGetString(GL_VERSION);
+
+    m_directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/shaders";
+}
+
+bool ProgramCache::build(QOpenGLShaderProgram& program, const QString& vertexFile, const QString& fragmentFile,
+    const QStringList& defines)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QByteArray prefix;
+    for (const QString& define : defines)
+        prefix += "#define " + define.toLatin1() + "\n";
+
+    QByteArray vertexSource = readSource(vertexFile, prefix);
+    QByteArray fragmentSource = readSource(fragmentFile, prefix);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(m_driver);
+    hash.addData(vertexSource);
+    hash.addData(fragmentSource);
+    QByteArray key = hash.result();
+
+    // One file per shader pair and variant, overwritten when the sources change
+    QString fileName = m_directory + "/" + QFileInfo(vertexFile).baseName() + "-" + QFileInfo(fragmentFile).baseName();
+    for (const QString& define : defines)
+        fileName += "-" + define.toLower();
+    fileName += ".bin";
+
+    if (m_supported && readBinary(program, fileName, key))
+    {
+        qDebug() << "ProgramCache: loaded" << fileName << "in" << timer.elapsed() << "ms";
+        return true;
+    }
+
+    if (!program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource) ||
+        !program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource))
+        return false;
+
+    if (m_supported)
+        glProgramParameteri(program.programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    if (!program.link())
+        return false;
+
+    if (m_supported)
+        writeBinary(program, fileName, key);
+
+    qDebug() << "ProgramCache: compiled" << fileName << "in" << timer.elapsed() << "ms";
+    return true;
+}
+
+bool ProgramCache::readBinary(QOpenGLShaderProgram& program, const QString& fileName, const QByteArray& key)
+{
+    std::ifstream in(fileName.toStdString(), std::ios::in | std::ios::binary);
+    if (!in)
+        return false;
+
+    CacheHeader header;
+    in.read((char*)&header, sizeof(header));
+
+    // Stale if the driver or the sources changed
+    if (!in || header.magic != cacheMagic || memcmp(header.key, key.constData(), sizeof(header.key)))
+        return false;
+
+    std::vector<char> binary(header.size);
+    in.read(binary.data(), binary.size());
+
+    if (!in || !program.create())
+        return false;
+
+    glProgramBinary(program.programId(), header.format, binary.data(), (GLsizei)binary.size());
+
+    // Drivers may still reject a binary, the program is then compiled from source.
+    // With a linked binary and no shaders link() only picks up the link status.
+    GLint linked = 0;
+    glGetProgramiv(program.programId(), GL_LINK_STATUS, &linked);
+    return linked && program.link();
+}
+
+void ProgramCache::writeBinary(QOpenGLShaderProgram& program, const QString& fileName, const QByteArray& key)
+{
+    GLint size = 0;
+    glGetProgramiv(program.programId(), GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0)
+        return;
+
+    std::vector<char> binary(size);
+    GLsizei length = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program.programId(), size, &length, &format, binary.data());
+    if (length <= 0)
+        return;
+
+    QDir().mkpath(m_directory);
+
+    std::ofstream out(fileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+        std::cerr << "Cannot write " << fileName.toStdString() << std::endl;
+        return;
+    }
+
+    CacheHeader header;
+    header.magic = cacheMagic;
+    header.format = format;
+    header.size = length;
+    memcpy(header.key, key.constData(), sizeof(header.key));
+
+    out.write((const char*)&header, sizeof(header));
+    out.write(binary.data(), length);
+}
@@ -0,0 +1,33 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "debug/Stable.h"
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+// Builds shader programs from the resource sources and keeps the linked binaries on disk.
+// A binary is reused while the driver, the GPU and the sources are unchanged, any other
+// binary is rebuilt from source and replaced. Needs the context to be current.
+// Variants of the same sources are built with defines inserted after the #version line.
+class ProgramCache : protected QOpenGLExtraFunctions
+{
+public:
+    ProgramCache();
+
+    bool build(QOpenGLShaderProgram& program, const QString& vertexFile, const QString& fragmentFile,
+        const QStringList& defines = QStringList());
+
+private:
+    bool readBinary(QOpenGLShaderProgram& program, const QString& fileName, const QByteArray& key);
+    void writeBinary(QOpenGLShaderProgram& program, const QString& fileName, const QByteArray& key);
+
+    bool m_supported; // Driver can return program binaries
+    QByteArray m_driver;
+    QString m_directory;
+};
+
+#endif // PROGRAMCACHE_H
@@ -0,0 +1,809 @@
+#include <algorithm>
+#include <cmath>
+
+#include "debug/Stable.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QDebug>
+
+#include "RenderThread.h"
+#include "Profiler.h"
+#include "PosterRenderer.h"
+
+namespace
+{
+    const float minRenderScale = 0.25f;
+    const float maxScaleStep = 1.1f; // Per frame, the timings lag a few frames behind
+    const GLuint64 readbackTimeout = 1000000000; // ns to wait for the oldest readback
+}
+
+RenderThread::RenderThread(QOpenGLContext* shareContext) :
+    m_surface(new QOffscreenSurface()),
+    m_context(new QOpenGLContext()),
+    m_quit(false),
+    m_back(0),
+    m_middle(1),
+    m_front(2),
+    m_model(nullptr),
+    m_chunkedModel(nullptr),
+    m_pointCloud(nullptr),
+    m_aoBaker(nullptr),
+    m_aoFinished(false),
+    m_size(1, 1),
+    m_pixelSize(1, 1),
+    m_lightColor(Qt::white),
+    m_modelColor(Qt::white),
+    m_dirty(true),
+    m_captureInterval(0),
+    m_dynamicResolution(true),
+    m_renderScale(1),
+    m_reduced(false),
+    m_panDepth(0),
+    m_measuring(false),
+    m_lastMoveTime(0),
+    m_captureRequested(false),
+    m_frameSink(nullptr),
+    m_readHead(0),
+    m_readCount(0),
+    m_lastFrameBufferUpdateTime(QDateTime::currentMSecsSinceEpoch())
+{
+    for (FrameSlot& slot : m_slots)
+    {
+        slot.fbo = nullptr;
+        slot.texture = 0;
+        slot.fence = 0;
+        slot.presented = 0;
+        slot.time = 0;
+    }
+
+    for (Readback& r : m_readbacks)
+    {
+        r.buffer = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+        r.yuv = false;
+        r.fence = 0;
+        r.time = 0;
+    }
+
+    // Surfaces have to be created on the GUI thread
+    m_surface->setFormat(shareContext->format());
+    m_surface->create();
+
+    m_context->setFormat(shareContext->format());
+    m_context->setShareContext(shareContext);
+    m_context->create();
+    m_context->moveToThread(this);
+}
+
+RenderThread::~RenderThread()
+{
+    stop();
+
+    // Already deleted by the thread if it ran
+    delete m_context;
+    delete m_surface;
+}
+
+void RenderThread::stop()
+{
+    m_quit = true;
+    m_wake.release();
+    wait();
+}
+
+void RenderThread::post(const RenderCommand& command)
+{
+    // Only full while the render thread is busy with a frame, it drains the queue right after
+    while (!m_commands.push(command))
+        QThread::yieldCurrentThread();
+
+    m_wake.release();
+}
+
+void RenderThread::requestCapture()
+{
+    m_captureRequested = true;
+    m_wake.release();
+}
+
+QImage RenderThread::getFrameBuffer()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_frameBuffer;
+}
+
+qint64 RenderThread::getLastFrameBufferUpdateTime()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_lastFrameBufferUpdateTime;
+}
+
+void RenderThread::setFrameSink(FrameSink* sink)
+{
+    QMutexLocker lck(&m_sinkMutex);
+    m_frameSink = sink;
+}
+
+FrameStats RenderThread::getFrameStats()
+{
+    QMutexLocker lck(&m_mutex);
+    return m_frameStats;
+}
+
+GLuint RenderThread::acquireFrame(QVector2D& texCoordScale)
+{
+    if (m_middle.load() & newFrameBit)
+    {
+        QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+        // The render thread may draw into the old frame once the GPU is done showing it
+        FrameSlot& old = m_slots[m_front];
+        if (old.texture)
+        {
+            old.presented = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            f->glFlush();
+        }
+
+        m_front = m_middle.exchange(m_front) & ~newFrameBit;
+
+        // Waits on the GPU, the GUI thread carries on
+        f->glWaitSync(m_slots[m_front].fence, 0, GL_TIMEOUT_IGNORED);
+    }
+
+    const FrameSlot& slot = m_slots[m_front];
+    if (!slot.texture)
+        return 0;
+
+    texCoordScale = QVector2D((float)slot.rendered.width() / slot.size.width(),
+        (float)slot.rendered.height() / slot.size.height());
+    return slot.texture;
+}
+
+void RenderThread::run()
+{
+    m_context->makeCurrent(m_surface);
+    initializeOpenGLFunctions();
+
+    if (!m_scene.initialize())
+        qDebug() << "RenderThread: cannot build the shaders";
+
+    // Only CPU times are profiled without timer queries
+    m_gpuProfiler.initialize();
+
+    // Captures are converted on the CPU without it
+    if (!m_yuvConverter.initialize())
+        qDebug() << "RenderThread: no YUV conversion on the GPU";
+
+    m_model = new Model();
+
+    for (Readback& r : m_readbacks)
+    {
+        r.buffer.create();
+        r.buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+    }
+
+    QElapsedTimer frameTimer;
+    frameTimer.start();
+    m_inputTimer.start();
+
+    RenderCommand command;
+
+    while (!m_quit)
+    {
+        while (m_commands.pop(command))
+            execute(command);
+
+        applyOcclusion();
+        finishReadbacks(false);
+
+        bool streaming = (m_chunkedModel && m_chunkedModel->isStreaming()) || (m_pointCloud && m_pointCloud->isStreaming());
+        bool paced = m_captureInterval > 0;
+        bool moving = m_camera.isCoasting() || m_inputTimer.elapsed() < settleDelay;
+
+        // A scaled down frame stays on screen until the input settles
+        bool refine = m_reduced && !moving;
+
+        if (!m_dirty && !streaming && !m_captureRequested && !paced && !m_camera.isCoasting() && !refine)
+        {
+            // Captures still in flight come in without rendering more frames
+            if (m_readCount)
+            {
+                finishReadbacks(true);
+                continue;
+            }
+
+            // Nothing changes on screen, sleep until something is posted, the input
+            // settles or the AO bake ends
+            if (m_reduced)
+                m_wake.tryAcquire(1, (int)(settleDelay - m_inputTimer.elapsed()));
+            else
+                m_wake.acquire();
+            continue;
+        }
+
+        // Steady pace while things change, input arriving meanwhile goes into the same frame
+        qint64 wait = (paced ? m_captureInterval : frameInterval) - frameTimer.elapsed();
+        if (wait > 0)
+        {
+            m_wake.tryAcquire(1, (int)wait);
+            continue;
+        }
+
+        // Capped so that coasting doesn't jump after a stall
+        qreal dt = std::min(frameTimer.restart(), (qint64)100) / 1000.;
+        m_camera.coast(dt);
+        m_dirty = false;
+
+        // Captures keep the full resolution
+        bool capture = m_captureRequested.exchange(false) || paced;
+        float scale = m_dynamicResolution && moving && !capture ? m_renderScale : 1;
+
+        QElapsedTimer cpuTimer;
+        cpuTimer.start();
+
+        renderFrame(scale);
+
+        if (capture)
+            startReadback();
+
+        publishFrame();
+
+        m_reduced = scale < 1;
+        if (m_dynamicResolution && moving)
+            updateRenderScale(cpuTimer.elapsed());
+    }
+
+    release();
+
+    m_context->doneCurrent();
+    delete m_context;
+    m_context = nullptr;
+}
+
+void RenderThread::execute(RenderCommand& command)
+{
+    switch (command.type)
+    {
+    case RENDER_COMMAND_RESIZE:
+        m_size = command.size.expandedTo(QSize(1, 1));
+        m_pixelSize = (QSizeF(m_size) * command.pixelRatio).toSize().expandedTo(QSize(1, 1));
+        m_scene.resize(m_size.width(), m_size.height());
+        break;
+
+    case RENDER_COMMAND_MOUSE_PRESS:
+        mousePress(command);
+        break;
+
+    case RENDER_COMMAND_MOUSE_MOVE:
+        mouseMove(command);
+        break;
+
+    case RENDER_COMMAND_MOUSE_RELEASE:
+        mouseRelease(command);
+        break;
+
+    case RENDER_COMMAND_MOUSE_DOUBLE_CLICK:
+        mouseDoubleClick(command);
+        break;
+
+    case RENDER_COMMAND_WHEEL:
+        wheel(command);
+        break;
+
+    case RENDER_COMMAND_LIGHT_COLOR:
+        m_lightColor = command.color;
+        break;
+
+    case RENDER_COMMAND_MODEL_COLOR:
+        m_modelColor = command.color;
+        break;
+
+    case RENDER_COMMAND_OCCLUSION_CULLING:
+        m_scene.setOcclusionCulling(command.enabled);
+        break;
+
+    case RENDER_COMMAND_SET_MODEL:
+        setModel(command.model, command.fileName);
+        break;
+
+    case RENDER_COMMAND_SET_POINT_CLOUD:
+        setPointCloud(command.points);
+        break;
+
+    case RENDER_COMMAND_LOAD_CHUNKS:
+        loadChunkedModel(command.fileName);
+        break;
+
+    case RENDER_COMMAND_CAPTURE_RATE:
+        m_captureInterval = command.rate > 0 ? 1000 / command.rate : 0;
+        break;
+
+    case RENDER_COMMAND_DYNAMIC_RESOLUTION:
+        m_dynamicResolution = command.enabled;
+        break;
+
+    case RENDER_COMMAND_TWO_SIDED_LIGHTING:
+        m_scene.setTwoSided(command.enabled);
+        break;
+
+    case RENDER_COMMAND_FLAT_SHADING:
+        m_scene.setFlatShading(command.enabled);
+        break;
+
+    case RENDER_COMMAND_SAVE_POSTER:
+        savePoster(command.fileName, command.size);
+        break;
+    }
+
+    m_dirty = true;
+}
+
+void RenderThread::renderFrame(float scale)
+{
+    ProfileScope scope("Frame");
+
+    m_gpuProfiler.collect();
+
+    // Wait for the GUI context to finish drawing from this slot before drawing into it
+    FrameSlot& slot = m_slots[m_back];
+    if (slot.presented)
+    {
+        glWaitSync(slot.presented, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(slot.presented);
+        slot.presented = 0;
+    }
+
+    if (!slot.fbo || slot.size != m_pixelSize)
+    {
+        delete slot.fbo;
+        slot.fbo = new QOpenGLFramebufferObject(m_pixelSize, QOpenGLFramebufferObject::Depth);
+        slot.texture = slot.fbo->texture();
+        slot.size = m_pixelSize;
+
+        // Scaled down frames are stretched over the widget
+        glBindTexture(GL_TEXTURE_2D, slot.texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Drawn into the lower left part so that scale changes don't reallocate the framebuffer
+    slot.rendered = (QSizeF(m_pixelSize) * scale).toSize().expandedTo(QSize(1, 1));
+    slot.time = QDateTime::currentMSecsSinceEpoch();
+
+    slot.fbo->bind();
+    glViewport(0, 0, slot.rendered.width(), slot.rendered.height());
+
+    m_gpuProfiler.begin("Scene");
+
+    if (m_chunkedModel)
+        m_scene.render(m_chunkedModel, m_camera, m_lightColor, m_modelColor);
+    else if (m_pointCloud)
+        m_scene.render(m_pointCloud, m_camera, m_lightColor, m_modelColor);
+    else
+        m_scene.render(m_model, m_camera, m_lightColor, m_modelColor);
+
+    m_gpuProfiler.end();
+
+    QMutexLocker lck(&m_mutex);
+    m_frameStats = m_scene.getFrameStats();
+}
+
+void RenderThread::publishFrame()
+{
+    FrameSlot& slot = m_slots[m_back];
+    slot.fbo->release();
+
+    if (slot.fence)
+        glDeleteSync(slot.fence);
+
+    // Flushed so that the fence reaches the GPU before the GUI context waits for it
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    m_back = m_middle.exchange(m_back | newFrameBit) & ~newFrameBit;
+
+    frameReady();
+}
+
+void RenderThread::startReadback()
+{
+    ProfileScope scope("Readback");
+
+    // Only with every buffer in flight, the oldest has had the most frames to finish
+    if (m_readCount == readbackCount)
+        finishReadbacks(true);
+
+    // Given up on after the timeout, the buffer is reused
+    if (m_readCount == readbackCount)
+    {
+        qDebug() << "RenderThread: dropped a readback";
+        glDeleteSync(m_readbacks[m_readHead].fence);
+        m_readbacks[m_readHead].fence = 0;
+        m_readHead = (m_readHead + 1) % readbackCount;
+        --m_readCount;
+    }
+
+    // Read from the frame just rendered, before it is published
+    const FrameSlot& slot = m_slots[m_back];
+    Readback& r = m_readbacks[(m_readHead + m_readCount) % readbackCount];
+    r.time = slot.time;
+
+    QSize yuvSize;
+    {
+        QMutexLocker lck(&m_sinkMutex);
+        if (m_frameSink)
+            yuvSize = m_frameSink->getYuvSize();
+    }
+
+    // Scaled to the video size and converted on the GPU, 1.5 bytes per pixel to read back
+    QVector2D texCoordScale((float)slot.rendered.width() / slot.size.width(), (float)slot.rendered.height() / slot.size.height());
+
+    m_gpuProfiler.begin("Convert");
+    r.yuv = !yuvSize.isEmpty() && m_yuvConverter.convert(slot.texture, texCoordScale, yuvSize);
+    m_gpuProfiler.end();
+
+    r.size = r.yuv ? yuvSize : slot.rendered;
+
+    int bytes = r.yuv ? r.size.width() * r.size.height() * 3 / 2 : r.size.width() * r.size.height() * 4;
+
+    r.buffer.bind();
+    if (r.buffer.size() != bytes)
+        r.buffer.allocate(bytes);
+
+    // Asynchronous into the buffer, mapped once the fence has signaled
+    m_gpuProfiler.begin("Readback");
+    if (r.yuv)
+    {
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, r.size.width(), r.size.height() * 3 / 2, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    }
+    else
+        glReadPixels(0, 0, r.size.width(), r.size.height(), GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+    m_gpuProfiler.end();
+
+    r.buffer.release();
+
+    // Flushed with the frame's fence in publishFrame()
+    r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++m_readCount;
+}
+
+void RenderThread::finishReadbacks(bool waitOldest)
+{
+    while (m_readCount)
+    {
+        Readback& r = m_readbacks[m_readHead];
+
+        // Polled, or for the oldest one waited for with the commands flushed
+        GLenum status = glClientWaitSync(r.fence, waitOldest ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, waitOldest ? readbackTimeout : 0);
+        waitOldest = false;
+
+        if (status == GL_TIMEOUT_EXPIRED)
+            break;
+
+        glDeleteSync(r.fence);
+        r.fence = 0;
+        m_readHead = (m_readHead + 1) % readbackCount;
+        --m_readCount;
+
+        if (status == GL_WAIT_FAILED)
+        {
+            qDebug() << "RenderThread: readback fence failed";
+            continue;
+        }
+
+        ProfileScope scope("Readback map");
+
+        r.buffer.bind();
+
+        const unsigned char* fb = (const unsigned char*) r.buffer.map(QOpenGLBuffer::ReadOnly);
+        if (fb)
+        {
+            int stride = r.size.width() * 4;
+            bool sunk = false;
+            QImage frame;
+
+            {
+                // The sink reads the mapped memory itself, BGRA is flipped with a negative stride
+                QMutexLocker lck(&m_sinkMutex);
+                if (m_frameSink && r.yuv)
+                {
+                    const uchar* planes[3];
+                    int strides[3];
+                    YuvConverter::getPlanes(fb, r.size, planes, strides);
+                    m_frameSink->consumeYuvFrame(planes, strides, r.size.width(), r.size.height(), r.time);
+                }
+                else if (m_frameSink)
+                    m_frameSink->consumeFrame(fb + (r.size.height() - 1) * stride, r.size.width(), r.size.height(), -stride, r.time);
+
+                // Planes for a sink that is gone are dropped
+                sunk = m_frameSink || r.yuv;
+            }
+
+            if (!sunk)
+                frame = QImage(fb, r.size.width(), r.size.height(), QImage::Format_RGB32).mirrored();
+
+            if (!r.buffer.unmap())
+                qDebug() << "RenderThread: failed unmap";
+
+            {
+                // Stamped with the render time, captures arrive a few frames late
+                QMutexLocker lck(&m_mutex);
+                if (!sunk)
+                    m_frameBuffer = frame;
+                m_lastFrameBufferUpdateTime = r.time;
+            }
+
+            recordFrame();
+        }
+        else
+            qDebug() << "RenderThread: failed map";
+
+        r.buffer.release();
+    }
+}
+
+void RenderThread::updateRenderScale(qint64 cpuTime)
+{
+    // The CPU time only shows GPU load once the driver queue is full
+    double time = m_gpuProfiler.getLastTime("Scene");
+    if (time <= 0)
+        time = std::max(cpuTime, (qint64)1);
+
+    // The cost mostly follows the pixel count, the square of the scale
+    float step = (float)std::sqrt(targetFrameTime / time);
+    step = qBound(1 / maxScaleStep, step, maxScaleStep);
+    m_renderScale = qBound(minRenderScale, m_renderScale * step, 1.f);
+}
+
+void RenderThread::savePoster(QString fileName, QSize size)
+{
+    // No frames meanwhile, input queues up until the poster is done
+    PosterRenderer poster;
+    bool ok = poster.render(m_scene, size.width(), size.height(), fileName, [this]()
+    {
+        if (m_chunkedModel)
+        {
+            m_scene.render(m_chunkedModel, m_camera, m_lightColor, m_modelColor);
+            return m_chunkedModel->isStreaming();
+        }
+
+        if (m_pointCloud)
+        {
+            m_scene.render(m_pointCloud, m_camera, m_lightColor, m_modelColor);
+            return m_pointCloud->isStreaming();
+        }
+
+        m_scene.render(m_model, m_camera, m_lightColor, m_modelColor);
+        return false;
+    });
+
+    posterSaved(fileName, ok);
+}
+
+void RenderThread::release()
+{
+    stopAoBake();
+    dropModel();
+
+    m_scene.destroy();
+    m_gpuProfiler.destroy();
+    m_yuvConverter.destroy();
+    for (Readback& r : m_readbacks)
+    {
+        r.buffer.destroy();
+
+        if (r.fence)
+            glDeleteSync(r.fence);
+    }
+
+    for (FrameSlot& slot : m_slots)
+    {
+        delete slot.fbo;
+
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.presented)
+            glDeleteSync(slot.presented);
+    }
+}
+
+void RenderThread::mousePress(const RenderCommand& command)
+{
+    m_mouseLastPosition = command.pos;
+
+    // Grabbing the model stops it
+    m_camera.stopCoasting();
+    m_rotateVelocity = QVector2D();
+    m_lastMoveTime = command.time;
+
+    QVector3D point;
+
+    if (command.button == Qt::MiddleButton)
+    {
+        // Grab the surface under the cursor so that panning keeps it there
+        m_panDepth = 0;
+        if (pickSurface(command.pos, point))
+            m_panDepth = -m_camera.getModelView(m_model->pivot).map(point).z();
+    }
+    else if (command.button == Qt::LeftButton && command.modifiers & Qt::ControlModifier && pickSurface(command.pos, point))
+    {
+        // Distance from the previous measured point, -1 for the first one
+        pointMeasured(point, m_measuring ? (point - m_measurePoint).length() : -1);
+        m_measurePoint = point;
+        m_measuring = true;
+    }
+}
+
+void RenderThread::mouseMove(const RenderCommand& command)
+{
+    QVector2D diff = QVector2D(command.pos - m_mouseLastPosition);
+    m_mouseLastPosition = command.pos;
+    m_inputTimer.restart();
+
+    if (command.buttons == Qt::MiddleButton && command.modifiers & Qt::ShiftModifier)
+    {
+        if (m_panDepth > 0)
+            m_camera.pan(diff, m_panDepth, m_size.height());
+        else
+            m_camera.pan(diff);
+    }
+    else if (command.buttons == Qt::MiddleButton)
+    {
+        // Averaged over the last moves for the fling on release
+        qint64 dt = command.time - m_lastMoveTime;
+        if (dt > 0)
+            m_rotateVelocity = (m_rotateVelocity + diff * (1000.f / dt)) / 2;
+        m_lastMoveTime = command.time;
+
+        m_camera.rotate(diff);
+    }
+}
+
+void RenderThread::mouseRelease(const RenderCommand& command)
+{
+    // Keeps rotating if the cursor was still moving when the button went up
+    if (command.button == Qt::MiddleButton && command.time - m_lastMoveTime < flingTimeout)
+        m_camera.fling(m_rotateVelocity);
+}
+
+void RenderThread::mouseDoubleClick(const RenderCommand& command)
+{
+    QVector3D point;
+
+    // Rotate around the picked point from now on
+    if (command.button == Qt::LeftButton && pickSurface(command.pos, point))
+    {
+        m_camera.movePivot(m_model->pivot, point);
+        m_model->pivot = point;
+    }
+}
+
+void RenderThread::wheel(const RenderCommand& command)
+{
+    m_inputTimer.restart();
+
+    QVector3D point;
+    if (pickSurface(command.pos, point))
+        m_camera.zoomAt(command.delta, point, m_model->pivot);
+    else
+        m_camera.zoom(command.delta);
+}
+
+bool RenderThread::pickSurface(const QPointF& pos, QVector3D& point)
+{
+    QMatrix4x4 mvp = m_camera.getProjection(m_size.width(), m_size.height()) * m_camera.getModelView(m_model->pivot);
+    return m_picker.pick(mvp, pos, m_size, point);
+}
+
+void RenderThread::setModel(Model* model, QString fileName)
+{
+    stopAoBake();
+    dropModel();
+
+    // Loaded on the GUI thread without a context, the buffers are filled here
+    m_model = model;
+    m_model->upload();
+    m_picker.setModel(m_model);
+
+    startAoBake(fileName);
+}
+
+void RenderThread::setPointCloud(PointOctree* points)
+{
+    stopAoBake();
+    dropModel();
+
+    m_pointCloud = new PointCloud();
+    m_pointCloud->load(*points);
+    delete points;
+
+    // No triangles to pick or bake, the model only keeps the pivot
+    m_model = new Model();
+    m_model->pivot = m_pointCloud->getPivot();
+}
+
+void RenderThread::loadChunkedModel(QString fileName)
+{
+    ChunkedModel* model = new ChunkedModel();
+    if (!model->open(fileName))
+    {
+        delete model;
+        return;
+    }
+
+    stopAoBake();
+    dropModel();
+
+    m_chunkedModel = model;
+
+    // The in-memory model stays empty and only keeps the pivot for navigation
+    m_model = new Model();
+    m_model->pivot = m_chunkedModel->getPivot();
+}
+
+void RenderThread::dropModel()
+{
+    m_picker.setModel(nullptr);
+    m_measuring = false;
+
+    delete m_model;
+    m_model = nullptr;
+
+    delete m_chunkedModel;
+    m_chunkedModel = nullptr;
+
+    delete m_pointCloud;
+    m_pointCloud = nullptr;
+}
+
+void RenderThread::startAoBake(QString fileName)
+{
+    m_aoBaker = new AoBaker(m_model, m_picker.getBuilder(), fileName);
+    m_aoFinished = false;
+
+    // Wakes the idle loop to apply the result
+    connect(m_aoBaker, &QThread::finished, this, [this]()
+    {
+        m_aoFinished = true;
+        m_wake.release();
+    }, Qt::DirectConnection);
+
+    // The GUI shows the progress and deletes the baker once it is released here
+    m_aoBaker->moveToThread(QCoreApplication::instance()->thread());
+    m_aoBaker->start(QThread::LowPriority);
+    aoBakeStarted(m_aoBaker);
+}
+
+void RenderThread::stopAoBake()
+{
+    if (!m_aoBaker)
+        return;
+
+    m_aoBaker->cancel();
+    m_aoBaker->wait();
+
+    m_aoBaker->deleteLater();
+    m_aoBaker = nullptr;
+}
+
+void RenderThread::applyOcclusion()
+{
+    if (!m_aoBaker || !m_aoFinished)
+        return;
+
+    // finished() comes just before the thread ends
+    m_aoBaker->wait();
+
+    if (m_aoBaker->isReady())
+    {
+        m_aoBaker->read(m_model);
+        m_dirty = true;
+    }
+
+    m_aoBaker->deleteLater();
+    m_aoBaker = nullptr;
+}
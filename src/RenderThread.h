@@ -0,0 +1,236 @@
+#ifndef RENDERTHREAD_H
+#define RENDERTHREAD_H
+
+#include <atomic>
+
+#include "debug/Stable.h"
+
+#include <QThread>
+#include <QSemaphore>
+#include <QMutex>
+#include <QImage>
+#include <QColor>
+#include <QPointF>
+#include <QVector2D>
+#include <QSize>
+#include <QElapsedTimer>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLBuffer>
+#include <QOffscreenSurface>
+
+#include "model.h"
+#include "ChunkedModel.h"
+#include "PointCloud.h"
+#include "PointOctree.h"
+#include "Camera.h"
+#include "SurfacePicker.h"
+#include "AoBaker.h"
+#include "FrameStats.h"
+#include "FrameSink.h"
+#include "SceneRenderer.h"
+#include "GpuProfiler.h"
+#include "YuvConverter.h"
+#include "SpscQueue.h"
+
+enum RenderCommandType
+{
+    RENDER_COMMAND_RESIZE,
+    RENDER_COMMAND_MOUSE_PRESS,
+    RENDER_COMMAND_MOUSE_MOVE,
+    RENDER_COMMAND_MOUSE_RELEASE,
+    RENDER_COMMAND_MOUSE_DOUBLE_CLICK,
+    RENDER_COMMAND_WHEEL,
+    RENDER_COMMAND_LIGHT_COLOR,
+    RENDER_COMMAND_MODEL_COLOR,
+    RENDER_COMMAND_OCCLUSION_CULLING,
+    RENDER_COMMAND_SET_MODEL, // Takes model, loaded without a context
+    RENDER_COMMAND_SET_POINT_CLOUD, // Takes points
+    RENDER_COMMAND_LOAD_CHUNKS,
+    RENDER_COMMAND_CAPTURE_RATE, // Frames per second while recording, 0 to render on demand
+    RENDER_COMMAND_DYNAMIC_RESOLUTION,
+    RENDER_COMMAND_TWO_SIDED_LIGHTING,
+    RENDER_COMMAND_FLAT_SHADING,
+    RENDER_COMMAND_SAVE_POSTER // fileName and size, rendered in tiles
+};
+
+struct RenderCommand
+{
+    RenderCommandType type = RENDER_COMMAND_RESIZE;
+
+    // Input, in widget pixels
+    QPointF pos;
+    Qt::MouseButton button = Qt::NoButton;
+    Qt::MouseButtons buttons = Qt::NoButton;
+    Qt::KeyboardModifiers modifiers = Qt::NoModifier;
+    qreal delta = 0;
+    qint64 time = 0; // Event timestamp, ms
+
+    QSize size;
+    qreal pixelRatio = 1;
+    QColor color;
+    bool enabled = false;
+    int rate = 0;
+
+    Model* model = nullptr;
+    PointOctree* points = nullptr;
+    QString fileName;
+};
+
+// Owns a GL context shared with the viewport widget and does all scene work on its own thread.
+// The GUI thread posts input and settings through a lock-free queue, frames are rendered
+// into textures handed over triple buffered, so neither side ever waits for the other.
+// Frames are only rendered after input, model changes, streaming or camera inertia,
+// otherwise the thread sleeps. While recording every frame is paced and captured at the
+// capture rate instead. Captures are read back here and don't depend on the GUI thread,
+// through a ring of pixel buffers that are only mapped once their fence has signaled,
+// a frame sink reads the mapped memory directly. Sinks taking YUV get the frame converted
+// and scaled on the GPU, only the planes are read back.
+// With dynamic resolution the camera moves at a scaled down resolution kept within the
+// frame time budget, a full resolution frame follows once the input settles. Captured
+// frames are always rendered at full resolution.
+class RenderThread : public QThread, protected QOpenGLExtraFunctions
+{
+    Q_OBJECT
+
+public:
+    // On the GUI thread with shareContext current
+    explicit RenderThread(QOpenGLContext* shareContext);
+    ~RenderThread();
+
+    void stop();
+
+    // GUI thread only
+    void post(const RenderCommand& command);
+
+    // Newest finished frame for the GUI thread to draw, 0 before the first one.
+    // Only the lower left texCoordScale part of the texture holds the frame.
+    // Needs a context sharing with the render context to be current.
+    GLuint acquireFrame(QVector2D& texCoordScale);
+
+    // Any thread
+    void requestCapture();
+    QImage getFrameBuffer();
+    qint64 getLastFrameBufferUpdateTime();
+    void setFrameSink(FrameSink* sink); // Waits for a frame already in the old sink
+    FrameStats getFrameStats();
+
+signals:
+    void frameReady();
+    void recordFrame(); // Emitted on the render thread
+    void pointMeasured(QVector3D point, qreal distance);
+    void aoBakeStarted(AoBaker* baker); // The baker lives on the GUI thread
+    void posterSaved(QString fileName, bool ok);
+
+private:
+    static const int frameInterval = 12; // ms between frames while something changes
+    static const int flingTimeout = 50; // ms between the last move and the release for inertia
+    static const int settleDelay = 150; // ms after the last input before rendering at full resolution
+    static const int targetFrameTime = 16; // ms, GPU budget of a scaled down frame
+    static const int slotCount = 3;
+    static const int newFrameBit = 4;
+    static const int readbackCount = 3; // Captures arrive at most this many frames late
+
+    struct FrameSlot
+    {
+        QOpenGLFramebufferObject* fbo;
+        GLuint texture;
+        QSize size;
+        QSize rendered; // Part of the texture drawn, smaller at a scaled down resolution
+        qint64 time; // When the camera was sampled for it, ms since epoch
+        GLsync fence; // Rendering done, waited for by the GUI context
+        GLsync presented; // Drawing from the texture done, waited for by the render context
+    };
+
+    struct Readback
+    {
+        QOpenGLBuffer buffer;
+        QSize size;
+        bool yuv; // Planes of a YuvConverter, else BGRA
+        GLsync fence; // Copy into the buffer done
+        qint64 time; // When the frame was rendered
+    };
+
+    void run() override;
+    void execute(RenderCommand& command);
+    void renderFrame(float scale);
+    void publishFrame();
+    void startReadback();
+    void finishReadbacks(bool waitOldest); // Maps the signaled ones in order
+    void updateRenderScale(qint64 cpuTime);
+    void release();
+
+    void mousePress(const RenderCommand& command);
+    void mouseMove(const RenderCommand& command);
+    void mouseRelease(const RenderCommand& command);
+    void mouseDoubleClick(const RenderCommand& command);
+    void wheel(const RenderCommand& command);
+    bool pickSurface(const QPointF& pos, QVector3D& point);
+
+    void setModel(Model* model, QString fileName);
+    void setPointCloud(PointOctree* points);
+    void loadChunkedModel(QString fileName);
+    void dropModel();
+    void startAoBake(QString fileName);
+    void stopAoBake();
+    void applyOcclusion();
+    void savePoster(QString fileName, QSize size);
+
+    // Created on the GUI thread, the context is moved to the render thread
+    QOffscreenSurface* m_surface;
+    QOpenGLContext* m_context;
+
+    SpscQueue<RenderCommand, 1024> m_commands;
+    QSemaphore m_wake;
+    std::atomic<bool> m_quit;
+
+    FrameSlot m_slots[slotCount];
+    int m_back; // Render thread
+    std::atomic<int> m_middle; // Slot index, newFrameBit when not yet acquired
+    int m_front; // GUI thread
+
+    SceneRenderer m_scene;
+    GpuProfiler m_gpuProfiler;
+    YuvConverter m_yuvConverter;
+    Model* m_model;
+    ChunkedModel* m_chunkedModel; // Drawn instead of m_model when set
+    PointCloud* m_pointCloud; // Likewise
+    Camera m_camera;
+    SurfacePicker m_picker;
+    AoBaker* m_aoBaker;
+    std::atomic<bool> m_aoFinished;
+
+    QSize m_size; // Widget pixels
+    QSize m_pixelSize; // Framebuffer pixels
+    QColor m_lightColor;
+    QColor m_modelColor;
+    bool m_dirty;
+    int m_captureInterval; // ms, 0 when not recording
+
+    bool m_dynamicResolution;
+    float m_renderScale; // Of the framebuffer while the camera moves
+    bool m_reduced; // The last frame was scaled down
+    QElapsedTimer m_inputTimer; // Since the last camera input
+
+    qreal m_panDepth; // Eye space depth of the surface grabbed for panning, 0 if none
+    bool m_measuring;
+    QVector3D m_measurePoint;
+    QPointF m_mouseLastPosition;
+    QVector2D m_rotateVelocity; // Smoothed, pixels per second
+    qint64 m_lastMoveTime;
+
+    std::atomic<bool> m_captureRequested;
+    QMutex m_sinkMutex; // Held while the sink has a frame
+    FrameSink* m_frameSink; // Called with the mapped pixels instead of filling the frame buffer
+    Readback m_readbacks[readbackCount];
+    int m_readHead; // Oldest in flight
+    int m_readCount;
+
+    QMutex m_mutex; // Guards the values below
+    QImage m_frameBuffer;
+    qint64 m_lastFrameBufferUpdateTime;
+    FrameStats m_frameStats;
+};
+
+#endif // RENDERTHREAD_H
@@ -0,0 +1,71 @@
+#ifndef RENDERVIEW_H
+#define RENDERVIEW_H
+
+#include "debug/Stable.h"
+
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <QWidget>
+
+#include "FrameStats.h"
+#include "FrameSink.h"
+
+enum RenderBackend
+{
+    RENDER_BACKEND_OPENGL,
+    RENDER_BACKEND_SOFTWARE
+};
+
+// Viewport interface used by MainWindow and VideoRecorder.
+// widget() must provide the recordFrame(), pointMeasured(QVector3D, qreal) and
+// posterSaved(QString, bool) signals, recordFrame() may be emitted on any thread
+// once a requested frame buffer is ready.
+class RenderView
+{
+public:
+    virtual ~RenderView() {}
+
+    virtual QWidget* widget() = 0;
+
+    virtual void setLightColor(QColor) = 0;
+    virtual void setModelColor(QColor) = 0;
+    virtual QColor getLightColor() = 0;
+    virtual QColor getModelColor() = 0;
+
+    virtual void setOcclusionCulling(bool) = 0;
+    virtual bool isOcclusionCulling() = 0;
+
+    // Scale the resolution down while the camera moves, captures stay at full resolution
+    virtual void setDynamicResolution(bool) = 0;
+    virtual bool isDynamicResolution() = 0;
+
+    // Mesh shading, lighting is two-sided and smooth by default
+    virtual void setTwoSidedLighting(bool) = 0;
+    virtual bool isTwoSidedLighting() = 0;
+    virtual void setFlatShading(bool) = 0;
+    virtual bool isFlatShading() = 0;
+
+    virtual FrameStats getFrameStats() = 0;
+
+    // Frames per second while recording, 0 when done. Viewports that only
+    // render on demand keep rendering at this rate meanwhile.
+    virtual void setCaptureRate(int fps) = 0;
+
+    // Thread safe. The next frame rendered is captured right after rendering,
+    // stamped with the time it was rendered at.
+    virtual void requestFrameBuffer() = 0;
+    virtual QImage getFrameBuffer() = 0;
+    virtual qint64 getLastFrameBufferUpdateTime() = 0;
+
+    // Requested captures go to the sink instead of the frame buffer, nullptr to
+    // restore it. The sink must outlive the view or be reset first.
+    virtual void setFrameSink(FrameSink*) = 0;
+
+    // Current view at any resolution into a TIFF file, posterSaved() follows
+    virtual void savePoster(QString fileName, int width, int height) = 0;
+
+    virtual void loadModel(QString) = 0;
+};
+
+#endif // RENDERVIEW_H
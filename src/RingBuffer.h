@@ -0,0 +1,59 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+
+// Bounded FIFO in fixed storage, for queues that are guarded by a mutex and must not allocate.
+// Capacity must be a power of two. Pushing onto a full buffer is an error, callers check size().
+template <typename T, size_t Capacity>
+class RingBuffer
+{
+public:
+    RingBuffer() :
+        m_head(0),
+        m_size(0)
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    T& front()
+    {
+        return m_items[m_head];
+    }
+
+    void push_back(const T& item)
+    {
+        m_items[(m_head + m_size) & (Capacity - 1)] = item;
+        ++m_size;
+    }
+
+    void pop_front()
+    {
+        m_items[m_head] = T();
+        m_head = (m_head + 1) & (Capacity - 1);
+        --m_size;
+    }
+
+    void clear()
+    {
+        while (!empty())
+            pop_front();
+    }
+
+private:
+    T m_items[Capacity];
+    size_t m_head;
+    size_t m_size;
+};
+
+#endif // RINGBUFFER_H
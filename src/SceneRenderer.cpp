@@ -0,0 +1,310 @@
+#include <cstring>
+
+#include "debug/Stable.h"
+
+#include "SceneRenderer.h"
+#include "Profiler.h"
+
+#ifndef GL_PROGRAM_POINT_SIZE
+#define GL_PROGRAM_POINT_SIZE 0x8642
+#endif
+
+SceneRenderer::SceneRenderer() :
+    m_cache(nullptr),
+    m_failedVariants(0),
+    m_pointSizeLocation(-1),
+    m_frameUniforms(0),
+    m_features(SHADER_FEATURE_TWO_SIDED),
+    m_width(1),
+    m_height(1)
+{
+    for (QOpenGLShaderProgram*& program : m_variants)
+        program = nullptr;
+}
+
+SceneRenderer::~SceneRenderer()
+{
+    for (QOpenGLShaderProgram* program : m_variants)
+        delete program;
+
+    delete m_cache;
+}
+
+void SceneRenderer::destroy()
+{
+    for (QOpenGLShaderProgram*& program : m_variants)
+    {
+        delete program;
+        program = nullptr;
+    }
+
+    if (m_frameUniforms)
+        glDeleteBuffers(1, &m_frameUniforms);
+    m_frameUniforms = 0;
+}
+
+bool SceneRenderer::initialize()
+{
+    initializeOpenGLFunctions();
+
+    glClearColor(0, 0, 0, 1);
+
+    // Compiled and linked on the first run, restored from the binary cache afterwards
+    m_cache = new ProgramCache();
+
+    // The usual variants up front, others are built when first drawn with
+    if (!meshProgram(m_features) || !meshProgram(m_features | SHADER_FEATURE_OCCLUSION))
+        return false;
+
+    // Point clouds have no normals and size their points in the vertex shader
+    if (!m_cache->build(m_pointProgram, ":/rsc/pointvshader.glsl", ":/rsc/pointfshader.glsl"))
+        return false;
+
+    m_pointSizeLocation = m_pointProgram.uniformLocation("pointSize");
+
+    // Filled once per frame, every program reads it from the same binding
+    glGenBuffers(1, &m_frameUniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUniforms);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glEnable(GL_DEPTH_TEST); // Enable depth buffer
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+
+    return true;
+}
+
+void SceneRenderer::resize(int w, int h)
+{
+    m_width = w;
+    m_height = h;
+}
+
+void SceneRenderer::setTile(const QRect& tile)
+{
+    m_tile = tile;
+}
+
+void SceneRenderer::render(Model* model, const Camera& camera, QColor lightColor, QColor modelColor)
+{
+    // Clear color and depth buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (!model)
+        return;
+
+    // Calculate model view transformation
+    m_modelView = camera.getModelView(model->pivot);
+    m_projection = projection(camera);
+
+    QMatrix4x4 mvp = m_projection * m_modelView;
+
+    // Drop parts outside the frustum or hidden behind big occluders
+    {
+        ProfileScope scope("Cull");
+        m_culler.cull(*model, mvp, m_visibleParts, m_frameStats);
+    }
+
+    ProfileScope scope("Draw");
+
+    // Occlusion arrives once the bake finishes
+    int features = m_features;
+    if (!model->getOcclusion().empty())
+        features |= SHADER_FEATURE_OCCLUSION;
+
+    QOpenGLShaderProgram* program = meshProgram(features);
+    if (!program || !bindProgram(*program, lightColor, modelColor))
+        return;
+
+    // Draw
+    model->draw(m_visibleParts);
+}
+
+void SceneRenderer::render(ChunkedModel* model, const Camera& camera, QColor lightColor, QColor modelColor)
+{
+    // Clear color and depth buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (!model)
+        return;
+
+    m_modelView = camera.getModelView(model->getPivot());
+    m_projection = projection(camera);
+
+    // Pick LODs and stream, then draw what is resident
+    {
+        ProfileScope scope("Cull");
+        model->update(m_modelView, m_projection, viewportHeight(), m_frameStats);
+    }
+
+    ProfileScope scope("Draw");
+
+    // Chunks carry no occlusion
+    QOpenGLShaderProgram* program = meshProgram(m_features);
+    if (!program || !bindProgram(*program, lightColor, modelColor))
+        return;
+
+    model->draw();
+}
+
+void SceneRenderer::render(PointCloud* cloud, const Camera& camera, QColor lightColor, QColor modelColor)
+{
+    // Clear color and depth buffer
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (!cloud)
+        return;
+
+    m_modelView = camera.getModelView(cloud->getPivot());
+    m_projection = projection(camera);
+
+    // Pick the nodes for the point budget and upload new ones
+    {
+        ProfileScope scope("Cull");
+        cloud->update(m_modelView, m_projection, viewportHeight(), m_frameStats);
+    }
+
+    ProfileScope scope("Draw");
+
+    if (!bindProgram(m_pointProgram, lightColor, modelColor))
+        return;
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    cloud->draw(&m_pointProgram, m_pointSizeLocation);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
+
+QOpenGLShaderProgram* SceneRenderer::meshProgram(int features)
+{
+    if (m_variants[features] || m_failedVariants & (1 << features))
+        return m_variants[features];
+
+    QStringList defines;
+    if (features & SHADER_FEATURE_TWO_SIDED)
+        defines << "TWO_SIDED";
+    if (features & SHADER_FEATURE_FLAT)
+        defines << "FLAT";
+    if (features & SHADER_FEATURE_OCCLUSION)
+        defines << "OCCLUSION";
+
+    QOpenGLShaderProgram* program = new QOpenGLShaderProgram();
+    if (!m_cache->build(*program, ":/rsc/vshader.glsl", ":/rsc/fshader.glsl", defines))
+    {
+        // Not retried every frame
+        delete program;
+        m_failedVariants |= 1 << features;
+        return nullptr;
+    }
+
+    m_variants[features] = program;
+    return program;
+}
+
+bool SceneRenderer::bindProgram(QOpenGLShaderProgram& program, QColor lightColor, QColor modelColor)
+{
+    if (!program.bind())
+        return false;
+
+    // Set modelview-projection matrix, the normal matrix once per draw instead of per fragment
+    QMatrix4x4 mvp = m_projection * m_modelView;
+    QMatrix4x4 normalMatrix(m_modelView.normalMatrix());
+
+    FrameUniforms u;
+    memcpy(u.mvp, mvp.constData(), sizeof(u.mvp));
+    memcpy(u.modelView, m_modelView.constData(), sizeof(u.modelView));
+    memcpy(u.normalMatrix, normalMatrix.constData(), sizeof(u.normalMatrix));
+
+    QVector4D vectors[] =
+    {
+        QVector4D(0., 0., -1., 1.),
+        QVector4D(lightColor.redF(), lightColor.greenF(), lightColor.blueF(), 1.),
+        QVector4D(modelColor.redF(), modelColor.greenF(), modelColor.blueF(), 1.)
+    };
+    float* dst[] = { u.lightPos, u.lightColor, u.modelColor };
+    for (int i = 0; i < 3; ++i)
+        memcpy(dst[i], &vectors[i], sizeof(u.lightPos));
+
+    // Whole buffer replaced so the driver doesn't wait for the previous frame's draws
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameUniforms);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(u), &u, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, frameUniformsBinding, m_frameUniforms);
+
+    return true;
+}
+
+QMatrix4x4 SceneRenderer::projection(const Camera& camera) const
+{
+    QMatrix4x4 projection = camera.getProjection(m_width, m_height);
+    if (m_tile.isNull())
+        return projection;
+
+    // Maps the tile's part of the clip space onto the whole viewport
+    float centerX = (2.f * m_tile.x() + m_tile.width()) / m_width - 1;
+    float centerY = 1 - (2.f * m_tile.y() + m_tile.height()) / m_height;
+
+    QMatrix4x4 tile;
+    tile.scale((float)m_width / m_tile.width(), (float)m_height / m_tile.height(), 1);
+    tile.translate(-centerX, -centerY, 0);
+    return tile * projection;
+}
+
+int SceneRenderer::viewportHeight() const
+{
+    // LODs and point sizes keep the on screen size of the full image
+    return m_tile.isNull() ? m_height : m_tile.height();
+}
+
+int SceneRenderer::getWidth() const
+{
+    return m_width;
+}
+
+int SceneRenderer::getHeight() const
+{
+    return m_height;
+}
+
+QMatrix4x4 SceneRenderer::getModelView() const
+{
+    return m_modelView;
+}
+
+QMatrix4x4 SceneRenderer::getProjection() const
+{
+    return m_projection;
+}
+
+void SceneRenderer::setOcclusionCulling(bool enabled)
+{
+    m_culler.setEnabled(enabled);
+}
+
+bool SceneRenderer::isOcclusionCulling()
+{
+    return m_culler.isEnabled();
+}
+
+void SceneRenderer::setTwoSided(bool enabled)
+{
+    setFeature(SHADER_FEATURE_TWO_SIDED, enabled);
+}
+
+void SceneRenderer::setFlatShading(bool enabled)
+{
+    setFeature(SHADER_FEATURE_FLAT, enabled);
+}
+
+void SceneRenderer::setFeature(int feature, bool enabled)
+{
+    if (enabled)
+        m_features |= feature;
+    else
+        m_features &= ~feature;
+}
+
+FrameStats SceneRenderer::getFrameStats() const
+{
+    return m_frameStats;
+}
@@ -0,0 +1,106 @@
+#ifndef SCENERENDERER_H
+#define SCENERENDERER_H
+
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QMatrix4x4>
+#include <QVector4D>
+#include <QColor>
+#include <QRect>
+
+#include "model.h"
+#include "ChunkedModel.h"
+#include "PointCloud.h"
+#include "Camera.h"
+#include "FrameStats.h"
+#include "OcclusionCuller.h"
+#include "ProgramCache.h"
+
+// Compiled into the mesh shaders as defines of the same name without the prefix
+enum ShaderFeature
+{
+    SHADER_FEATURE_TWO_SIDED = 1, // Back faces lit like front faces
+    SHADER_FEATURE_FLAT = 2, // Face normals from screen space derivatives, vertex normals unused
+    SHADER_FEATURE_OCCLUSION = 4 // Baked per-vertex ambient occlusion
+};
+
+// Draws a model with the viewer shaders into the current framebuffer.
+// Shared by the viewport widget and the offscreen renderer, all calls need
+// the context that initialize() was called with to be current.
+// Each draw uses the mesh shader variant built for exactly the features it needs.
+class SceneRenderer : protected QOpenGLExtraFunctions
+{
+public:
+    SceneRenderer();
+    ~SceneRenderer();
+
+    bool initialize();
+    void destroy(); // Releases the GL objects, with the context current
+    void resize(int w, int h); // Projection size, the caller sets the viewport
+
+    // Part of the resize() sized image drawn into the viewport, top left origin.
+    // Null draws all of it.
+    void setTile(const QRect& tile);
+    void render(Model* model, const Camera& camera, QColor lightColor, QColor modelColor);
+    void render(ChunkedModel* model, const Camera& camera, QColor lightColor, QColor modelColor);
+    void render(PointCloud* cloud, const Camera& camera, QColor lightColor, QColor modelColor);
+
+    int getWidth() const;
+    int getHeight() const;
+    QMatrix4x4 getModelView() const;
+    QMatrix4x4 getProjection() const;
+
+    void setOcclusionCulling(bool);
+    bool isOcclusionCulling();
+    FrameStats getFrameStats() const;
+
+    // Two-sided is on by default
+    void setTwoSided(bool);
+    void setFlatShading(bool);
+
+private:
+    static const int variantCount = 8; // Every combination of ShaderFeature
+    static const int frameUniformsBinding = 0;
+
+    // std140 layout of the FrameUniforms block in the shaders
+    struct FrameUniforms
+    {
+        float mvp[16];
+        float modelView[16];
+        float normalMatrix[16];
+        float lightPos[4];
+        float lightColor[4];
+        float modelColor[4];
+    };
+
+    QOpenGLShaderProgram* meshProgram(int features);
+    bool bindProgram(QOpenGLShaderProgram& program, QColor lightColor, QColor modelColor);
+    void setFeature(int feature, bool enabled);
+    QMatrix4x4 projection(const Camera& camera) const;
+    int viewportHeight() const; // Pixels the projection spans on screen
+
+    ProgramCache* m_cache;
+    QOpenGLShaderProgram* m_variants[variantCount]; // Built on first use
+    int m_failedVariants; // Bit per variant that did not build
+    QOpenGLShaderProgram m_pointProgram;
+    int m_pointSizeLocation;
+    GLuint m_frameUniforms; // Uniform buffer
+
+    int m_features; // Set by the viewer, occlusion is added per model
+
+    int m_width;
+    int m_height;
+    QRect m_tile;
+    QMatrix4x4 m_modelView;
+    QMatrix4x4 m_projection;
+
+    OcclusionCuller m_culler;
+    std::vector<int> m_visibleParts;
+    FrameStats m_frameStats;
+};
+
+#endif // SCENERENDERER_H
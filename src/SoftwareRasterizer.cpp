@@ -0,0 +1,558 @@
+#include <algorithm>
+#include <cmath>
+
+#include <emmintrin.h>
+
+#include "debug/Stable.h"
+
+#include "SoftwareRasterizer.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    const float lightPos[3] = { 0.f, 0.f, -1.f }; // Same as Renderer::paintGL
+}
+
+SoftwareRasterizer::SoftwareRasterizer() :
+    m_width(0),
+    m_height(0),
+    m_depthStride(0),
+    m_tilesX(0),
+    m_tilesY(0),
+    m_bits(nullptr),
+    m_bytesPerLine(0)
+{}
+
+void SoftwareRasterizer::render(const Model& model, const std::vector<int>& visibleParts,
+                                const QMatrix4x4& modelView, const QMatrix4x4& projection,
+                                QColor lightColor, QColor modelColor, QImage& target)
+{
+    if (target.isNull())
+        return;
+
+    m_width = target.width();
+    m_height = target.height();
+    m_depthStride = (m_width + 3) & ~3;
+    m_tilesX = (m_width + tileSize - 1) / tileSize;
+    m_tilesY = (m_height + tileSize - 1) / tileSize;
+
+    // Detaches target once here, tiles write through the raw pointer
+    m_bits = target.bits();
+    m_bytesPerLine = target.bytesPerLine();
+
+    m_lightColor[0] = lightColor.redF();
+    m_lightColor[1] = lightColor.greenF();
+    m_lightColor[2] = lightColor.blueF();
+    m_modelColor[0] = modelColor.redF();
+    m_modelColor[1] = modelColor.greenF();
+    m_modelColor[2] = modelColor.blueF();
+
+    ThreadPool* pool = ThreadPool::instance();
+
+    // Clear color to black and depth to the far plane
+    m_depth.resize((size_t)m_depthStride * m_height);
+    pool->parallelFor(m_height, [this](int y)
+    {
+        std::fill_n((quint32*)(m_bits + (size_t)y * m_bytesPerLine), m_width, 0xff000000u);
+        std::fill_n(&m_depth[(size_t)y * m_depthStride], m_depthStride, 1.f);
+    });
+
+    shadeVertices(model, modelView, projection);
+
+    // Split the visible parts into setup jobs
+    std::vector<std::pair<const GLuint*, int>> jobs;
+    const std::vector<GLuint>& indices = model.getIndices();
+    const std::vector<Part>& parts = model.getParts();
+
+    for (int p : visibleParts)
+    {
+        int triangles = parts[p].indexCount / 3;
+
+        for (int first = 0; first < triangles; first += chunkSize)
+            jobs.push_back(std::make_pair(&indices[parts[p].firstIndex + first * 3], std::min(triangles - first, int(chunkSize))));
+    }
+
+    const int chunksPerBatch = batchSize / chunkSize;
+    m_chunks.resize(chunksPerBatch);
+
+    for (int first = 0; first < (int)jobs.size(); first += chunksPerBatch)
+    {
+        int count = std::min(chunksPerBatch, (int)jobs.size() - first);
+
+        pool->parallelFor(count, [&](int c)
+        {
+            setupChunk(m_chunks[c], jobs[first + c].first, jobs[first + c].second);
+        });
+
+        // Tiles never overlap, so there is no synchronization between them
+        pool->parallelFor(m_tilesX * m_tilesY, [&](int tile)
+        {
+            drawTile(tile, count);
+        });
+    }
+}
+
+SoftwareRasterizer::ShadedVertex SoftwareRasterizer::lerp(const ShadedVertex& a, const ShadedVertex& b, float t)
+{
+    ShadedVertex v;
+    const float* pa = &a.cx;
+    const float* pb = &b.cx;
+    float* pv = &v.cx;
+
+    for (int i = 0; i < 11; ++i)
+        pv[i] = pa[i] + (pb[i] - pa[i]) * t;
+
+    return v;
+}
+
+SoftwareRasterizer::ScreenVertex SoftwareRasterizer::project(const ShadedVertex& v)
+{
+    ScreenVertex s;
+    s.invW = 1.f / v.cw;
+    s.x = (v.cx * s.invW * 0.5f + 0.5f) * m_width;
+    s.y = (0.5f - v.cy * s.invW * 0.5f) * m_height; // Top row first
+    s.z = v.cz * s.invW * 0.5f + 0.5f;
+    return s;
+}
+
+void SoftwareRasterizer::shadeVertices(const Model& model, const QMatrix4x4& modelView, const QMatrix4x4& projection)
+{
+    const std::vector<Vertex>& vertices = model.getVertices();
+    const std::vector<float>& occlusion = model.getOcclusion();
+    int count = (int)vertices.size();
+
+    m_vertices.resize(count);
+    m_screenVertices.resize(count);
+    m_nearClipped.resize(count);
+
+    QMatrix4x4 mvp = projection * modelView;
+    QMatrix3x3 normalMatrix = modelView.normalMatrix();
+
+    // Column-major
+    const float* c = mvp.constData();
+    const float* e = modelView.constData();
+    const float* n = normalMatrix.constData();
+
+    const int block = 16384;
+    ThreadPool::instance()->parallelFor((count + block - 1) / block, [&](int b)
+    {
+        int end = std::min(count, (b + 1) * block);
+
+        for (int i = b * block; i < end; ++i)
+        {
+            float x = vertices[i].pos.x(), y = vertices[i].pos.y(), z = vertices[i].pos.z();
+            float nx = vertices[i].norm.x(), ny = vertices[i].norm.y(), nz = vertices[i].norm.z();
+
+            ShadedVertex& v = m_vertices[i];
+            v.cx = c[0] * x + c[4] * y + c[8] * z + c[12];
+            v.cy = c[1] * x + c[5] * y + c[9] * z + c[13];
+            v.cz = c[2] * x + c[6] * y + c[10] * z + c[14];
+            v.cw = c[3] * x + c[7] * y + c[11] * z + c[15];
+
+            v.px = e[0] * x + e[4] * y + e[8] * z + e[12];
+            v.py = e[1] * x + e[5] * y + e[9] * z + e[13];
+            v.pz = e[2] * x + e[6] * y + e[10] * z + e[14];
+
+            v.nx = n[0] * nx + n[3] * ny + n[6] * nz;
+            v.ny = n[1] * nx + n[4] * ny + n[7] * nz;
+            v.nz = n[2] * nx + n[5] * ny + n[8] * nz;
+
+            v.ao = occlusion.empty() ? 1.f : occlusion[i];
+
+            m_nearClipped[i] = v.cz < -v.cw;
+            if (!m_nearClipped[i])
+                m_screenVertices[i] = project(v);
+        }
+    });
+}
+
+void SoftwareRasterizer::setupChunk(Chunk& chunk, const GLuint* indices, int triangleCount)
+{
+    chunk.triangles.clear();
+    chunk.clipVertices.clear();
+    chunk.bins.resize(m_tilesX * m_tilesY);
+    for (std::vector<int>& bin : chunk.bins)
+        bin.clear();
+
+    const __m128 eps = _mm_set1_ps(1e-8f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+    alignas(16) float a[3][4], b[3][4], c[3][4], zp[3][4];
+    alignas(16) float minX[4], minY[4], maxX[4], maxY[4];
+    alignas(16) int valid[4];
+
+    int i = 0;
+
+    // Four triangles at a time
+    for (; i + 4 <= triangleCount; i += 4)
+    {
+        const GLuint* tri = indices + i * 3;
+        const ScreenVertex* s[4][3];
+        bool clipped[4];
+
+        for (int l = 0; l < 4; ++l)
+        {
+            clipped[l] = m_nearClipped[tri[l * 3]] || m_nearClipped[tri[l * 3 + 1]] || m_nearClipped[tri[l * 3 + 2]];
+
+            for (int k = 0; k < 3; ++k)
+                s[l][k] = &m_screenVertices[tri[l * 3 + k]];
+        }
+
+        __m128 x[3], y[3], zv[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            x[k] = _mm_setr_ps(s[0][k]->x, s[1][k]->x, s[2][k]->x, s[3][k]->x);
+            y[k] = _mm_setr_ps(s[0][k]->y, s[1][k]->y, s[2][k]->y, s[3][k]->y);
+            zv[k] = _mm_setr_ps(s[0][k]->z, s[1][k]->z, s[2][k]->z, s[3][k]->z);
+        }
+
+        // Edge opposite to vertex k goes from k + 1 to k + 2
+        __m128 ea[3], eb[3], ec[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            int k1 = (k + 1) % 3, k2 = (k + 2) % 3;
+            ea[k] = _mm_sub_ps(y[k1], y[k2]);
+            eb[k] = _mm_sub_ps(x[k2], x[k1]);
+            ec[k] = _mm_sub_ps(_mm_mul_ps(y[k2], x[k1]), _mm_mul_ps(x[k2], y[k1]));
+        }
+
+        __m128 area = _mm_add_ps(_mm_add_ps(ec[0], ec[1]), ec[2]);
+        __m128 nonDegenerate = _mm_cmpgt_ps(_mm_and_ps(area, absMask), eps);
+        _mm_store_si128((__m128i*)valid, _mm_castps_si128(nonDegenerate));
+
+        // Normalizing by the signed area makes the weights positive inside for both windings
+        __m128 invArea = _mm_div_ps(_mm_set1_ps(1.f), _mm_or_ps(_mm_and_ps(nonDegenerate, area), _mm_andnot_ps(nonDegenerate, _mm_set1_ps(1.f))));
+
+        __m128 za = _mm_setzero_ps(), zb = _mm_setzero_ps(), zc = _mm_setzero_ps();
+        for (int k = 0; k < 3; ++k)
+        {
+            ea[k] = _mm_mul_ps(ea[k], invArea);
+            eb[k] = _mm_mul_ps(eb[k], invArea);
+            ec[k] = _mm_mul_ps(ec[k], invArea);
+
+            za = _mm_add_ps(za, _mm_mul_ps(ea[k], zv[k]));
+            zb = _mm_add_ps(zb, _mm_mul_ps(eb[k], zv[k]));
+            zc = _mm_add_ps(zc, _mm_mul_ps(ec[k], zv[k]));
+
+            _mm_store_ps(a[k], ea[k]);
+            _mm_store_ps(b[k], eb[k]);
+            _mm_store_ps(c[k], ec[k]);
+        }
+
+        _mm_store_ps(zp[0], za);
+        _mm_store_ps(zp[1], zb);
+        _mm_store_ps(zp[2], zc);
+
+        _mm_store_ps(minX, _mm_min_ps(_mm_min_ps(x[0], x[1]), x[2]));
+        _mm_store_ps(maxX, _mm_max_ps(_mm_max_ps(x[0], x[1]), x[2]));
+        _mm_store_ps(minY, _mm_min_ps(_mm_min_ps(y[0], y[1]), y[2]));
+        _mm_store_ps(maxY, _mm_max_ps(_mm_max_ps(y[0], y[1]), y[2]));
+
+        for (int l = 0; l < 4; ++l)
+        {
+            const ShadedVertex* v[3] = { &m_vertices[tri[l * 3]], &m_vertices[tri[l * 3 + 1]], &m_vertices[tri[l * 3 + 2]] };
+
+            if (clipped[l])
+            {
+                setupClipped(chunk, v[0], v[1], v[2]);
+                continue;
+            }
+
+            if (!valid[l] || maxX[l] < 0 || maxY[l] < 0 || minX[l] >= m_width || minY[l] >= m_height)
+                continue;
+
+            SetupTriangle t;
+            for (int k = 0; k < 3; ++k)
+            {
+                t.a[k] = a[k][l];
+                t.b[k] = b[k][l];
+                t.c[k] = c[k][l];
+                t.v[k] = v[k];
+                t.invW[k] = s[l][k]->invW;
+            }
+
+            t.za = zp[0][l];
+            t.zb = zp[1][l];
+            t.zc = zp[2][l];
+            t.minX = std::max(0, (int)std::floor(minX[l]));
+            t.minY = std::max(0, (int)std::floor(minY[l]));
+            t.maxX = std::min(m_width - 1, (int)std::ceil(maxX[l]));
+            t.maxY = std::min(m_height - 1, (int)std::ceil(maxY[l]));
+
+            chunk.triangles.push_back(t);
+            binTriangle(chunk, (int)chunk.triangles.size() - 1);
+        }
+    }
+
+    for (; i < triangleCount; ++i)
+    {
+        const GLuint* tri = indices + i * 3;
+        const ShadedVertex* v[3] = { &m_vertices[tri[0]], &m_vertices[tri[1]], &m_vertices[tri[2]] };
+
+        if (m_nearClipped[tri[0]] || m_nearClipped[tri[1]] || m_nearClipped[tri[2]])
+        {
+            setupClipped(chunk, v[0], v[1], v[2]);
+            continue;
+        }
+
+        SetupTriangle t;
+        if (setupTriangle(v[0], v[1], v[2], t))
+        {
+            chunk.triangles.push_back(t);
+            binTriangle(chunk, (int)chunk.triangles.size() - 1);
+        }
+    }
+}
+
+void SoftwareRasterizer::setupClipped(Chunk& chunk, const ShadedVertex* v0, const ShadedVertex* v1, const ShadedVertex* v2)
+{
+    // Sutherland-Hodgman against the near plane z = -w
+    const ShadedVertex* in[3] = { v0, v1, v2 };
+    ShadedVertex out[4];
+    int n = 0;
+
+    for (int k = 0; k < 3; ++k)
+    {
+        const ShadedVertex& a = *in[k];
+        const ShadedVertex& b = *in[(k + 1) % 3];
+        float da = a.cz + a.cw;
+        float db = b.cz + b.cw;
+
+        if (da >= 0)
+            out[n++] = a;
+
+        if ((da >= 0) != (db >= 0))
+            out[n++] = lerp(a, b, da / (da - db));
+    }
+
+    if (n < 3)
+        return;
+
+    int first = (int)chunk.clipVertices.size();
+    for (int k = 0; k < n; ++k)
+        chunk.clipVertices.push_back(out[k]);
+
+    for (int k = 1; k + 1 < n; ++k)
+    {
+        SetupTriangle t;
+        if (setupTriangle(&chunk.clipVertices[first], &chunk.clipVertices[first + k], &chunk.clipVertices[first + k + 1], t))
+        {
+            chunk.triangles.push_back(t);
+            binTriangle(chunk, (int)chunk.triangles.size() - 1);
+        }
+    }
+}
+
+bool SoftwareRasterizer::setupTriangle(const ShadedVertex* v0, const ShadedVertex* v1, const ShadedVertex* v2, SetupTriangle& t)
+{
+    const ShadedVertex* v[3] = { v0, v1, v2 };
+    ScreenVertex s[3] = { project(*v0), project(*v1), project(*v2) };
+
+    float area = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        const ScreenVertex& s1 = s[(k + 1) % 3];
+        const ScreenVertex& s2 = s[(k + 2) % 3];
+        t.a[k] = s1.y - s2.y;
+        t.b[k] = s2.x - s1.x;
+        t.c[k] = s2.y * s1.x - s2.x * s1.y;
+        area += t.c[k];
+    }
+
+    if (std::fabs(area) <= 1e-8f)
+        return false;
+
+    float minX = std::min(std::min(s[0].x, s[1].x), s[2].x);
+    float maxX = std::max(std::max(s[0].x, s[1].x), s[2].x);
+    float minY = std::min(std::min(s[0].y, s[1].y), s[2].y);
+    float maxY = std::max(std::max(s[0].y, s[1].y), s[2].y);
+
+    if (maxX < 0 || maxY < 0 || minX >= m_width || minY >= m_height)
+        return false;
+
+    t.za = t.zb = t.zc = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        t.a[k] /= area;
+        t.b[k] /= area;
+        t.c[k] /= area;
+
+        t.za += t.a[k] * s[k].z;
+        t.zb += t.b[k] * s[k].z;
+        t.zc += t.c[k] * s[k].z;
+
+        t.v[k] = v[k];
+        t.invW[k] = s[k].invW;
+    }
+
+    t.minX = std::max(0, (int)std::floor(minX));
+    t.minY = std::max(0, (int)std::floor(minY));
+    t.maxX = std::min(m_width - 1, (int)std::ceil(maxX));
+    t.maxY = std::min(m_height - 1, (int)std::ceil(maxY));
+
+    return true;
+}
+
+void SoftwareRasterizer::binTriangle(Chunk& chunk, int index)
+{
+    const SetupTriangle& t = chunk.triangles[index];
+
+    for (int ty = t.minY / tileSize; ty <= t.maxY / tileSize; ++ty)
+        for (int tx = t.minX / tileSize; tx <= t.maxX / tileSize; ++tx)
+            chunk.bins[ty * m_tilesX + tx].push_back(index);
+}
+
+void SoftwareRasterizer::drawTile(int tile, int chunkCount)
+{
+    int tileX0 = (tile % m_tilesX) * tileSize;
+    int tileY0 = (tile / m_tilesX) * tileSize;
+    int tileX1 = std::min(tileX0 + tileSize, m_width);
+    int tileY1 = std::min(tileY0 + tileSize, m_height);
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 laneIndex = _mm_setr_ps(0.f, 1.f, 2.f, 3.f);
+    const __m128 scale = _mm_set1_ps(255.f);
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+    __m128 color[3];
+    for (int k = 0; k < 3; ++k)
+        color[k] = _mm_set1_ps(m_lightColor[k] * m_modelColor[k]);
+
+    for (int ci = 0; ci < chunkCount; ++ci)
+    {
+        const Chunk& chunk = m_chunks[ci];
+
+        for (int index : chunk.bins[tile])
+        {
+            const SetupTriangle& t = chunk.triangles[index];
+
+            int x0 = std::max(tileX0, t.minX) & ~3;
+            int x1 = std::min(tileX1, t.maxX + 1);
+            int y0 = std::max(tileY0, t.minY);
+            int y1 = std::min(tileY1, t.maxY + 1);
+
+            // Perspective correct interpolation of attribute / w
+            __m128 w[3], p[3][3], n[3][3], o[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                const ShadedVertex& v = *t.v[k];
+                float iw = t.invW[k];
+
+                w[k] = _mm_set1_ps(iw);
+                p[k][0] = _mm_set1_ps(v.px * iw);
+                p[k][1] = _mm_set1_ps(v.py * iw);
+                p[k][2] = _mm_set1_ps(v.pz * iw);
+                n[k][0] = _mm_set1_ps(v.nx * iw);
+                n[k][1] = _mm_set1_ps(v.ny * iw);
+                n[k][2] = _mm_set1_ps(v.nz * iw);
+                o[k] = _mm_set1_ps(v.ao * iw);
+            }
+
+            __m128 a[3], step[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                a[k] = _mm_set1_ps(t.a[k]);
+                step[k] = _mm_set1_ps(t.a[k] * 4);
+            }
+
+            __m128 za = _mm_set1_ps(t.za);
+            __m128 stepZ = _mm_set1_ps(t.za * 4);
+
+            for (int y = y0; y < y1; ++y)
+            {
+                float py = y + 0.5f;
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x0), laneOffset);
+                __m128 lx = _mm_add_ps(_mm_set1_ps((float)x0), laneIndex);
+
+                __m128 l[3];
+                for (int k = 0; k < 3; ++k)
+                    l[k] = _mm_add_ps(_mm_mul_ps(a[k], px), _mm_set1_ps(t.b[k] * py + t.c[k]));
+
+                __m128 z = _mm_add_ps(_mm_mul_ps(za, px), _mm_set1_ps(t.zb * py + t.zc));
+
+                float* depthRow = &m_depth[(size_t)y * m_depthStride];
+                quint32* colorRow = (quint32*)(m_bits + (size_t)y * m_bytesPerLine);
+
+                for (int x = x0; x < x1; x += 4)
+                {
+                    __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(l[0], zero), _mm_cmpge_ps(l[1], zero)), _mm_cmpge_ps(l[2], zero));
+                    inside = _mm_and_ps(inside, _mm_cmplt_ps(lx, _mm_set1_ps((float)m_width)));
+
+                    __m128 d = _mm_loadu_ps(depthRow + x);
+                    __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, d));
+                    int passMask = _mm_movemask_ps(pass);
+
+                    if (passMask)
+                    {
+                        _mm_storeu_ps(depthRow + x, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, d)));
+
+                        // Interpolate eye space position and normal
+                        __m128 q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(l[0], w[0]), _mm_mul_ps(l[1], w[1])), _mm_mul_ps(l[2], w[2]));
+                        __m128 invQ = _mm_div_ps(one, q);
+
+                        __m128 pos[3], nrm[3];
+                        for (int j = 0; j < 3; ++j)
+                        {
+                            pos[j] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l[0], p[0][j]), _mm_mul_ps(l[1], p[1][j])), _mm_mul_ps(l[2], p[2][j])), invQ);
+                            nrm[j] = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l[0], n[0][j]), _mm_mul_ps(l[1], n[1][j])), _mm_mul_ps(l[2], n[2][j])), invQ);
+                        }
+
+                        // fshader.glsl: abs(dot(normal, surfaceToLight)) / (length(surfaceToLight) * length(normal))
+                        __m128 sx = _mm_sub_ps(_mm_set1_ps(lightPos[0]), pos[0]);
+                        __m128 sy = _mm_sub_ps(_mm_set1_ps(lightPos[1]), pos[1]);
+                        __m128 sz = _mm_sub_ps(_mm_set1_ps(lightPos[2]), pos[2]);
+
+                        __m128 dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nrm[0], sx), _mm_mul_ps(nrm[1], sy)), _mm_mul_ps(nrm[2], sz));
+                        __m128 ss = _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy)), _mm_mul_ps(sz, sz));
+                        __m128 nn = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nrm[0], nrm[0]), _mm_mul_ps(nrm[1], nrm[1])), _mm_mul_ps(nrm[2], nrm[2]));
+                        __m128 len = _mm_sqrt_ps(_mm_mul_ps(ss, nn));
+
+                        __m128 nonZero = _mm_cmpgt_ps(len, zero);
+                        __m128 brightness = _mm_and_ps(nonZero, _mm_div_ps(_mm_and_ps(dot, absMask), _mm_or_ps(len, _mm_andnot_ps(nonZero, one))));
+
+                        // Baked ambient occlusion
+                        __m128 ao = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(l[0], o[0]), _mm_mul_ps(l[1], o[1])), _mm_mul_ps(l[2], o[2])), invQ);
+                        brightness = _mm_mul_ps(brightness, ao);
+
+                        __m128i rgb[3];
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(brightness, color[k]), zero), one);
+                            rgb[k] = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+                        }
+
+                        __m128i pixel = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(rgb[0], 16)), _mm_or_si128(_mm_slli_epi32(rgb[1], 8), rgb[2]));
+
+                        if (x + 4 <= m_width)
+                        {
+                            __m128i old = _mm_loadu_si128((const __m128i*)(colorRow + x));
+                            __m128i mask = _mm_castps_si128(pass);
+                            _mm_storeu_si128((__m128i*)(colorRow + x), _mm_or_si128(_mm_and_si128(mask, pixel), _mm_andnot_si128(mask, old)));
+                        }
+                        else
+                        {
+                            // Last pixels of a row that is not a multiple of 4
+                            alignas(16) quint32 out[4];
+                            _mm_store_si128((__m128i*)out, pixel);
+
+                            for (int lane = 0; lane < 4; ++lane)
+                            {
+                                if (passMask & (1 << lane))
+                                    colorRow[x + lane] = out[lane];
+                            }
+                        }
+                    }
+
+                    for (int k = 0; k < 3; ++k)
+                        l[k] = _mm_add_ps(l[k], step[k]);
+
+                    z = _mm_add_ps(z, stepZ);
+                    lx = _mm_add_ps(lx, _mm_set1_ps(4.f));
+                }
+            }
+        }
+    }
+}
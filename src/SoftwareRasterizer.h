@@ -0,0 +1,92 @@
+#ifndef SOFTWARERASTERIZER_H
+#define SOFTWARERASTERIZER_H
+
+#include <deque>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QColor>
+#include <QImage>
+#include <QMatrix4x4>
+
+#include "model.h"
+
+// Tiled CPU rasterizer producing the same shading as vshader.glsl/fshader.glsl.
+// Triangles are set up four at a time with SSE and binned into tiles,
+// tiles are rasterized and shaded in parallel on the thread pool.
+class SoftwareRasterizer
+{
+public:
+    SoftwareRasterizer();
+
+    // Renders the given parts into target, which must be Format_RGB32 with the top row first
+    void render(const Model& model, const std::vector<int>& visibleParts,
+                const QMatrix4x4& modelView, const QMatrix4x4& projection,
+                QColor lightColor, QColor modelColor, QImage& target);
+
+private:
+    static const int tileSize = 64;
+    static const int chunkSize = 4096; // Triangles per setup job
+    static const int batchSize = 64 * chunkSize; // Triangles set up before the tiles are drawn
+
+    // Vertex shader output
+    struct ShadedVertex
+    {
+        float cx, cy, cz, cw; // Clip space
+        float px, py, pz; // Eye space position
+        float nx, ny, nz; // Eye space normal
+        float ao; // Baked ambient occlusion
+    };
+
+    struct ScreenVertex
+    {
+        float x, y, z, invW;
+    };
+
+    struct SetupTriangle
+    {
+        // Barycentric weight of vertex k is a[k] * x + b[k] * y + c[k]
+        float a[3], b[3], c[3];
+        float za, zb, zc; // Depth plane
+        const ShadedVertex* v[3];
+        float invW[3];
+        int minX, minY, maxX, maxY;
+    };
+
+    struct Chunk
+    {
+        std::vector<SetupTriangle> triangles;
+        std::vector<std::vector<int>> bins;
+        std::deque<ShadedVertex> clipVertices; // Stable addresses for near plane clipping output
+    };
+
+    void shadeVertices(const Model& model, const QMatrix4x4& modelView, const QMatrix4x4& projection);
+    void setupChunk(Chunk& chunk, const GLuint* indices, int triangleCount);
+    void setupClipped(Chunk& chunk, const ShadedVertex* v0, const ShadedVertex* v1, const ShadedVertex* v2);
+    bool setupTriangle(const ShadedVertex* v0, const ShadedVertex* v1, const ShadedVertex* v2, SetupTriangle& t);
+    void binTriangle(Chunk& chunk, int index);
+    void drawTile(int tile, int chunkCount);
+
+    static ShadedVertex lerp(const ShadedVertex& a, const ShadedVertex& b, float t);
+    ScreenVertex project(const ShadedVertex&);
+
+    int m_width;
+    int m_height;
+    int m_depthStride;
+    int m_tilesX;
+    int m_tilesY;
+
+    uchar* m_bits;
+    int m_bytesPerLine;
+    float m_lightColor[3];
+    float m_modelColor[3];
+
+    std::vector<ShadedVertex> m_vertices;
+    std::vector<ScreenVertex> m_screenVertices;
+    std::vector<char> m_nearClipped;
+    std::vector<Chunk> m_chunks;
+    std::vector<float> m_depth;
+};
+
+#endif // SOFTWARERASTERIZER_H
@@ -0,0 +1,357 @@
+#include "debug/Stable.h"
+
+#include <QMouseEvent>
+#include <QPainter>
+#include <QDateTime>
+#include <QTimer>
+
+#include "SoftwareRenderer.h"
+#include "ModelLoadDialog.h"
+#include "AoBakeDialog.h"
+#include "Profiler.h"
+
+SoftwareRenderer::SoftwareRenderer(QWidget *parent) :
+    QWidget(parent),
+    m_model(new Model()),
+    m_panDepth(0),
+    m_measuring(false),
+    m_aoBaker(nullptr),
+    m_modelColor(Qt::white),
+    m_lightColor(Qt::white),
+    m_frameSink(nullptr),
+    m_renderTime(0),
+    m_captureRequested(false),
+    m_lastFrameBufferUpdateTime(QDateTime::currentMSecsSinceEpoch())
+{
+    m_captureTimer = new QTimer(this);
+    m_captureTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_captureTimer, &QTimer::timeout, this, &SoftwareRenderer::requestFrameBuffer);
+
+    // Every pixel is written by the rasterizer
+    setAttribute(Qt::WA_OpaquePaintEvent);
+}
+
+SoftwareRenderer::~SoftwareRenderer()
+{
+    stopAoBake();
+    m_picker.setModel(nullptr);
+    delete m_model;
+}
+
+QWidget* SoftwareRenderer::widget()
+{
+    return this;
+}
+
+void SoftwareRenderer::setCaptureRate(int fps)
+{
+    // A frame is rendered and captured at every tick, even if nothing changed
+    if (fps > 0)
+        m_captureTimer->start(1000 / fps);
+    else
+        m_captureTimer->stop();
+}
+
+void SoftwareRenderer::requestFrameBuffer()
+{
+    // Captured by the next paint, which renders a frame even if nothing changed
+    m_captureRequested = true;
+    QMetaObject::invokeMethod(this, "update", Qt::QueuedConnection);
+}
+
+QImage SoftwareRenderer::getFrameBuffer()
+{
+    QMutexLocker lck(&m_frameBufferMutex);
+    return m_frameBuffer;
+}
+
+qint64 SoftwareRenderer::getLastFrameBufferUpdateTime()
+{
+    QMutexLocker lck(&m_frameBufferMutex);
+    return m_lastFrameBufferUpdateTime;
+}
+
+void SoftwareRenderer::setFrameSink(FrameSink* sink)
+{
+    m_frameSink = sink;
+}
+
+void SoftwareRenderer::captureFrame()
+{
+    // The rendered frame is already in system memory
+    ProfileScope scope("Readback");
+    if (m_frameSink)
+        m_frameSink->consumeFrame(m_image.constBits(), m_image.width(), m_image.height(), m_image.bytesPerLine(), m_renderTime);
+
+    {
+        QMutexLocker lck(&m_frameBufferMutex);
+        if (!m_frameSink)
+            m_frameBuffer = m_image.copy();
+        m_lastFrameBufferUpdateTime = m_renderTime;
+    }
+    recordFrame();
+}
+
+void SoftwareRenderer::savePoster(QString fileName, int, int)
+{
+    // Posters are rendered in GPU tiles only
+    qDebug() << "SoftwareRenderer: posters need the OpenGL renderer";
+    posterSaved(fileName, false);
+}
+
+void SoftwareRenderer::loadModel(QString fileName)
+{
+    // Residency is managed in GPU buffers
+    if (fileName.endsWith(".chunks"))
+    {
+        qWarning() << "Out-of-core models need the OpenGL renderer";
+        return;
+    }
+
+    ModelLoadDialog* mld = new ModelLoadDialog(this, fileName);
+    mld->exec();
+
+    if (mld->isReady() && mld->isPointCloud())
+        qWarning() << "Point clouds need the OpenGL renderer";
+    else if (mld->isReady())
+    {
+        stopAoBake();
+        m_picker.setModel(nullptr);
+        m_measuring = false;
+        delete m_model;
+
+        // No GL context here, the model keeps only its CPU side copy
+        m_model = new Model();
+        mld->read(m_model);
+        m_picker.setModel(m_model);
+        startAoBake(fileName);
+
+        update();
+    }
+}
+
+void SoftwareRenderer::setLightColor(QColor c)
+{
+    m_lightColor = c;
+    update();
+}
+
+void SoftwareRenderer::setModelColor(QColor c)
+{
+    m_modelColor = c;
+    update();
+}
+
+QColor SoftwareRenderer::getLightColor()
+{
+    return m_lightColor;
+}
+
+QColor SoftwareRenderer::getModelColor()
+{
+    return m_modelColor;
+}
+
+void SoftwareRenderer::setOcclusionCulling(bool enabled)
+{
+    m_culler.setEnabled(enabled);
+    update();
+}
+
+bool SoftwareRenderer::isOcclusionCulling()
+{
+    return m_culler.isEnabled();
+}
+
+void SoftwareRenderer::setDynamicResolution(bool)
+{
+    // Always renders at the widget resolution
+}
+
+bool SoftwareRenderer::isDynamicResolution()
+{
+    return false;
+}
+
+void SoftwareRenderer::setTwoSidedLighting(bool)
+{
+    // The rasterizer always lights both sides and interpolates vertex normals
+}
+
+bool SoftwareRenderer::isTwoSidedLighting()
+{
+    return true;
+}
+
+void SoftwareRenderer::setFlatShading(bool)
+{
+}
+
+bool SoftwareRenderer::isFlatShading()
+{
+    return false;
+}
+
+FrameStats SoftwareRenderer::getFrameStats()
+{
+    return m_frameStats;
+}
+
+void SoftwareRenderer::mousePressEvent(QMouseEvent *e)
+{
+    m_mouseLastPosition = QVector2D(e->localPos());
+
+    QVector3D point;
+
+    if (e->button() == Qt::MiddleButton)
+    {
+        // Grab the surface under the cursor so that panning keeps it there
+        m_panDepth = 0;
+        if (pickSurface(e->localPos(), point))
+            m_panDepth = -m_camera.getModelView(m_model->pivot).map(point).z();
+    }
+    else if (e->button() == Qt::LeftButton && e->modifiers() & Qt::ControlModifier && pickSurface(e->localPos(), point))
+    {
+        // Distance from the previous measured point, -1 for the first one
+        pointMeasured(point, m_measuring ? (point - m_measurePoint).length() : -1);
+        m_measurePoint = point;
+        m_measuring = true;
+    }
+}
+
+void SoftwareRenderer::mouseMoveEvent(QMouseEvent *e)
+{
+    QVector2D diff = QVector2D(e->localPos()) - m_mouseLastPosition;
+    m_mouseLastPosition = QVector2D(e->localPos());
+
+    if (e->buttons() == Qt::MiddleButton && e->modifiers() & Qt::ShiftModifier)
+    {
+        if (m_panDepth > 0)
+            m_camera.pan(diff, m_panDepth, height());
+        else
+            m_camera.pan(diff);
+    }
+    else if (e->buttons() == Qt::MiddleButton)
+        m_camera.rotate(diff);
+
+    update();
+}
+
+void SoftwareRenderer::mouseDoubleClickEvent(QMouseEvent *e)
+{
+    QVector3D point;
+
+    // Rotate around the picked point from now on
+    if (e->button() == Qt::LeftButton && pickSurface(e->localPos(), point))
+    {
+        m_camera.movePivot(m_model->pivot, point);
+        m_model->pivot = point;
+        update();
+    }
+}
+
+void SoftwareRenderer::wheelEvent(QWheelEvent* e)
+{
+    QPoint numPixels = e->pixelDelta();
+    QPoint numDegrees = e->angleDelta() / 8;
+    qreal d = 0;
+
+    if (!numPixels.isNull())
+    {
+        d = numPixels.y();
+    } else if (!numDegrees.isNull())
+    {
+        d = (numDegrees / 15).y();
+    }
+
+    QVector3D point;
+    if (pickSurface(e->posF(), point))
+        m_camera.zoomAt(d, point, m_model->pivot);
+    else
+        m_camera.zoom(d);
+
+    e->accept();
+    update();
+}
+
+void SoftwareRenderer::paintEvent(QPaintEvent*)
+{
+    ProfileScope scope("Frame");
+
+    renderFrame();
+
+    // The frame just rendered, before anything else can change it
+    if (m_captureRequested.exchange(false) && !m_image.isNull())
+        captureFrame();
+
+    QPainter p(this);
+    p.drawImage(0, 0, m_image);
+}
+
+void SoftwareRenderer::renderFrame()
+{
+    if (width() <= 0 || height() <= 0)
+        return;
+
+    if (m_image.size() != size())
+        m_image = QImage(size(), QImage::Format_RGB32);
+
+    // Captures carry the time the camera was sampled at
+    m_renderTime = QDateTime::currentMSecsSinceEpoch();
+
+    QMatrix4x4 modelView = m_camera.getModelView(m_model->pivot);
+    QMatrix4x4 projection = m_camera.getProjection(width(), height());
+
+    // Same culling as the OpenGL path, then rasterize what is left
+    {
+        ProfileScope scope("Cull");
+        m_culler.cull(*m_model, projection * modelView, m_visibleParts, m_frameStats);
+    }
+
+    ProfileScope scope("Rasterize");
+    m_rasterizer.render(*m_model, m_visibleParts, modelView, projection, m_lightColor, m_modelColor, m_image);
+}
+
+bool SoftwareRenderer::pickSurface(const QPointF& pos, QVector3D& point)
+{
+    QMatrix4x4 mvp = m_camera.getProjection(width(), height()) * m_camera.getModelView(m_model->pivot);
+    return m_picker.pick(mvp, pos, size(), point);
+}
+
+void SoftwareRenderer::startAoBake(QString fileName)
+{
+    m_aoBaker = new AoBaker(m_model, m_picker.getBuilder(), fileName);
+    connect(m_aoBaker, &QThread::finished, this, &SoftwareRenderer::applyOcclusion);
+    new AoBakeDialog(this, m_aoBaker);
+    m_aoBaker->start(QThread::LowPriority);
+}
+
+void SoftwareRenderer::stopAoBake()
+{
+    if (!m_aoBaker)
+        return;
+
+    m_aoBaker->cancel();
+    m_aoBaker->wait();
+
+    // Deferred so that a finished() still queued from it is not taken for the next baker's
+    m_aoBaker->deleteLater();
+    m_aoBaker = nullptr;
+}
+
+void SoftwareRenderer::applyOcclusion()
+{
+    if (!m_aoBaker || sender() != m_aoBaker)
+        return;
+
+    m_aoBaker->wait();
+
+    if (m_aoBaker->isReady())
+    {
+        m_aoBaker->read(m_model);
+        update();
+    }
+
+    m_aoBaker->deleteLater();
+    m_aoBaker = nullptr;
+}
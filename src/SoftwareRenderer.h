@@ -0,0 +1,115 @@
+#ifndef SOFTWARERENDERER_H
+#define SOFTWARERENDERER_H
+
+#include <atomic>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QString>
+#include <QWidget>
+#include <QImage>
+#include <QVector2D>
+#include <QColor>
+#include <QMutex>
+#include <QTimer>
+
+#include "model.h"
+#include "Camera.h"
+#include "SurfacePicker.h"
+#include "AoBaker.h"
+#include "FrameStats.h"
+#include "OcclusionCuller.h"
+#include "RenderView.h"
+#include "SoftwareRasterizer.h"
+
+// Viewport drawing the model with SoftwareRasterizer, for machines without a usable GPU
+class SoftwareRenderer : public QWidget, public RenderView
+{
+    Q_OBJECT
+
+public:
+    explicit SoftwareRenderer(QWidget *parent = 0);
+    ~SoftwareRenderer();
+
+    QWidget* widget() override;
+
+    void setLightColor(QColor) override;
+    void setModelColor(QColor) override;
+
+    QColor getLightColor() override;
+    QColor getModelColor() override;
+
+    void setOcclusionCulling(bool) override;
+    bool isOcclusionCulling() override;
+    void setDynamicResolution(bool) override;
+    bool isDynamicResolution() override;
+    void setTwoSidedLighting(bool) override;
+    bool isTwoSidedLighting() override;
+    void setFlatShading(bool) override;
+    bool isFlatShading() override;
+    FrameStats getFrameStats() override;
+
+    void setCaptureRate(int fps) override;
+    void requestFrameBuffer() override;
+    QImage getFrameBuffer() override;
+    qint64 getLastFrameBufferUpdateTime() override;
+    void setFrameSink(FrameSink*) override;
+
+    void savePoster(QString fileName, int width, int height) override;
+
+    void loadModel(QString) override;
+
+protected:
+    void mousePressEvent(QMouseEvent*) override;
+    void mouseMoveEvent(QMouseEvent*) override;
+    void mouseDoubleClickEvent(QMouseEvent*) override;
+    void wheelEvent(QWheelEvent*) override;
+
+    void paintEvent(QPaintEvent*) override;
+
+private:
+    bool pickSurface(const QPointF& pos, QVector3D& point);
+    void startAoBake(QString fileName);
+    void stopAoBake();
+
+    void renderFrame();
+    void captureFrame(); // Of the frame just rendered
+
+    Model* m_model;
+
+    Camera m_camera;
+    SurfacePicker m_picker;
+    qreal m_panDepth; // Eye space depth of the surface grabbed for panning, 0 if none
+    bool m_measuring;
+    QVector3D m_measurePoint;
+    AoBaker* m_aoBaker;
+    QVector2D m_mouseLastPosition;
+
+    QColor m_modelColor;
+    QColor m_lightColor;
+
+    OcclusionCuller m_culler;
+    SoftwareRasterizer m_rasterizer;
+    std::vector<int> m_visibleParts;
+    FrameStats m_frameStats;
+
+    QImage m_image;
+    FrameSink* m_frameSink; // GUI thread
+    qint64 m_renderTime; // Of m_image, ms since epoch
+    std::atomic<bool> m_captureRequested;
+    QTimer* m_captureTimer; // Requests captures while recording
+    QMutex m_frameBufferMutex; // Guards the values below for the recorder thread
+    QImage m_frameBuffer;
+    qint64 m_lastFrameBufferUpdateTime;
+
+signals:
+    void recordFrame();
+    void pointMeasured(QVector3D point, qreal distance);
+    void posterSaved(QString fileName, bool ok);
+
+public slots:
+    void applyOcclusion();
+};
+
+#endif // SOFTWARERENDERER_H
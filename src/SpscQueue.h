@@ -0,0 +1,56 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two, one slot is kept free to tell full from empty.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue() :
+        m_head(0),
+        m_tail(0)
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    }
+
+    // Producer only, false if the queue is full
+    bool push(const T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & (Capacity - 1);
+
+        if (next == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, false if the queue is empty
+    bool pop(T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+
+        item = m_items[tail];
+        m_items[tail] = T(); // Don't keep shared data alive in the slot
+        m_tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    T m_items[Capacity];
+
+    // Separate cache lines so producer and consumer don't contend
+    alignas(64) std::atomic<size_t> m_head;
+    alignas(64) std::atomic<size_t> m_tail;
+};
+
+#endif // SPSCQUEUE_H
@@ -0,0 +1,72 @@
+#include "debug/Stable.h"
+
+#include "SurfacePicker.h"
+
+SurfacePicker::SurfacePicker() :
+    m_builder(nullptr)
+{}
+
+SurfacePicker::~SurfacePicker()
+{
+    setModel(nullptr);
+}
+
+void SurfacePicker::setModel(const Model* model)
+{
+    if (m_builder)
+    {
+        m_builder->cancel();
+        m_builder->wait();
+        delete m_builder;
+        m_builder = nullptr;
+    }
+
+    if (model)
+    {
+        m_builder = new BvhBuilder(model);
+        m_builder->start(QThread::LowPriority);
+    }
+}
+
+bool SurfacePicker::isReady()
+{
+    return m_builder && m_builder->isReady();
+}
+
+BvhBuilder* SurfacePicker::getBuilder()
+{
+    return m_builder;
+}
+
+bool SurfacePicker::pick(const QMatrix4x4& modelViewProjection, const QPointF& pos, const QSize& size, QVector3D& point)
+{
+    if (!isReady())
+        return false;
+
+    Ray ray = screenRay(modelViewProjection, pos, size);
+
+    // The ray spans the near to far plane with t in [0, 1]
+    RayHit hit;
+    if (!m_builder->getBvh().intersect(ray, hit, 0, 1))
+        return false;
+
+    point = ray.origin + hit.t * ray.direction;
+    return true;
+}
+
+Ray SurfacePicker::screenRay(const QMatrix4x4& modelViewProjection, const QPointF& pos, const QSize& size)
+{
+    QMatrix4x4 inverse = modelViewProjection.inverted();
+
+    // Widget y axis points down
+    float x = float(2 * pos.x() / (size.width() ? size.width() : 1) - 1);
+    float y = float(1 - 2 * pos.y() / (size.height() ? size.height() : 1));
+
+    QVector3D nearPoint = inverse.map(QVector3D(x, y, -1));
+    QVector3D farPoint = inverse.map(QVector3D(x, y, 1));
+
+    Ray ray;
+    ray.origin = nearPoint;
+    ray.direction = farPoint - nearPoint;
+    return ray;
+}
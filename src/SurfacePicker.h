@@ -0,0 +1,39 @@
+#ifndef SURFACEPICKER_H
+#define SURFACEPICKER_H
+
+#include "debug/Stable.h"
+
+#include <QMatrix4x4>
+#include <QPointF>
+#include <QSize>
+#include <QVector3D>
+
+#include "model.h"
+#include "Bvh.h"
+#include "BvhBuilder.h"
+
+// Picks points on the model surface under the cursor.
+// Picking is available once the BVH built after setModel() is ready,
+// until then pick() finds nothing and the viewports fall back to plain navigation.
+class SurfacePicker
+{
+public:
+    SurfacePicker();
+    ~SurfacePicker();
+
+    // Starts building the BVH of the model, nullptr drops the current one.
+    // Must be called with nullptr before the current model is deleted.
+    void setModel(const Model* model);
+    bool isReady();
+    BvhBuilder* getBuilder();
+
+    // pos is in widget pixels, point is returned in model coordinates
+    bool pick(const QMatrix4x4& modelViewProjection, const QPointF& pos, const QSize& size, QVector3D& point);
+
+    static Ray screenRay(const QMatrix4x4& modelViewProjection, const QPointF& pos, const QSize& size);
+
+private:
+    BvhBuilder* m_builder;
+};
+
+#endif // SURFACEPICKER_H
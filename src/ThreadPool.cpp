@@ -0,0 +1,181 @@
+#include <algorithm>
+
+#include "debug/Stable.h"
+
+#include "ThreadPool.h"
+
+namespace
+{
+    // Set on workers and on a thread while it helps with its own parallelFor
+    thread_local bool insidePool = false;
+}
+
+ThreadPool::ThreadPool(int threadCount) :
+    m_job(nullptr),
+    m_remaining(0),
+    m_busy(0),
+    m_generation(0),
+    m_quit(false)
+{
+    if (threadCount < 0)
+        threadCount = std::max(QThread::idealThreadCount() - 1, 1);
+
+    for (int i = 0; i <= threadCount; ++i)
+        m_ranges.emplace_back(new WorkRange());
+
+    for (int i = 0; i < threadCount; ++i)
+        m_workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t : m_workers)
+        t.join();
+}
+
+ThreadPool* ThreadPool::instance()
+{
+    static ThreadPool pool;
+    return &pool;
+}
+
+int ThreadPool::getThreadCount()
+{
+    return (int)m_workers.size() + 1;
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& fn)
+{
+    if (count <= 0)
+        return;
+
+    if (count == 1 || insidePool || m_workers.empty())
+    {
+        for (int i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    std::lock_guard<std::mutex> submit(m_submitMutex);
+
+    // Give every participant an equal contiguous slice
+    int slots = (int)m_ranges.size();
+    for (int i = 0; i < slots; ++i)
+    {
+        std::lock_guard<std::mutex> lck(m_ranges[i]->mutex);
+        m_ranges[i]->begin = (int)((long long)count * i / slots);
+        m_ranges[i]->end = (int)((long long)count * (i + 1) / slots);
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_job = &fn;
+        m_remaining = count;
+        m_busy = (int)m_workers.size();
+        ++m_generation;
+    }
+
+    m_wake.notify_all();
+
+    insidePool = true;
+    runJobs(slots - 1);
+    insidePool = false;
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+    m_done.wait(lck, [this] { return m_busy == 0; });
+    m_job = nullptr;
+}
+
+bool ThreadPool::popJob(int slot, int& job)
+{
+    WorkRange& r = *m_ranges[slot];
+    std::lock_guard<std::mutex> lck(r.mutex);
+
+    if (r.begin >= r.end)
+        return false;
+
+    job = r.begin++;
+    return true;
+}
+
+bool ThreadPool::stealJobs(int slot)
+{
+    int slots = (int)m_ranges.size();
+
+    for (int i = 1; i < slots; ++i)
+    {
+        WorkRange& victim = *m_ranges[(slot + i) % slots];
+        int begin, end;
+
+        {
+            std::lock_guard<std::mutex> lck(victim.mutex);
+
+            int n = victim.end - victim.begin;
+            if (n <= 0)
+                continue;
+
+            // Take the back half, the victim keeps working from the front
+            begin = victim.end - (n + 1) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+
+        WorkRange& own = *m_ranges[slot];
+        std::lock_guard<std::mutex> lck(own.mutex);
+        own.begin = begin;
+        own.end = end;
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::runJobs(int slot)
+{
+    int job;
+
+    while (m_remaining > 0)
+    {
+        if (popJob(slot, job))
+        {
+            (*m_job)(job);
+            --m_remaining;
+        }
+        else if (!stealJobs(slot))
+            break;
+    }
+}
+
+void ThreadPool::workerLoop(int slot)
+{
+    insidePool = true;
+    unsigned generation = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+            m_wake.wait(lck, [&] { return m_quit || m_generation != generation; });
+
+            if (m_quit)
+                return;
+
+            generation = m_generation;
+        }
+
+        runJobs(slot);
+
+        {
+            std::lock_guard<std::mutex> lck(m_mutex);
+            if (--m_busy == 0)
+                m_done.notify_one();
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for data-parallel loops.
+// The calling thread takes part in the work, so a pool of N workers runs N + 1 jobs at once.
+// Each participant starts on its own slice of the index range and steals half of
+// another participant's remaining slice when it runs out, so uneven jobs stay balanced.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threadCount = -1);
+    ~ThreadPool();
+
+    static ThreadPool* instance();
+
+    int getThreadCount();
+
+    // Calls fn(i) for every i in [0, count) and returns when all calls are done.
+    // Nested calls from a worker run serially on that worker.
+    void parallelFor(int count, const std::function<void(int)>& fn);
+
+private:
+    struct WorkRange
+    {
+        std::mutex mutex;
+        int begin;
+        int end;
+    };
+
+    void workerLoop(int slot);
+    void runJobs(int slot);
+    bool popJob(int slot, int& job);
+    bool stealJobs(int slot);
+
+    std::vector<std::thread> m_workers;
+    std::vector<std::unique_ptr<WorkRange>> m_ranges; // One per worker plus the caller
+
+    std::mutex m_submitMutex; // One parallelFor at a time
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(int)>* m_job;
+    std::atomic<int> m_remaining;
+    int m_busy;
+    unsigned m_generation;
+    bool m_quit;
+};
+
+#endif // THREADPOOL_H
@@ -0,0 +1,273 @@
+#include <algorithm>
+#include <iostream>
+
+#include "debug/Stable.h"
+
+#include <QByteArray>
+#include <QThread>
+
+#include "TiffWriter.h"
+
+namespace
+{
+    enum TiffType
+    {
+        TIFF_SHORT = 3,
+        TIFF_LONG = 4,
+        TIFF_RATIONAL = 5
+    };
+
+    const int dotsPerInch = 300; // Print resolution stored in the file
+    const int compressionLevel = 6;
+
+    void put16(std::vector<unsigned char>& out, quint16 v)
+    {
+        out.push_back(v & 0xff);
+        out.push_back(v >> 8);
+    }
+
+    void put32(std::vector<unsigned char>& out, quint32 v)
+    {
+        put16(out, v & 0xffff);
+        put16(out, v >> 16);
+    }
+
+    // Values of up to 4 bytes are stored in the entry, others at an offset
+    void putEntry(std::vector<unsigned char>& out, quint16 tag, quint16 type, quint32 count, quint32 value)
+    {
+        put16(out, tag);
+        put16(out, type);
+        put32(out, count);
+        put32(out, value);
+    }
+}
+
+TiffWriter::TiffWriter(int width, int height, int threadCount) :
+    m_width(width),
+    m_height(height),
+    m_threadCount(threadCount > 0 ? threadCount : std::max(QThread::idealThreadCount() - 1, 1)),
+    m_rowsWritten(0),
+    m_stripCount((height + rowsPerStrip - 1) / rowsPerStrip),
+    m_stripOffsets(m_stripCount, 0),
+    m_stripSizes(m_stripCount, 0),
+    m_fileSize(0),
+    m_quit(false),
+    m_failed(false)
+{}
+
+TiffWriter::~TiffWriter()
+{
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t : m_workers)
+        t.join();
+}
+
+bool TiffWriter::open(QString fileName)
+{
+    m_out.open(fileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!m_out)
+    {
+        std::cerr << "Cannot write " << fileName.toStdString() << std::endl;
+        return false;
+    }
+
+    // Little endian, the directory offset is filled in by close()
+    std::vector<unsigned char> header = { 'I', 'I' };
+    put16(header, 42);
+    put32(header, 0);
+
+    m_out.write((const char*)header.data(), header.size());
+    m_fileSize = header.size();
+
+    for (int i = 0; i < m_threadCount; ++i)
+        m_workers.emplace_back(&TiffWriter::workerLoop, this);
+
+    return true;
+}
+
+bool TiffWriter::writeRows(const unsigned char* rows, int count)
+{
+    int rowBytes = m_width * 3;
+    count = std::min(count, m_height - m_rowsWritten);
+
+    for (int i = 0; i < count; ++i)
+    {
+        m_strip.insert(m_strip.end(), rows + i * rowBytes, rows + (i + 1) * rowBytes);
+        ++m_rowsWritten;
+
+        if (m_strip.size() == (size_t)rowsPerStrip * rowBytes || m_rowsWritten == m_height)
+            queueStrip();
+    }
+
+    return !m_failed;
+}
+
+void TiffWriter::queueStrip()
+{
+    int rowBytes = m_width * 3;
+    int stripRows = (int)(m_strip.size() / rowBytes);
+
+    Strip strip;
+    strip.index = (m_rowsWritten - stripRows) / rowsPerStrip;
+    strip.data.swap(m_strip);
+
+    {
+        // A couple of strips per worker keeps them busy without buffering the image
+        std::unique_lock<std::mutex> lck(m_mutex);
+        m_room.wait(lck, [this] { return (int)m_queue.size() < m_threadCount * 2; });
+        m_queue.push_back(std::move(strip));
+    }
+
+    m_wake.notify_one();
+}
+
+void TiffWriter::workerLoop()
+{
+    int rowBytes = m_width * 3;
+
+    for (;;)
+    {
+        Strip strip;
+
+        {
+            std::unique_lock<std::mutex> lck(m_mutex);
+            m_wake.wait(lck, [this] { return m_quit || !m_queue.empty(); });
+
+            if (m_queue.empty())
+                return;
+
+            strip = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        m_room.notify_one();
+
+        // Horizontal differencing (predictor 2), neighbouring pixels mostly differ little
+        for (size_t row = 0; row < strip.data.size(); row += rowBytes)
+            for (int i = rowBytes - 1; i >= 3; --i)
+                strip.data[row + i] -= strip.data[row + i - 3];
+
+        // qCompress() prefixes the zlib stream that TIFF deflate expects with the data size
+        QByteArray compressed = qCompress(strip.data.data(), (int)strip.data.size(), compressionLevel);
+        const char* data = compressed.constData() + 4;
+        quint32 size = compressed.size() - 4;
+
+        std::lock_guard<std::mutex> lck(m_mutex);
+
+        if (m_fileSize + size > 0xffffffffu)
+        {
+            if (!m_failed.exchange(true))
+                std::cerr << "TIFF file exceeds 4 GB" << std::endl;
+            continue;
+        }
+
+        m_out.write(data, size);
+        if (!m_out)
+            m_failed = true;
+
+        m_stripOffsets[strip.index] = (quint32)m_fileSize;
+        m_stripSizes[strip.index] = size;
+        m_fileSize += size;
+    }
+}
+
+bool TiffWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> lck(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (std::thread& t : m_workers)
+        t.join();
+    m_workers.clear();
+
+    if (m_rowsWritten != m_height || m_failed || !writeDirectory())
+    {
+        m_out.close();
+        return false;
+    }
+
+    m_out.close();
+    return !m_out.fail();
+}
+
+bool TiffWriter::writeDirectory()
+{
+    const int entryCount = 14;
+
+    // Word aligned
+    if (m_fileSize & 1)
+    {
+        m_out.put(0);
+        ++m_fileSize;
+    }
+
+    quint64 directory = m_fileSize;
+    quint64 extra = directory + 2 + entryCount * 12 + 4;
+    quint64 bitsOffset = extra;
+    quint64 xResolutionOffset = bitsOffset + 6;
+    quint64 yResolutionOffset = xResolutionOffset + 8;
+    quint64 offsetsOffset = yResolutionOffset + 8;
+    quint64 sizesOffset = offsetsOffset + m_stripCount * 4;
+    quint64 end = sizesOffset + m_stripCount * 4;
+
+    if (end > 0xffffffffu)
+    {
+        std::cerr << "TIFF file exceeds 4 GB" << std::endl;
+        return false;
+    }
+
+    // A single strip is stored in the entries themselves
+    bool single = m_stripCount == 1;
+
+    // Sorted by tag
+    std::vector<unsigned char> out;
+    put16(out, entryCount);
+    putEntry(out, 256, TIFF_LONG, 1, m_width); // ImageWidth
+    putEntry(out, 257, TIFF_LONG, 1, m_height); // ImageLength
+    putEntry(out, 258, TIFF_SHORT, 3, (quint32)bitsOffset); // BitsPerSample
+    putEntry(out, 259, TIFF_SHORT, 1, 8); // Compression, deflate
+    putEntry(out, 262, TIFF_SHORT, 1, 2); // PhotometricInterpretation, RGB
+    putEntry(out, 273, TIFF_LONG, m_stripCount, single ? m_stripOffsets[0] : (quint32)offsetsOffset); // StripOffsets
+    putEntry(out, 277, TIFF_SHORT, 1, 3); // SamplesPerPixel
+    putEntry(out, 278, TIFF_LONG, 1, rowsPerStrip); // RowsPerStrip
+    putEntry(out, 279, TIFF_LONG, m_stripCount, single ? m_stripSizes[0] : (quint32)sizesOffset); // StripByteCounts
+    putEntry(out, 282, TIFF_RATIONAL, 1, (quint32)xResolutionOffset); // XResolution
+    putEntry(out, 283, TIFF_RATIONAL, 1, (quint32)yResolutionOffset); // YResolution
+    putEntry(out, 284, TIFF_SHORT, 1, 1); // PlanarConfiguration, interleaved
+    putEntry(out, 296, TIFF_SHORT, 1, 2); // ResolutionUnit, inch
+    putEntry(out, 317, TIFF_SHORT, 1, 2); // Predictor, horizontal differencing
+    put32(out, 0); // No further images
+
+    put16(out, 8);
+    put16(out, 8);
+    put16(out, 8);
+    put32(out, dotsPerInch);
+    put32(out, 1);
+    put32(out, dotsPerInch);
+    put32(out, 1);
+
+    for (quint32 offset : m_stripOffsets)
+        put32(out, offset);
+    for (quint32 size : m_stripSizes)
+        put32(out, size);
+
+    m_out.write((const char*)out.data(), out.size());
+
+    // Point the header at the directory
+    std::vector<unsigned char> offset;
+    put32(offset, (quint32)directory);
+    m_out.seekp(4);
+    m_out.write((const char*)offset.data(), offset.size());
+
+    return !m_out.fail();
+}
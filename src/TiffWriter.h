@@ -0,0 +1,68 @@
+#ifndef TIFFWRITER_H
+#define TIFFWRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "debug/Stable.h"
+
+#include <QString>
+
+// Writes an RGB TIFF file row by row without holding the whole image.
+// Rows are gathered into strips which are deflate compressed on worker threads
+// and appended to the file in whatever order they finish, the strip table at the
+// end of the file puts them back in order. Classic TIFF, so files stay below 4 GB.
+class TiffWriter
+{
+public:
+    TiffWriter(int width, int height, int threadCount = -1);
+    ~TiffWriter();
+
+    bool open(QString fileName);
+
+    // Top row first, width * 3 bytes per row. Blocks while the workers are behind.
+    bool writeRows(const unsigned char* rows, int count);
+
+    // Needs every row to be written
+    bool close();
+
+private:
+    static const int rowsPerStrip = 64;
+
+    struct Strip
+    {
+        int index;
+        std::vector<unsigned char> data;
+    };
+
+    void workerLoop();
+    void queueStrip();
+    bool writeDirectory();
+
+    int m_width;
+    int m_height;
+    int m_threadCount;
+    int m_rowsWritten;
+    int m_stripCount;
+
+    std::ofstream m_out;
+    std::vector<unsigned char> m_strip; // Being filled by writeRows()
+    std::vector<quint32> m_stripOffsets;
+    std::vector<quint32> m_stripSizes;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex; // Guards the queue and the file
+    std::condition_variable m_wake;
+    std::condition_variable m_room;
+    std::deque<Strip> m_queue;
+    quint64 m_fileSize;
+    bool m_quit;
+    std::atomic<bool> m_failed;
+};
+
+#endif // TIFFWRITER_H
@@ -7,29 +7,40 @@
 
 #include "VideoRecorder.h"
 #include "MainWindow.h"
+#include "Profiler.h"
 
-VideoRecorder::VideoRecorder(QObject* parent, Renderer* targetWidget_) :
+VideoRecorder::VideoRecorder(QObject* parent, RenderView* target) :
+	QThread(parent),
     m_currentStatus(VIDEO_STATUS_STOP),
+    m_queuePolicy(RECORD_QUEUE_DROP_OLDEST),
     m_fps(0),
-    m_lastSecondFrameCount(0),
-    m_frameReady(false),
-    m_lastFrameTime(0),
-    m_lastFpsTime(0),
     m_videoLength(0),
-	QThread(parent),
-    m_targetWidget(targetWidget_),
-    m_videoWriter(new VideoWriter(1920, 1080, 25, 5000000))
+    m_target(target),
+    m_videoWriter(new VideoWriter(1920, 1080, 25, 5000000)),
+    m_droppedFrames(0),
+    m_statusGeneration(0),
+    m_recording(0),
+    m_openRecording(0),
+    m_stopped(true),
+    m_closing(false),
+    m_muxQuit(false),
+    m_lastGeneration(0),
+    m_lastCaptureTime(0),
+    m_lastSecondFrameCount(0),
+    m_lastFpsTime(0)
 {
 	VideoWriter::initAv();
 
-	connect(targetWidget_, SIGNAL(recordFrame()), this, SLOT(recordFrame()));
-	connect(this, SIGNAL(updateFrameBuffer()), targetWidget_, SLOT(updateFrameBuffer()));
+    m_pipelineClock.start();
+    m_target->setFrameSink(this);
 }
 
 VideoRecorder::~VideoRecorder()
 {
-    if (m_videoWriter->isOpen())
-        m_videoWriter->close();
+    // Returns once no frame is being converted anymore
+    m_target->setFrameSink(nullptr);
+
+    closeWriter();
 
     delete m_videoWriter;
     m_videoWriter = nullptr;
@@ -55,40 +66,46 @@ VideoRecorder::~VideoRecorder()
     return m_videoWriter->setBitRate(bitRate);
  }
 
-void VideoRecorder::startRecord()
+void VideoRecorder::setQueuePolicy(RecordQueuePolicy policy)
+{
+    m_queuePolicy = policy;
+}
+
+RecordQueueStats VideoRecorder::getQueueStats()
 {
-    if (m_currentStatus == VIDEO_STATUS_STOP)
-	{
-        m_lastFrameTime = 0;
-        m_lastFpsTime = m_lastFrameTime;
-        m_videoLength = 0;
+    RecordQueueStats stats;
 
-        m_frameTimer.start();
-	}
-    else if (m_currentStatus == VIDEO_STATUS_PAUSE)
-	{
-        m_lastFrameTime += m_frameTimer.elapsed() - m_pauseTime;
-        m_lastFpsTime += m_frameTimer.elapsed() - m_pauseTime;
-	}
+    {
+        QMutexLocker lck(&m_queueMutex);
+        stats.framesQueued = (int)m_queue.size();
+        stats.droppedFrames = m_droppedFrames;
+    }
 
-    m_lastSecondFrameCount = 0;
-    m_currentStatus = VIDEO_STATUS_RECORD;
+    QMutexLocker lck(&m_packetMutex);
+    stats.packetsQueued = (int)m_packets.size();
+    return stats;
+}
 
-    m_frameReady = false;
-	updateFrameBuffer();
+void VideoRecorder::startRecord()
+{
+    setStatus(VIDEO_STATUS_RECORD);
+
+    // Views rendering on demand keep rendering, each frame is captured
+    m_target->setCaptureRate(m_videoWriter->getFps());
 }
 
 void VideoRecorder::pauseRecord()
 {
-    m_currentStatus = VIDEO_STATUS_PAUSE;
-    m_pauseTime = m_frameTimer.elapsed();
+    setStatus(VIDEO_STATUS_PAUSE);
     m_fps = 0;
+    m_target->setCaptureRate(0);
 }
 
 void VideoRecorder::stopRecord()
 {
-    m_currentStatus = VIDEO_STATUS_STOP;
+    setStatus(VIDEO_STATUS_STOP);
     m_fps = 0;
+    m_target->setCaptureRate(0);
 }
 
 bool VideoRecorder::isRecording()
@@ -98,71 +115,361 @@ bool VideoRecorder::isRecording()
 
 void VideoRecorder::terminate()
 {
-    m_currentStatus = VIDEO_STATUS_TERMINATE;
+    setStatus(VIDEO_STATUS_TERMINATE);
+}
+
+void VideoRecorder::setStatus(Status status)
+{
+    QMutexLocker lck(&m_queueMutex);
+
+    if (status == VIDEO_STATUS_STOP)
+        m_stopped = true;
+    else if (status == VIDEO_STATUS_RECORD && m_stopped)
+    {
+        ++m_recording;
+        m_stopped = false;
+    }
+
+    m_currentStatus = status;
+    ++m_statusGeneration;
+
+    // A capture waiting for a frame gives up
+    m_frameQueued.wakeAll();
+    m_frameFreed.wakeAll();
 }
 
 void VideoRecorder::run()
 {
-	qint64 curTime;
-    qint64 frameLength;
-    qint64 frameDelay;
+    int handledGeneration = 0;
 
-    for (; m_currentStatus != VIDEO_STATUS_TERMINATE;)
+    for (;;)
     {
-        switch (m_currentStatus)
+        QueuedFrame frame = { nullptr, 0, 0, 0 };
+        Status status;
+        int recording;
+        int openRecording;
+        bool stopped;
+        bool drained;
+
         {
-        case VIDEO_STATUS_RECORD:
-            if (!m_videoWriter->isOpen())
-            {
-                m_videoWriter->open("video");
-                frameDelay = 1000 / m_videoWriter->getFps();
-            }
+            QMutexLocker lck(&m_queueMutex);
 
-            curTime = m_frameTimer.elapsed();
+            // Asleep until there is something to do, no CPU while idle or waiting for frames
+            while (m_queue.empty() && m_statusGeneration == handledGeneration)
+                m_frameQueued.wait(&m_queueMutex);
 
-            if(m_frameReady && curTime >= m_lastFrameTime + frameDelay || m_videoLength == 0)
+            status = m_currentStatus;
+            recording = m_recording;
+            openRecording = m_openRecording;
+            stopped = m_stopped;
+            handledGeneration = m_statusGeneration;
+
+            if (!m_queue.empty())
             {
-				updateFrameBuffer();
-                {
-                    frameLength = curTime - m_lastFrameTime;
-                    if (frameLength < 0)
-                        frameLength = 1000 / m_videoWriter->getFps();
-
-                    m_videoLength += frameLength;
-
-                    QImage img = m_targetWidget->getFrameBuffer();
-
-                    // Timestamp frame
-                    /*QPainter p(&img);
-                    p.setPen(QPen(Qt::white));
-                    p.setFont(QFont("Times", 14, QFont::Bold));
-                    p.drawText(QPoint(40, 40), QDateTime::fromMSecsSinceEpoch(m_videoLength).toUTC().toString("hh:mm:ss.zzz"));
-                    p.end();*/
-
-                    m_videoWriter->writeVideoFrame(img, frameLength);
-                    qDebug() << "VR\t" << frameLength << " ms\n";
-                }
-                m_lastFrameTime = curTime;
-
-                if (curTime >= m_lastFpsTime + 1000)
-				{
-                    m_fps = m_lastSecondFrameCount;
-                    m_lastSecondFrameCount = 0;
-                    m_lastFpsTime = curTime;
-				}
-                else
-                    ++m_lastSecondFrameCount;
+                frame = m_queue.front();
+                m_queue.pop_front();
             }
+
+            drained = m_queue.empty();
+        }
+
+        if (status == VIDEO_STATUS_TERMINATE)
             break;
 
-        case VIDEO_STATUS_STOP:
-            if (m_videoWriter->isOpen())
-                m_videoWriter->close();
+        if (frame.frame)
+        {
+            // Frames queued before a pause or stop are still encoded
+            encodeFrame(frame);
+
+            QMutexLocker lck(&m_queueMutex);
+            m_freeFrames.push_back(frame.frame);
+            m_frameFreed.wakeOne();
         }
-	}
+
+        // Closed once the last frame of a stopped recording is encoded, also when a new one has started since.
+        // Captures for the new one are dropped until then.
+        if (m_videoWriter->isOpen() && drained && (stopped || recording != openRecording))
+            closeWriter();
+
+        if (status == VIDEO_STATUS_RECORD && !m_videoWriter->isOpen())
+            openWriter(recording);
+    }
+
+    closeWriter();
+}
+
+void VideoRecorder::encodeFrame(const QueuedFrame& frame)
+{
+    // Between the render times, however late the frames got here.
+    // A frame interval across pauses, none before the first frame.
+    if (frame.generation != m_lastGeneration)
+        m_lastCaptureTime = 0; // Paused in between
+
+    m_lastGeneration = frame.generation;
+
+    qint64 frameLength = frame.time - m_lastCaptureTime;
+    if (!m_lastCaptureTime)
+        frameLength = m_videoLength ? 1000 / m_videoWriter->getFps() : 0;
+    else if (frameLength <= 0)
+        frameLength = 1;
+
+    m_lastCaptureTime = frame.time;
+    m_videoLength += frameLength;
+
+    // Converted already, encoded once at its time and muxed on the mux thread
+    m_encodedPackets.clear();
+    m_videoWriter->encodeVideoFrame(frame.frame, m_videoLength, m_encodedPackets);
+    queuePackets(m_encodedPackets);
+
+    Profiler::instance()->addSample("Encode latency", PROFILE_CLOCK_CPU, (m_pipelineClock.nsecsElapsed() - frame.queuedAt) / 1e6);
+
+    qint64 curTime = m_frameTimer.elapsed();
+    if (curTime >= m_lastFpsTime + 1000)
+    {
+        m_fps = m_lastSecondFrameCount;
+        m_lastSecondFrameCount = 0;
+        m_lastFpsTime = curTime;
+    }
+    else
+        ++m_lastSecondFrameCount;
+}
+
+void VideoRecorder::queuePackets(const std::vector<AVPacket*>& packets)
+{
+    QMutexLocker lck(&m_packetMutex);
+
+    for (AVPacket* packet : packets)
+    {
+        while ((int)m_packets.size() >= packetQueueLength)
+            m_packetWritten.wait(&m_packetMutex);
+
+        QueuedPacket queued = { packet, m_pipelineClock.nsecsElapsed() };
+        m_packets.push_back(queued);
+        m_packetQueued.wakeOne();
+    }
 }
 
-void VideoRecorder::recordFrame()
+void VideoRecorder::muxLoop()
 {
-    m_frameReady = true;
+    for (;;)
+    {
+        QueuedPacket packet;
+
+        {
+            QMutexLocker lck(&m_packetMutex);
+
+            while (m_packets.empty() && !m_muxQuit)
+                m_packetQueued.wait(&m_packetMutex);
+
+            // Written to the end before stopping
+            if (m_packets.empty())
+                return;
+
+            packet = m_packets.front();
+            m_packets.pop_front();
+            m_packetWritten.wakeOne();
+        }
+
+        m_videoWriter->writePacket(packet.packet);
+
+        Profiler::instance()->addSample("Mux latency", PROFILE_CLOCK_CPU, (m_pipelineClock.nsecsElapsed() - packet.queuedAt) / 1e6);
+    }
+}
+
+void VideoRecorder::stopMuxer()
+{
+    if (!m_muxThread.joinable())
+        return;
+
+    {
+        QMutexLocker lck(&m_packetMutex);
+        m_muxQuit = true;
+        m_packetQueued.wakeAll();
+    }
+
+    m_muxThread.join();
+    m_muxQuit = false;
+}
+
+void VideoRecorder::openWriter(int recording)
+{
+    QMutexLocker lck(&m_writerMutex);
+
+    // Matroska keeps the frame times, the frame rate varies with rendering
+    if (!m_videoWriter->open("video.mkv"))
+        return;
+
+    // Encoded and muxed on different threads
+    if (!m_videoWriter->canEncodeToPackets())
+    {
+        qDebug() << "VideoRecorder: raw picture formats can't be recorded";
+        m_videoWriter->close();
+        return;
+    }
+
+    m_videoLength = 0;
+    m_lastCaptureTime = 0;
+    m_lastSecondFrameCount = 0;
+    m_lastFpsTime = 0;
+    m_frameTimer.start();
+
+    // One more frame being converted and one being encoded
+    for (int i = 0; i < queueLength + 2; ++i)
+    {
+        AVFrame* frame = m_videoWriter->createVideoFrame();
+        if (frame)
+            m_pool.push_back(frame);
+    }
+
+    {
+        QMutexLocker queueLck(&m_queueMutex);
+        m_freeFrames = m_pool;
+        m_droppedFrames = 0;
+        m_openRecording = recording;
+    }
+
+    m_muxThread = std::thread(&VideoRecorder::muxLoop, this);
+}
+
+void VideoRecorder::closeWriter()
+{
+    // A capture waiting for a frame holds m_writerMutex
+    {
+        QMutexLocker queueLck(&m_queueMutex);
+        m_closing = true;
+        m_frameFreed.wakeAll();
+    }
+
+    QMutexLocker lck(&m_writerMutex);
+
+    {
+        QMutexLocker queueLck(&m_queueMutex);
+        m_closing = false;
+        m_openRecording = 0;
+
+        if (m_droppedFrames)
+            qDebug() << "VideoRecorder: dropped" << m_droppedFrames << "frames";
+        m_droppedFrames = 0;
+
+        m_queue.clear();
+        m_freeFrames.clear();
+    }
+
+    for (AVFrame* frame : m_pool)
+        m_videoWriter->destroyVideoFrame(frame);
+    m_pool.clear();
+
+    // The encoder is drained by close(), with the muxer stopped
+    stopMuxer();
+
+    if (m_videoWriter->isOpen())
+        m_videoWriter->close();
+}
+
+bool VideoRecorder::acquireFrame(QueuedFrame& queued)
+{
+    QMutexLocker lck(&m_queueMutex);
+
+    int generation = m_statusGeneration;
+    AVFrame* frame = nullptr;
+
+    while (!frame)
+    {
+        // Also gives up after waiting through a status change or for the writer to close
+        if (m_currentStatus != VIDEO_STATUS_RECORD || m_statusGeneration != generation || m_closing || m_recording != m_openRecording || m_pool.empty())
+            return false;
+
+        if (!m_freeFrames.empty())
+        {
+            frame = m_freeFrames.back();
+            m_freeFrames.pop_back();
+            break;
+        }
+
+        switch (m_queuePolicy)
+        {
+        case RECORD_QUEUE_DROP_OLDEST:
+            if (m_queue.empty())
+                return false;
+
+            frame = m_queue.front().frame;
+            m_queue.pop_front();
+            ++m_droppedFrames;
+            break;
+
+        case RECORD_QUEUE_DROP_NEWEST:
+            ++m_droppedFrames;
+            return false;
+
+        case RECORD_QUEUE_BLOCK:
+            m_frameFreed.wait(&m_queueMutex);
+            break;
+        }
+    }
+
+    queued.frame = frame;
+    queued.generation = generation;
+    return true;
+}
+
+void VideoRecorder::queueFrame(QueuedFrame& queued, qint64 time)
+{
+    QMutexLocker lck(&m_queueMutex);
+
+    queued.time = time;
+    queued.queuedAt = m_pipelineClock.nsecsElapsed();
+    m_queue.push_back(queued);
+    m_frameQueued.wakeOne();
+}
+
+void VideoRecorder::consumeFrame(const uchar* pixels, int width, int height, int stride, qint64 time)
+{
+    QMutexLocker lck(&m_writerMutex);
+
+    QueuedFrame frame;
+    if (!acquireFrame(frame))
+        return;
+
+    bool ok;
+    {
+        ProfileScope scope("Convert");
+        ok = m_videoWriter->convertFrame(pixels, width, height, stride, frame.frame);
+    }
+
+    if (ok)
+        queueFrame(frame, time);
+    else
+    {
+        QMutexLocker queueLck(&m_queueMutex);
+        m_freeFrames.push_back(frame.frame);
+    }
+}
+
+QSize VideoRecorder::getYuvSize()
+{
+    // The size is fixed, so the frames can be scaled before readback
+    return QSize(m_videoWriter->getWidth(), m_videoWriter->getHeight());
+}
+
+void VideoRecorder::consumeYuvFrame(const uchar* const planes[3], const int strides[3], int width, int height, qint64 time)
+{
+    QMutexLocker lck(&m_writerMutex);
+
+    QueuedFrame frame;
+    if (!acquireFrame(frame))
+        return;
+
+    bool ok;
+    {
+        ProfileScope scope("Convert");
+        ok = m_videoWriter->convertFrame(planes, strides, width, height, frame.frame);
+    }
+
+    if (ok)
+        queueFrame(frame, time);
+    else
+    {
+        QMutexLocker queueLck(&m_queueMutex);
+        m_freeFrames.push_back(frame.frame);
+    }
 }
@@ -1,15 +1,21 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
 #include "debug/Stable.h"
 
 #include <QThread>
 #include <QTime>
 #include <QElapsedTimer>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QOpenGLWidget>
 
 #include "VideoWriter.h"
-#include "Renderer.h"
+#include "RenderView.h"
+#include "RingBuffer.h"
 
 enum Status
 {
@@ -19,12 +25,37 @@ enum Status
     VIDEO_STATUS_TERMINATE // Terminate thread
 };
 
-class VideoRecorder : public QThread
+// What a capture does when every queued frame still waits for the encoder
+enum RecordQueuePolicy
+{
+    RECORD_QUEUE_DROP_OLDEST, // The oldest queued frame is replaced, the video skips ahead
+    RECORD_QUEUE_DROP_NEWEST, // The capture is dropped, the queued frames are kept
+    RECORD_QUEUE_BLOCK // The capture waits for the encoder, rendering slows down to its pace
+};
+
+// Frames waiting between the stages of the recording pipeline
+struct RecordQueueStats
+{
+    int framesQueued; // Converted, waiting for the encoder
+    int packetsQueued; // Encoded, waiting for the muxer
+    int droppedFrames; // Since the writer was opened
+};
+
+// Recording is a pipeline of three stages connected by bounded queues, so that
+// throughput is set by the slowest stage rather than by all of them in turn:
+//  - consumeFrame() converts captures to the video format on the capturing thread and the
+//    thread pool, straight from the memory they were read back into,
+//  - this thread encodes them,
+//  - a mux thread, running while the writer is open, writes the packets to the file.
+// The frame queue is bounded by a pool of frames allocated while the writer is open, a full
+// packet queue holds the encoder back. The threads sleep on their queues. Time spent in
+// and waiting for each stage goes to the Profiler, the queue depths to getQueueStats().
+class VideoRecorder : public QThread, public FrameSink
 {
 	Q_OBJECT
 
 public:
-	VideoRecorder(QObject* parent, Renderer* targetWidget_);
+	VideoRecorder(QObject* parent, RenderView* target);
 	~VideoRecorder();
 
 	void startRecord();
@@ -39,28 +70,81 @@ public:
     int getBitRate();
 
     bool setBitRate(int);
+    void setQueuePolicy(RecordQueuePolicy);
 
-private:
-    void run() override;
+    RecordQueueStats getQueueStats();
 
-    Status m_currentStatus;
-    int m_fps;
-    int m_lastSecondFrameCount;
+    void consumeFrame(const uchar* pixels, int width, int height, int stride, qint64 time) override;
+    QSize getYuvSize() override;
+    void consumeYuvFrame(const uchar* const planes[3], const int strides[3], int width, int height, qint64 time) override;
 
-    bool m_frameReady;
+private:
+    static const int queueLength = 4; // Converted frames waiting for the encoder, the pool has 2 more
+    static const int packetQueueLength = 16; // Encoded packets waiting for the muxer
+
+    struct QueuedFrame
+    {
+        AVFrame* frame;
+        qint64 time; // Render time, ms since epoch
+        qint64 queuedAt; // ns on m_pipelineClock
+        int generation; // m_statusGeneration when it was captured
+    };
+
+    struct QueuedPacket
+    {
+        AVPacket* packet;
+        qint64 queuedAt; // ns on m_pipelineClock
+    };
 
-    Renderer* m_targetWidget;
+    void run() override;
+    void setStatus(Status);
+    void openWriter(int recording);
+    void closeWriter();
+    void encodeFrame(const QueuedFrame& frame);
+    void queuePackets(const std::vector<AVPacket*>& packets); // Waits for room
+    void muxLoop();
+    void stopMuxer(); // Once every queued packet is written
+
+    // Capturing thread, with m_writerMutex held
+    bool acquireFrame(QueuedFrame& frame); // False to drop the capture
+    void queueFrame(QueuedFrame& frame, qint64 time);
+
+    std::atomic<Status> m_currentStatus;
+    std::atomic<RecordQueuePolicy> m_queuePolicy;
+    std::atomic<int> m_fps;
+    std::atomic<qint64> m_videoLength; // ms
+
+    RenderView* m_target;
     VideoWriter* m_videoWriter;
-
-    qint64 m_lastFrameTime;
+    QMutex m_writerMutex; // Held by consumeFrame() and while the writer opens or closes
+    std::vector<AVFrame*> m_pool; // Every frame, queued or not, empty while the writer is closed
+    QElapsedTimer m_pipelineClock; // Stage latencies, read from every thread
+
+    QMutex m_queueMutex; // Guards the values below
+    QWaitCondition m_frameQueued; // Or the status changed
+    QWaitCondition m_frameFreed; // Or the status changed or the writer is closing
+    RingBuffer<QueuedFrame, 8> m_queue; // Room for the whole pool
+    std::vector<AVFrame*> m_freeFrames;
+    int m_droppedFrames;
+    // Status changes are counted, run() sees every one however quickly they follow each other
+    int m_statusGeneration;
+    int m_recording; // Incremented by a record after a stop, each recording gets its own file
+    int m_openRecording; // The writer is open for, 0 for none. Captures for another one are dropped.
+    bool m_stopped; // Since the last record
+    bool m_closing; // A waiting capture gives up so that the writer can close
+
+    std::thread m_muxThread;
+    QMutex m_packetMutex; // Guards the values below
+    QWaitCondition m_packetQueued; // Or the muxer is stopped
+    QWaitCondition m_packetWritten;
+    RingBuffer<QueuedPacket, packetQueueLength> m_packets;
+    bool m_muxQuit;
+
+    // run() only
+    int m_lastGeneration; // Of the last encoded frame
+    qint64 m_lastCaptureTime; // Render time of the last encoded frame, 0 for none
+    int m_lastSecondFrameCount;
     qint64 m_lastFpsTime;
-    qint64 m_pauseTime;
-    qint64 m_videoLength;
     QElapsedTimer m_frameTimer;
-
-signals:
-	void updateFrameBuffer();
-
-public slots:
-    void recordFrame();
+    std::vector<AVPacket*> m_encodedPackets; // Kept to reuse its storage
 };
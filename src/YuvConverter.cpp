@@ -0,0 +1,106 @@
+#include "debug/Stable.h"
+
+#include <QDebug>
+
+#include "YuvConverter.h"
+#include "ProgramCache.h"
+
+YuvConverter::YuvConverter() :
+    m_fbo(nullptr),
+    m_initialized(false)
+{}
+
+YuvConverter::~YuvConverter()
+{
+    // The GL objects are gone with the context if destroy() wasn't called
+    delete m_fbo;
+}
+
+bool YuvConverter::initialize()
+{
+    initializeOpenGLFunctions();
+
+    ProgramCache cache;
+    if (!cache.build(m_program, ":/rsc/yuvvshader.glsl", ":/rsc/yuvfshader.glsl"))
+        return false;
+
+    // The frame is always on texture unit 0
+    m_program.bind();
+    m_program.setUniformValue("frame", 0);
+    m_program.release();
+
+    m_initialized = m_vertexArray.create();
+    return m_initialized;
+}
+
+void YuvConverter::destroy()
+{
+    delete m_fbo;
+    m_fbo = nullptr;
+
+    m_vertexArray.destroy();
+    m_program.removeAllShaders();
+    m_initialized = false;
+}
+
+bool YuvConverter::convert(GLuint texture, const QVector2D& texCoordScale, const QSize& size)
+{
+    if (!m_initialized || size.isEmpty() || size.width() % 2 || size.height() % 2)
+        return false;
+
+    QSize planesSize(size.width(), size.height() * 3 / 2);
+
+    if (!m_fbo || m_fbo->size() != planesSize)
+    {
+        delete m_fbo;
+        m_fbo = new QOpenGLFramebufferObject(planesSize, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, GL_R8);
+
+        if (!m_fbo->isValid())
+        {
+            qDebug() << "YuvConverter: cannot create" << planesSize << "framebuffer";
+            delete m_fbo;
+            m_fbo = nullptr;
+            return false;
+        }
+    }
+
+    m_fbo->bind();
+    glViewport(0, 0, planesSize.width(), planesSize.height());
+
+    // The render thread's scene passes depend on it
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    glDisable(GL_DEPTH_TEST);
+
+    m_program.bind();
+    m_program.setUniformValue("texCoordScale", texCoordScale);
+    m_program.setUniformValue("size", QVector2D(size.width(), size.height()));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    m_vertexArray.bind();
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    m_vertexArray.release();
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_program.release();
+
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+
+    return true;
+}
+
+void YuvConverter::getPlanes(const uchar* data, const QSize& size, const uchar* planes[3], int strides[3])
+{
+    // Chroma rows are as long as luma rows, each holds a row of both planes
+    int w = size.width();
+
+    planes[0] = data;
+    planes[1] = data + w * size.height();
+    planes[2] = planes[1] + w / 2;
+
+    strides[0] = w;
+    strides[1] = w;
+    strides[2] = w;
+}
@@ -0,0 +1,40 @@
+#ifndef YUVCONVERTER_H
+#define YUVCONVERTER_H
+
+#include "debug/Stable.h"
+
+#include <QSize>
+#include <QVector2D>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLFramebufferObject>
+
+// Converts a frame texture to YUV 4:2:0 at the video size in a shader pass, so that
+// only the planes are read back. They are stacked in one single channel framebuffer
+// of width x height * 3 / 2: the Y plane, then rows of U on the left and V on the right.
+// Read back as is it holds the frame top row first. Needs the context to be current.
+class YuvConverter : protected QOpenGLExtraFunctions
+{
+public:
+    YuvConverter();
+    ~YuvConverter();
+
+    bool initialize();
+    void destroy(); // Releases the GL objects, with the context current
+
+    // Scales the lower left texCoordScale part of texture to size, which has to be even.
+    // The planes framebuffer is left bound for the readback.
+    bool convert(GLuint texture, const QVector2D& texCoordScale, const QSize& size);
+
+    // Planes within the read back framebuffer of a frame of the given size
+    static void getPlanes(const uchar* data, const QSize& size, const uchar* planes[3], int strides[3]);
+
+private:
+    QOpenGLShaderProgram m_program;
+    QOpenGLVertexArrayObject m_vertexArray; // Empty, the quad comes from the vertex IDs
+    QOpenGLFramebufferObject* m_fbo;
+    bool m_initialized;
+};
+
+#endif // YUVCONVERTER_H
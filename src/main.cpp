@@ -1,19 +1,54 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
 #include "debug/Stable.h"
 
 #include <QApplication>
+#include <QFileInfo>
+#include <QCommandLineParser>
 #include <QLabel>
 #include <QSurfaceFormat>
 
 #include "mainwindow.h"
 #include "renderer.h"
+#include "HeadlessRecorder.h"
+#include "Benchmark.h"
+#include "ConversionBenchmark.h"
+#include "OffscreenRenderer.h"
+#include "CameraPath.h"
+#include "ChunkBuilder.h"
+#include "VideoWriter.h"
+#include "Profiler.h"
+
+// Some attributes must be set before QApplication parses the arguments
+static bool hasArgument(int argc, char *argv[], const char* name)
+{
+    for (int i = 1; i < argc; ++i)
+        if (!strcmp(argv[i], name))
+            return true;
+
+    return false;
+}
 
 int main(int argc, char *argv[])
 {
+    // Starts the clock for the time to first frame
+    Profiler::instance();
+
     installMemoryLeaksFilter();
     installCrashHandler();
 
+    if (hasArgument(argc, argv, "--software-gl"))
+    {
+        // Mesa llvmpipe: opengl32sw.dll on Windows, LIBGL_ALWAYS_SOFTWARE elsewhere
+        QCoreApplication::setAttribute(Qt::AA_UseSoftwareOpenGL);
+        qputenv("LIBGL_ALWAYS_SOFTWARE", "1");
+    }
+
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts, true);
+
     QApplication app(argc, argv);
-    app.setAttribute(Qt::AA_ShareOpenGLContexts ,true);
 
     QSurfaceFormat format;
     format.setDepthBufferSize(24);
@@ -25,14 +60,204 @@ int main(int argc, char *argv[])
     qRegisterMetaType<std::vector<Vertex>>("std::vector<Vertex>");
     qRegisterMetaType<std::vector<GLuint>>("std::vector<GLuint>");
 
-#ifndef QT_NO_OPENGL
-    MainWindow window;
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Model viewer. With --output renders a video, with --poster a still and with --benchmark "
+        "times a camera path without opening a window.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("model", "Model to render with --output, --poster or --benchmark or to preprocess with --build-chunks.");
+
+    QCommandLineOption rendererOption("renderer", "Viewport renderer: opengl or software.", "renderer", "opengl");
+    QCommandLineOption softwareGlOption("software-gl", "Use the Mesa software OpenGL implementation.");
+    QCommandLineOption outputOption(QStringList() << "o" << "output", "Render the model offscreen into a video file.", "file");
+    QCommandLineOption posterOption("poster", "Render the model offscreen into a TIFF file of any size, in tiles.", "file");
+    QCommandLineOption benchmarkOption("benchmark", "Play the camera path at a fixed timestep and write per-frame timings to a JSON file.", "file");
+    QCommandLineOption conversionBenchmarkOption("conversion-benchmark", "Time the video color conversion of 1080p and 4K frames and a 1080p recording, and write the results to a JSON file.", "file");
+    QCommandLineOption warmupOption("warmup", "Frames rendered before the benchmark starts timing.", "frames", "10");
+    QCommandLineOption cameraPathOption("camera-path", "JSON camera path, a turntable when omitted. Posters use its first key.", "file");
+    QCommandLineOption sizeOption("size", "Output resolution.", "WxH", "1920x1080");
+    QCommandLineOption fpsOption("fps", "Output frame rate.", "fps", "25");
+    QCommandLineOption codecOption("codec", "Encoder name, the container default when omitted.", "codec");
+    QCommandLineOption bitRateOption("bitrate", "Output bit rate.", "bps", "5000000");
+    QCommandLineOption durationOption("duration", "Video length in seconds, the camera path length when omitted.", "seconds", "0");
+    QCommandLineOption occlusionCullingOption("occlusion-culling", "Enable occlusion culling.");
+    QCommandLineOption buildChunksOption("build-chunks", "Split the model into a .chunks file for out-of-core viewing.");
+
+    parser.addOption(rendererOption);
+    parser.addOption(softwareGlOption);
+    parser.addOption(outputOption);
+    parser.addOption(posterOption);
+    parser.addOption(benchmarkOption);
+    parser.addOption(conversionBenchmarkOption);
+    parser.addOption(warmupOption);
+    parser.addOption(cameraPathOption);
+    parser.addOption(sizeOption);
+    parser.addOption(fpsOption);
+    parser.addOption(codecOption);
+    parser.addOption(bitRateOption);
+    parser.addOption(durationOption);
+    parser.addOption(occlusionCullingOption);
+    parser.addOption(buildChunksOption);
+    parser.process(app);
+
+    if (parser.isSet(buildChunksOption))
+    {
+        if (parser.positionalArguments().size() != 1)
+        {
+            qWarning() << "Exactly one model file is needed with --build-chunks";
+            return 1;
+        }
+
+        QFileInfo model(parser.positionalArguments()[0]);
+        ChunkBuilder builder(model.filePath(), model.path() + "/" + model.completeBaseName() + ".chunks");
+        builder.start();
+
+        while (!builder.wait(500))
+            std::cout << "\r" << builder.getProgress() * 100 / builder.getMaxProgress() << "%" << std::flush;
+
+        std::cout << std::endl;
+        return builder.isReady() ? 0 : 1;
+    }
+
+    if (parser.isSet(conversionBenchmarkOption))
+        return ConversionBenchmark(parser.value(conversionBenchmarkOption)).exec() ? 0 : 1;
+
+    if (parser.isSet(posterOption))
+    {
+        if (parser.positionalArguments().size() != 1)
+        {
+            qWarning() << "Exactly one model file is needed with --poster";
+            return 1;
+        }
+
+        QStringList size = parser.value(sizeOption).split('x');
+        int width = size.size() == 2 ? size[0].toInt() : 0;
+        int height = size.size() == 2 ? size[1].toInt() : 0;
+
+        if (width <= 0 || height <= 0)
+        {
+            qWarning() << "Invalid size";
+            return 1;
+        }
+
+        Camera camera;
+        if (parser.isSet(cameraPathOption))
+        {
+            CameraPath path;
+            if (!path.load(parser.value(cameraPathOption)))
+                return 1;
+            path.apply(0, camera);
+        }
+
+        // Only the tiles are rendered at once, the full size never needs a framebuffer
+        OffscreenRenderer renderer(width, height);
+        if (!renderer.initialize())
+            return 1;
+
+        renderer.setOcclusionCulling(parser.isSet(occlusionCullingOption));
+
+        if (!renderer.loadModel(parser.positionalArguments()[0]))
+        {
+            qWarning() << "Cannot load" << parser.positionalArguments()[0];
+            return 1;
+        }
+
+        return renderer.renderPoster(camera, parser.value(posterOption)) ? 0 : 1;
+    }
+
+    if (parser.isSet(benchmarkOption))
+    {
+        if (parser.positionalArguments().size() != 1)
+        {
+            qWarning() << "Exactly one model file is needed with --benchmark";
+            return 1;
+        }
+
+        BenchmarkSettings settings;
+        settings.modelFileName = parser.positionalArguments()[0];
+        settings.cameraPathFileName = parser.value(cameraPathOption);
+        settings.reportFileName = parser.value(benchmarkOption);
+
+        QStringList size = parser.value(sizeOption).split('x');
+        settings.width = size.size() == 2 ? size[0].toInt() : 0;
+        settings.height = size.size() == 2 ? size[1].toInt() : 0;
+        settings.fps = parser.value(fpsOption).toInt();
+        settings.duration = parser.value(durationOption).toDouble();
+        settings.warmupFrames = std::max(parser.value(warmupOption).toInt(), 0);
+        settings.occlusionCulling = parser.isSet(occlusionCullingOption);
+
+        if (settings.width <= 0 || settings.height <= 0 || settings.fps <= 0)
+        {
+            qWarning() << "Invalid size or frame rate";
+            return 1;
+        }
+
+        return Benchmark(settings).exec() ? 0 : 1;
+    }
+
+    if (parser.isSet(outputOption))
+    {
+        if (parser.positionalArguments().size() != 1)
+        {
+            qWarning() << "Exactly one model file is needed with --output";
+            return 1;
+        }
+
+        HeadlessRecorderSettings settings;
+        settings.modelFileName = parser.positionalArguments()[0];
+        settings.cameraPathFileName = parser.value(cameraPathOption);
+        settings.outputFileName = parser.value(outputOption);
+
+        QStringList size = parser.value(sizeOption).split('x');
+        settings.width = size.size() == 2 ? size[0].toInt() : 0;
+        settings.height = size.size() == 2 ? size[1].toInt() : 0;
+        settings.fps = parser.value(fpsOption).toInt();
+        settings.bitRate = parser.value(bitRateOption).toInt();
+        settings.duration = parser.value(durationOption).toDouble();
+        settings.lightColor = Qt::white;
+        settings.modelColor = Qt::white;
+        settings.occlusionCulling = parser.isSet(occlusionCullingOption);
+
+        // Encoders need even dimensions
+        if (settings.width <= 0 || settings.height <= 0 || settings.width % 2 || settings.height % 2 || settings.fps <= 0)
+        {
+            qWarning() << "Invalid size or frame rate";
+            return 1;
+        }
+
+        settings.codecId = AV_CODEC_ID_NONE;
+        if (parser.isSet(codecOption))
+        {
+            VideoWriter::initAv();
+            AVCodec* codec = avcodec_find_encoder_by_name(parser.value(codecOption).toLatin1().constData());
+            if (!codec || codec->type != AVMEDIA_TYPE_VIDEO)
+            {
+                qWarning() << "Unknown video encoder" << parser.value(codecOption);
+                return 1;
+            }
+            settings.codecId = codec->id;
+        }
+
+        return HeadlessRecorder(settings).exec() ? 0 : 1;
+    }
+
+    RenderBackend backend = RENDER_BACKEND_OPENGL;
+    if (parser.value(rendererOption) == "software")
+        backend = RENDER_BACKEND_SOFTWARE;
+    else if (parser.value(rendererOption) != "opengl")
+    {
+        qWarning() << "Unknown renderer" << parser.value(rendererOption);
+        return 1;
+    }
+
+#ifdef QT_NO_OPENGL
+    // Without OpenGL only the software rasterizer is available
+    backend = RENDER_BACKEND_SOFTWARE;
+#endif
+
+    MainWindow window(backend);
     window.setGeometry(QRect(50, 50, 1024, 768));
     window.show();
-#else
-    QLabel note("OpenGL Support required");
-    note.show();
-#endif
 
     QCoreApplication::sendPostedEvents(0x0, QEvent::DeferredDelete);
     QCoreApplication::processEvents();
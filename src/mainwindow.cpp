@@ -1,26 +1,41 @@
+#include <algorithm>
+
 #include "debug/Stable.h"
 
 #include <QMenuBar>
 #include <QFileDialog>
 #include <QColorDialog>
 #include <QGridLayout>
+#include <QStatusBar>
+#include <QInputDialog>
+#include <QActionGroup>
 
 #include "mainwindow.h"
+#include "Renderer.h"
+#include "SoftwareRenderer.h"
 
-MainWindow::MainWindow(QWidget *parent) :
+MainWindow::MainWindow(RenderBackend backend, QWidget *parent) :
     QMainWindow(parent),
-    renderer(new Renderer(this)),
+    renderer(backend == RENDER_BACKEND_SOFTWARE ? static_cast<RenderView*>(new SoftwareRenderer(this)) : new Renderer(this)),
     videoRecorder(new VideoRecorder(this, renderer)),
     fpsLabel(new QLabel(this)),
-    timerLabel(new QLabel(this))
+    timerLabel(new QLabel(this)),
+    statsLabel(new QLabel(this)),
+    profilerHud(new ProfilerHud(this))
 {
-    renderer->setGeometry(geometry());
+    renderer->widget()->setGeometry(geometry());
+    connect(renderer->widget(), SIGNAL(pointMeasured(QVector3D, qreal)), this, SLOT(showMeasurement(QVector3D, qreal)));
+    connect(renderer->widget(), SIGNAL(posterSaved(QString, bool)), this, SLOT(showPosterSaved(QString, bool)));
 
     openAct = new QAction(tr("&Open"), this);
     openAct->setShortcuts(QKeySequence::Open);
     openAct->setStatusTip(tr("Open model file"));
     connect(openAct, &QAction::triggered, this, &MainWindow::openModelDialog);
 
+    posterAct = new QAction(tr("Save &Poster..."), this);
+    posterAct->setStatusTip(tr("Render the current view at print resolution"));
+    connect(posterAct, &QAction::triggered, this, &MainWindow::posterDialog);
+
     lightColorAct = new QAction(tr("&Light Color"), this);
     lightColorAct->setStatusTip(tr("Set Light Color"));
     connect(lightColorAct, SIGNAL(triggered()), this, SLOT(lightColorDialog()));
@@ -36,11 +51,50 @@ MainWindow::MainWindow(QWidget *parent) :
 
     fileMenu = menuBar()->addMenu(tr("&File"));
     fileMenu->addAction(openAct);
+    fileMenu->addAction(posterAct);
     fileMenu->addAction(lightColorAct);
     fileMenu->addAction(modelColorAct);
     fileMenu->addSeparator();
     fileMenu->addAction(exitAct);
 
+    occlusionCullingAct = new QAction(tr("&Occlusion Culling"), this);
+    occlusionCullingAct->setStatusTip(tr("Skip parts hidden behind other parts"));
+    occlusionCullingAct->setCheckable(true);
+    occlusionCullingAct->setChecked(renderer->isOcclusionCulling());
+    connect(occlusionCullingAct, &QAction::toggled, this, &MainWindow::setOcclusionCulling);
+
+    dynamicResolutionAct = new QAction(tr("&Dynamic Resolution"), this);
+    dynamicResolutionAct->setStatusTip(tr("Lower the resolution while the camera moves"));
+    dynamicResolutionAct->setCheckable(true);
+    dynamicResolutionAct->setChecked(renderer->isDynamicResolution());
+    connect(dynamicResolutionAct, &QAction::toggled, this, &MainWindow::setDynamicResolution);
+
+    twoSidedLightingAct = new QAction(tr("&Two-Sided Lighting"), this);
+    twoSidedLightingAct->setStatusTip(tr("Light back faces like front faces"));
+    twoSidedLightingAct->setCheckable(true);
+    twoSidedLightingAct->setChecked(renderer->isTwoSidedLighting());
+    connect(twoSidedLightingAct, &QAction::toggled, this, &MainWindow::setTwoSidedLighting);
+
+    flatShadingAct = new QAction(tr("&Flat Shading"), this);
+    flatShadingAct->setStatusTip(tr("Shade each face with its own normal"));
+    flatShadingAct->setCheckable(true);
+    flatShadingAct->setChecked(renderer->isFlatShading());
+    connect(flatShadingAct, &QAction::toggled, this, &MainWindow::setFlatShading);
+
+    profilerAct = new QAction(tr("&Profiler"), this);
+    profilerAct->setStatusTip(tr("Show CPU and GPU stage timings"));
+    profilerAct->setShortcut(QKeySequence(Qt::Key_F3));
+    profilerAct->setCheckable(true);
+    profilerAct->setChecked(true);
+    connect(profilerAct, &QAction::toggled, this, &MainWindow::setProfilerVisible);
+
+    viewMenu = menuBar()->addMenu(tr("V&iew"));
+    viewMenu->addAction(occlusionCullingAct);
+    viewMenu->addAction(dynamicResolutionAct);
+    viewMenu->addAction(twoSidedLightingAct);
+    viewMenu->addAction(flatShadingAct);
+    viewMenu->addAction(profilerAct);
+
 	startRecordAct = new QAction(tr("&Record"), this);
 	startRecordAct->setStatusTip(tr("Start recording video"));
 	connect(startRecordAct, &QAction::triggered, this, &MainWindow::startRecord);
@@ -58,11 +112,36 @@ MainWindow::MainWindow(QWidget *parent) :
     bitRateLowAct->setStatusTip(tr("Set low bit rate"));
     connect(bitRateLowAct, &QAction::triggered, this, &MainWindow::setLowBitRate);
 
+    dropOldestFramesAct = new QAction(tr("Drop Oldest Frames"), this);
+    dropOldestFramesAct->setStatusTip(tr("Skip ahead when the encoder falls behind"));
+    dropOldestFramesAct->setCheckable(true);
+    dropOldestFramesAct->setChecked(true);
+    connect(dropOldestFramesAct, &QAction::triggered, this, &MainWindow::setDropOldestFrames);
+
+    dropNewestFramesAct = new QAction(tr("Drop Newest Frames"), this);
+    dropNewestFramesAct->setStatusTip(tr("Skip new frames when the encoder falls behind"));
+    dropNewestFramesAct->setCheckable(true);
+    connect(dropNewestFramesAct, &QAction::triggered, this, &MainWindow::setDropNewestFrames);
+
+    waitForEncoderAct = new QAction(tr("Wait for Encoder"), this);
+    waitForEncoderAct->setStatusTip(tr("Slow rendering down to the encoder's pace, no frame is dropped"));
+    waitForEncoderAct->setCheckable(true);
+    connect(waitForEncoderAct, &QAction::triggered, this, &MainWindow::setWaitForEncoder);
+
+    QActionGroup* queuePolicyGroup = new QActionGroup(this);
+    queuePolicyGroup->addAction(dropOldestFramesAct);
+    queuePolicyGroup->addAction(dropNewestFramesAct);
+    queuePolicyGroup->addAction(waitForEncoderAct);
+
 	videoMenu = menuBar()->addMenu(tr("&Video"));
     videoMenu->addAction(startRecordAct);
 	videoMenu->addAction(stopRecordAct);
     videoMenu->addAction(bitRateHighAct);
     videoMenu->addAction(bitRateLowAct);
+    videoMenu->addSeparator();
+    videoMenu->addAction(dropOldestFramesAct);
+    videoMenu->addAction(dropNewestFramesAct);
+    videoMenu->addAction(waitForEncoderAct);
 
     fpsLabel->setText("FPS: ");
     fpsLabel->setGeometry(20, 20, 100, 100);
@@ -78,15 +157,25 @@ MainWindow::MainWindow(QWidget *parent) :
     timerLabel->activateWindow();
     timerLabel->raise();
 
+    statsLabel->setGeometry(20, 60, 400, 100);
+    statsLabel->setStyleSheet("QLabel { color : white; }");
+    statsLabel->show();
+    statsLabel->activateWindow();
+    statsLabel->raise();
+
+    profilerHud->refresh();
+    profilerHud->show();
+    profilerHud->raise();
+
     VideoWriter::initAv();
     VideoWriter* vw = new VideoWriter(1920, 1080, 25, 5000000);
     QImage img("data/0.png");
     vw->open("test.avi");
-    vw->writeVideoFrame(img, 1000);
+    vw->writeVideoFrame(img, 0);
     img = QImage("data/1.png");
     vw->writeVideoFrame(img, 1000);
     img = QImage("data/2.png");
-    vw->writeVideoFrame(img, 1000);
+    vw->writeVideoFrame(img, 2000);
     vw->close();
     delete vw;
 
@@ -94,6 +183,7 @@ MainWindow::MainWindow(QWidget *parent) :
 
     QTimer* timer = new QTimer(this);
     connect(timer, SIGNAL(timeout()), this, SLOT(update()));
+    timer->start(250);
 }
 
 MainWindow::~MainWindow()
@@ -106,11 +196,17 @@ MainWindow::~MainWindow()
     delete renderer;
 
     delete openAct;
+    delete posterAct;
 	delete lightColorAct;
 	delete modelColorAct;
 	delete exitAct;
     delete fileMenu;
 
+    delete occlusionCullingAct;
+    delete dynamicResolutionAct;
+    delete profilerAct;
+    delete viewMenu;
+
     delete startRecordAct;
 	delete stopRecordAct;
 	delete videoMenu;
@@ -120,22 +216,63 @@ void MainWindow::update()
 {
     fpsLabel->setText("FPS: " + QString::number(videoRecorder->getFps()));
     timerLabel->setText(QDateTime::fromMSecsSinceEpoch(videoRecorder->getVideoLength()).toUTC().toString("hh:mm:ss.zzz"));
+
+    FrameStats stats = renderer->getFrameStats();
+    RecordQueueStats recordStats = videoRecorder->getQueueStats();
+    statsLabel->setText(QString("Parts: %1 drawn, %2 frustum culled, %3 occluded (%4 occluders, %5 tris)\nTriangles: %6, points: %10\nCull: %7 ms\nStreaming: %8 pending, %9 MB resident\nRecording: %11 frames to encode, %12 packets to mux, %13 dropped")
+        .arg(stats.partsDrawn).arg(stats.partsFrustumCulled).arg(stats.partsOcclusionCulled)
+        .arg(stats.occluders).arg(stats.occluderTriangles)
+        .arg(stats.trianglesDrawn)
+        .arg(stats.cullTime, 0, 'f', 2)
+        .arg(stats.chunksPending).arg(stats.residentBytes >> 20)
+        .arg(stats.pointsDrawn)
+        .arg(recordStats.framesQueued).arg(recordStats.packetsQueued).arg(recordStats.droppedFrames));
+
+    if (profilerHud->isVisible())
+    {
+        profilerHud->refresh();
+        profilerHud->move(width() - profilerHud->width() - 20, 60);
+    }
 }
 
 void MainWindow::resizeEvent(QResizeEvent* event)
 {
     QMainWindow::resizeEvent(event);
-    renderer->setGeometry(QRect(0, 0, geometry().width(), geometry().height()));
+    renderer->widget()->setGeometry(QRect(0, 0, geometry().width(), geometry().height()));
 }
 
 void MainWindow::openModelDialog()
 {
-    QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"),"/data/",tr("Wavefront Model Files (*.obj)"));
+    QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"),"/data/",tr("Model Files (*.obj *.chunks);;Wavefront Model Files (*.obj);;Out-of-Core Models (*.chunks)"));
 
     if (!fileName.isEmpty())
         renderer->loadModel(fileName);
 }
 
+void MainWindow::posterDialog()
+{
+    QString fileName = QFileDialog::getSaveFileName(this, tr("Save Poster"), "poster.tif", tr("TIFF Images (*.tif *.tiff)"));
+    if (fileName.isEmpty())
+        return;
+
+    bool ok = false;
+    int width = QInputDialog::getInt(this, tr("Save Poster"), tr("Width in pixels:"), 16384, 1, 65535, 1, &ok);
+    if (!ok)
+        return;
+
+    // Same framing as the viewport
+    QWidget* view = renderer->widget();
+    int height = std::max(1, width * view->height() / std::max(view->width(), 1));
+
+    statusBar()->showMessage(tr("Rendering %1 x %2 poster...").arg(width).arg(height));
+    renderer->savePoster(fileName, width, height);
+}
+
+void MainWindow::showPosterSaved(QString fileName, bool ok)
+{
+    statusBar()->showMessage(ok ? tr("Poster saved to %1").arg(fileName) : tr("Cannot save poster %1").arg(fileName));
+}
+
 void MainWindow::lightColorDialog()
 {
     renderer->setLightColor(QColorDialog::getColor(renderer->getLightColor(), this, "Choose light color"));
@@ -146,6 +283,41 @@ void MainWindow::modelColorDialog()
     renderer->setModelColor(QColorDialog::getColor(renderer->getModelColor(), this, "Choose model color"));
 }
 
+void MainWindow::setOcclusionCulling(bool enabled)
+{
+    renderer->setOcclusionCulling(enabled);
+}
+
+void MainWindow::setDynamicResolution(bool enabled)
+{
+    renderer->setDynamicResolution(enabled);
+}
+
+void MainWindow::setTwoSidedLighting(bool enabled)
+{
+    renderer->setTwoSidedLighting(enabled);
+}
+
+void MainWindow::setFlatShading(bool enabled)
+{
+    renderer->setFlatShading(enabled);
+}
+
+void MainWindow::setProfilerVisible(bool visible)
+{
+    profilerHud->setVisible(visible);
+    update();
+}
+
+void MainWindow::showMeasurement(QVector3D point, qreal distance)
+{
+    QString text = QString("Point: %1 %2 %3").arg(point.x()).arg(point.y()).arg(point.z());
+    if (distance >= 0)
+        text += QString("  Distance: %1").arg(distance);
+
+    statusBar()->showMessage(text);
+}
+
 void MainWindow::startRecord()
 {
 	if (videoRecorder->isRecording())
@@ -179,3 +351,18 @@ void MainWindow::setLowBitRate()
     bitRateHighAct->setEnabled(true);
     bitRateLowAct->setEnabled(false);
 }
+
+void MainWindow::setDropOldestFrames()
+{
+    videoRecorder->setQueuePolicy(RECORD_QUEUE_DROP_OLDEST);
+}
+
+void MainWindow::setDropNewestFrames()
+{
+    videoRecorder->setQueuePolicy(RECORD_QUEUE_DROP_NEWEST);
+}
+
+void MainWindow::setWaitForEncoder()
+{
+    videoRecorder->setQueuePolicy(RECORD_QUEUE_BLOCK);
+}
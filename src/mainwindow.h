@@ -5,16 +5,18 @@
 
 #include <QMenu>
 #include <QMainWindow>
+#include <QVector3D>
 
-#include "Renderer.h"
+#include "RenderView.h"
 #include "VideoRecorder.h"
+#include "ProfilerHud.h"
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = 0);
+    explicit MainWindow(RenderBackend backend = RENDER_BACKEND_OPENGL, QWidget *parent = 0);
     ~MainWindow();
 
 protected:
@@ -23,20 +25,33 @@ protected:
 private:
     QMenu* fileMenu;
     QAction* openAct;
+    QAction* posterAct;
     QAction* modelColorAct;
     QAction* lightColorAct;
     QAction* exitAct;
 
+    QMenu* viewMenu;
+    QAction* occlusionCullingAct;
+    QAction* dynamicResolutionAct;
+    QAction* twoSidedLightingAct;
+    QAction* flatShadingAct;
+    QAction* profilerAct;
+
 	QMenu* videoMenu;
     QAction* startRecordAct;
 	QAction* stopRecordAct;
     QAction* bitRateHighAct;
     QAction* bitRateLowAct;
+    QAction* dropOldestFramesAct;
+    QAction* dropNewestFramesAct;
+    QAction* waitForEncoderAct;
 
     QLabel* fpsLabel;
     QLabel* timerLabel;
+    QLabel* statsLabel;
+    ProfilerHud* profilerHud;
 
-    Renderer* renderer;
+    RenderView* renderer;
 	VideoRecorder* videoRecorder;
 
 signals:
@@ -46,13 +61,24 @@ public slots:
     void update();
 
     void openModelDialog();
+    void posterDialog();
     void lightColorDialog();
     void modelColorDialog();
+    void setOcclusionCulling(bool);
+    void setDynamicResolution(bool);
+    void setTwoSidedLighting(bool);
+    void setFlatShading(bool);
+    void setProfilerVisible(bool);
+    void showMeasurement(QVector3D point, qreal distance);
+    void showPosterSaved(QString fileName, bool ok);
 
     void startRecord();
 	void stopRecord();
     void setHighBitRate();
     void setLowBitRate();
+    void setDropOldestFrames();
+    void setDropNewestFrames();
+    void setWaitForEncoder();
 
 };
 
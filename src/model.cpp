@@ -12,56 +12,187 @@
 #include <QVector3D>
 #include <QMutexLocker>
 #include <QProgressDialog>
+#include <QOpenGLContext>
 
 #include "model.h"
 
 Model::Model()
-    : indexBuf(QOpenGLBuffer::IndexBuffer)
+    : bufSize(0),
+      indexBuf(QOpenGLBuffer::IndexBuffer)
 {
-    arrayBuf.create();
-    indexBuf.create();
+    // The software renderer has no context and only uses the CPU copies
+    if (QOpenGLContext::currentContext())
+    {
+        arrayBuf.create();
+        indexBuf.create();
+        occlusionBuf.create();
+    }
 }
 
 Model::~Model()
 {
+    vertexArray.destroy();
     arrayBuf.destroy();
     indexBuf.destroy();
+    occlusionBuf.destroy();
+}
+
+void Model::load(const std::vector<Vertex>& vdata, const std::vector<GLuint>& indices_, const std::vector<Part>& parts_, QVector3D pivot_)
+{
+    if (arrayBuf.isCreated() && indexBuf.isCreated())
+    {
+        arrayBuf.bind();
+        arrayBuf.allocate(vdata.data(), (int)vdata.size() * sizeof(Vertex));
+
+        indexBuf.bind();
+        indexBuf.allocate(indices_.data(), (int)indices_.size() * sizeof(GLuint));
+
+        if (!vertexArray.isCreated())
+            createVertexArray();
+    }
+
+    bufSize = (int) indices_.size();
+
+    // Keep CPU copies for culling
+    vertices = vdata;
+    indices = indices_;
+    parts = parts_;
+
+    pivot = pivot_;
 }
 
-void Model::load(const std::vector<Vertex>& vdata, const std::vector<GLuint>& indices, QVector3D pivot_)
+void Model::upload()
 {
+    QMutexLocker lck(&mutex);
+
+    if (arrayBuf.isCreated())
+        return;
+
+    arrayBuf.create();
+    indexBuf.create();
+    occlusionBuf.create();
+
     arrayBuf.bind();
-    arrayBuf.allocate(vdata.data(), (int)vdata.size() * sizeof(Vertex));
+    arrayBuf.allocate(vertices.data(), (int)vertices.size() * sizeof(Vertex));
 
     indexBuf.bind();
     indexBuf.allocate(indices.data(), (int)indices.size() * sizeof(GLuint));
 
-    bufSize = (int) indices.size();
+    if (!occlusion.empty())
+    {
+        occlusionBuf.bind();
+        occlusionBuf.allocate(occlusion.data(), (int)occlusion.size() * sizeof(float));
+        occlusionBuf.release();
+    }
 
-    pivot = pivot_;
+    createVertexArray();
 }
 
-void Model::draw(QOpenGLShaderProgram *program)
+const std::vector<Vertex>& Model::getVertices() const
 {
-    if (!mutex.tryLock())
+    return vertices;
+}
+
+const std::vector<GLuint>& Model::getIndices() const
+{
+    return indices;
+}
+
+const std::vector<Part>& Model::getParts() const
+{
+    return parts;
+}
+
+void Model::setOcclusion(const std::vector<float>& occlusion_)
+{
+    QMutexLocker lck(&mutex);
+
+    if (occlusion_.size() != vertices.size())
         return;
 
-    // Tell OpenGL which VBOs to use
+    // Separate buffer so the vertex data does not have to be uploaded again
+    if (occlusionBuf.isCreated())
+    {
+        occlusionBuf.bind();
+        occlusionBuf.allocate(occlusion_.data(), (int)occlusion_.size() * sizeof(float));
+        occlusionBuf.release();
+    }
+
+    occlusion = occlusion_;
+
+    if (vertexArray.isCreated())
+        setOcclusionAttribute();
+}
+
+const std::vector<float>& Model::getOcclusion() const
+{
+    return occlusion;
+}
+
+void Model::createVertexArray()
+{
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    // Recorded once, drawing only binds the vertex array
+    vertexArray.create();
+    vertexArray.bind();
+
     arrayBuf.bind();
     indexBuf.bind();
 
-    // Tell OpenGL programmable pipeline how to locate vertex position data
-    int vertexLocation = program->attributeLocation("vPos");
-    program->enableAttributeArray(vertexLocation);
-    program->setAttributeBuffer(vertexLocation, GL_FLOAT, 0, 3, sizeof(Vertex));
+    f->glEnableVertexAttribArray(VERTEX_ATTRIBUTE_POSITION);
+    f->glVertexAttribPointer(VERTEX_ATTRIBUTE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), 0);
+
+    f->glEnableVertexAttribArray(VERTEX_ATTRIBUTE_NORMAL);
+    f->glVertexAttribPointer(VERTEX_ATTRIBUTE_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)sizeof(QVector3D));
+
+    vertexArray.release();
+    arrayBuf.release();
+
+    if (!occlusion.empty())
+        setOcclusionAttribute();
+}
+
+void Model::setOcclusionAttribute()
+{
+    QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+    // Only read by the shader variant with occlusion
+    vertexArray.bind();
+    occlusionBuf.bind();
 
-    int normalLocation = program->attributeLocation("vNormal");
-    program->enableAttributeArray(normalLocation);
-    program->setAttributeBuffer(normalLocation, GL_FLOAT, sizeof(QVector3D), 3, sizeof(Vertex));
-    // Tell OpenGL programmable pipeline how to locate vertex texture coordinate data
+    f->glEnableVertexAttribArray(VERTEX_ATTRIBUTE_OCCLUSION);
+    f->glVertexAttribPointer(VERTEX_ATTRIBUTE_OCCLUSION, 1, GL_FLOAT, GL_FALSE, sizeof(float), 0);
 
-    // Draw cube geometry using indices from VBO 1
+    vertexArray.release();
+    occlusionBuf.release();
+}
+
+void Model::draw()
+{
+    if (!mutex.tryLock())
+        return;
+
+    vertexArray.bind();
     glDrawElements(GL_TRIANGLES, bufSize, GL_UNSIGNED_INT, 0);
+    vertexArray.release();
+
+    mutex.unlock();
+}
+
+void Model::draw(const std::vector<int>& visibleParts)
+{
+    if (!mutex.tryLock())
+        return;
+
+    vertexArray.bind();
+
+    for (int i : visibleParts)
+    {
+        const Part& p = parts[i];
+        glDrawElements(GL_TRIANGLES, p.indexCount, GL_UNSIGNED_INT, (const void*)(p.firstIndex * sizeof(GLuint)));
+    }
 
+    vertexArray.release();
     mutex.unlock();
 }
@@ -8,9 +8,19 @@
 #include <QOpenGLFunctions>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
 #include <QMutex>
 
 #include "vertex.h"
+#include "BoundingBox.h"
+
+// Range of triangles that is culled and drawn as a unit
+struct Part
+{
+    GLuint firstIndex;
+    GLsizei indexCount;
+    BoundingBox bbox;
+};
 
 class Model : public QObject
 {
@@ -22,15 +32,37 @@ public:
     Model();
     ~Model();
 
-    void draw(QOpenGLShaderProgram *program);
-    void load(const std::vector<Vertex>&, const std::vector<GLuint>&, QVector3D);
+    // The attributes are bound with the vertex array, any mesh program can be bound
+    void draw();
+    void draw(const std::vector<int>& visibleParts);
+    void load(const std::vector<Vertex>&, const std::vector<GLuint>&, const std::vector<Part>&, QVector3D);
+
+    // Creates and fills the buffers of a model loaded without a context, needs one to be current
+    void upload();
+
+    const std::vector<Vertex>& getVertices() const;
+    const std::vector<GLuint>& getIndices() const;
+    const std::vector<Part>& getParts() const;
+
+    // Per-vertex ambient occlusion, 1 is unoccluded. Draws without it until set.
+    void setOcclusion(const std::vector<float>&);
+    const std::vector<float>& getOcclusion() const;
 
     QVector3D pivot;
 
 private:
+    void createVertexArray();
+    void setOcclusionAttribute();
+
     int bufSize;
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<Part> parts;
+    std::vector<float> occlusion;
     QOpenGLBuffer arrayBuf;
     QOpenGLBuffer indexBuf;
+    QOpenGLBuffer occlusionBuf;
+    QOpenGLVertexArrayObject vertexArray; // Per context, built once the buffers are filled
     QMutex mutex;
 };
 
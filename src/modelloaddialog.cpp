@@ -44,6 +44,16 @@ void ModelLoadDialog::read(Model* mdl)
     mdlLoader->read(mdl);
 }
 
+bool ModelLoadDialog::isPointCloud()
+{
+    return mdlLoader->isPointCloud();
+}
+
+void ModelLoadDialog::read(PointOctree& octree)
+{
+    mdlLoader->read(octree);
+}
+
 void ModelLoadDialog::exec()
 {
     progress->exec();
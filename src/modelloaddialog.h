@@ -22,6 +22,8 @@ public:
     const std::vector<GLuint>& getIndices();
     QVector3D getPivot();
     void read(Model* mdl);
+    bool isPointCloud();
+    void read(PointOctree& octree);
 
     void exec();
 
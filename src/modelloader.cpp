@@ -4,6 +4,7 @@
 #include <fstream>
 #include <iostream>
 #include <locale>
+#include <utility>
 
 #include "debug/Stable.h"
 
@@ -12,6 +13,9 @@
 #include "model.h"
 #include "modelloader.h"
 
+// Objects bigger than this are split so that occlusion culling has a useful granularity
+static const GLsizei maxPartTriangles = 16384;
+
 // Treat / as whitespace
 struct Ctype: std::ctype<char>
 {
@@ -86,6 +90,11 @@ const std::vector<GLuint>& ModelLoader::getIndices()
     return indices;
 }
 
+const std::vector<Part>& ModelLoader::getParts()
+{
+    return parts;
+}
+
 QVector3D ModelLoader::getPivot()
 {
     return pivot;
@@ -101,10 +110,21 @@ void ModelLoader::read(Model* mdl)
     if (ready)
     {
         QMutexLocker lck(&(mdl->mutex));
-        mdl->load(vertices, indices, pivot);
+        mdl->load(vertices, indices, parts, pivot);
     }
 }
 
+bool ModelLoader::isPointCloud()
+{
+    return !pointOctree.isEmpty();
+}
+
+void ModelLoader::read(PointOctree& octree)
+{
+    if (ready)
+        std::swap(octree, pointOctree);
+}
+
 void ModelLoader::run()
 {
     std::vector<QVector3D> faceNormals;
@@ -257,6 +277,11 @@ void ModelLoader::run()
         {
             precomputedNormals = false;
             texturePresent = false;
+            startPart();
+        }
+        else if (line == "g")
+        {
+            startPart();
         }
 
         mtx->lock();
@@ -275,5 +300,54 @@ void ModelLoader::run()
 
     pivot /= vertices.size();
 
+    // Only the octree is kept for point clouds
+    if (indices.empty() && !vertices.empty())
+    {
+        if (!pointOctree.build(vertices, cancelled))
+            return;
+
+        std::vector<Vertex>().swap(vertices);
+    }
+
+    finishParts();
+
     ready = true;
 }
+
+void ModelLoader::startPart()
+{
+    if (!parts.empty() && parts.back().firstIndex == (GLuint)indices.size())
+        return;
+
+    Part p;
+    p.firstIndex = (GLuint)indices.size();
+    p.indexCount = 0;
+    parts.push_back(p);
+}
+
+void ModelLoader::finishParts()
+{
+    if (parts.empty())
+        startPart();
+
+    std::vector<Part> split;
+
+    for (int i = 0; i < (int)parts.size(); ++i)
+    {
+        GLuint end = i + 1 < (int)parts.size() ? parts[i + 1].firstIndex : (GLuint)indices.size();
+
+        for (GLuint first = parts[i].firstIndex; first < end; first += maxPartTriangles * 3)
+        {
+            Part p;
+            p.firstIndex = first;
+            p.indexCount = (GLsizei)qMin<GLuint>(end - first, maxPartTriangles * 3);
+
+            for (GLsizei j = 0; j < p.indexCount; ++j)
+                p.bbox.extend(vertices[indices[first + j]].pos);
+
+            split.push_back(p);
+        }
+    }
+
+    parts.swap(split);
+}
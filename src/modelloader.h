@@ -1,6 +1,8 @@
 #ifndef MODELLOADER_H
 #define MODELLOADER_H
 
+#include <atomic>
+
 #include "debug/Stable.h"
 
 #include <QTimer>
@@ -12,6 +14,7 @@
 #include <QOpenGLFunctions>
 
 #include "model.h"
+#include "PointOctree.h"
 
 class ModelLoader : public QThread
 {
@@ -28,22 +31,31 @@ public:
     int getMaxProgress();
     const std::vector<Vertex>& getVertices();
     const std::vector<GLuint>& getIndices();
+    const std::vector<Part>& getParts();
     QVector3D getPivot();
     void cancel();
     void read(Model*);
 
+    // Files with vertices but no faces load as a point cloud instead of a model
+    bool isPointCloud();
+    void read(PointOctree&); // Takes the octree
+
 private:
     void run() override;
+    void startPart();
+    void finishParts();
 
-    bool ready;
-    bool cancelled;
+    std::atomic<bool> ready;
+    std::atomic<bool> cancelled;
     int progress;
     int maxProgress;
     QString fileName;
     QMutex* mtx;
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
+    std::vector<Part> parts;
     QVector3D pivot;
+    PointOctree pointOctree;
 
 signals:
     void resultReady(std::vector<Vertex> vertices, std::vector<GLuint> indices);
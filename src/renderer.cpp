@@ -1,194 +1,261 @@
-#include <cmath>
-
 #include "debug/Stable.h"
 
 #include <QMouseEvent>
-#include <QFileDialog>
-#include <QColorDialog>
 
 #include "Renderer.h"
 #include "ModelLoadDialog.h"
-#include "VideoRecorder.h"
+#include "AoBakeDialog.h"
+#include "Profiler.h"
+#include "ProgramCache.h"
 
 Renderer::Renderer(QWidget *parent) :
     QOpenGLWidget(parent),
-    m_model(nullptr),
-    m_angularSpeed(0),
-    m_translationSpeed(0.005),
-    m_scale(1),
-    m_translation(0, 0, -5),
-    m_lightColor(Qt::white),
+    m_thread(nullptr),
+    m_presented(false),
     m_modelColor(Qt::white),
-    m_lastFrameBufferUpdateTime(QDateTime::currentMSecsSinceEpoch()),
-    m_pixBufObj(new QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer)),
-    m_frameBufferRead(false),
-    m_frameBufUpdate(false)
+    m_lightColor(Qt::white),
+    m_occlusionCulling(true),
+    m_dynamicResolution(true),
+    m_twoSidedLighting(true),
+    m_flatShading(false),
+    m_captureRate(0),
+    m_frameSink(nullptr)
 {}
 
 Renderer::~Renderer()
 {
-    // Make sure the context is current when deleting the texture
-    // and the buffers.
-
+    // The render context shares with ours, keep it alive until the thread has cleaned up
     makeCurrent();
 
-    delete m_model;
-    delete m_pixBufObj;
+    delete m_thread;
+    m_quad.destroy();
 
     doneCurrent();
 }
 
-QImage& Renderer::getFrameBuffer()
+QWidget* Renderer::widget()
 {
-    return m_frameBuffer;
+    return this;
 }
 
-qint64 Renderer::getLastFrameBufferUpdateTime()
+void Renderer::setCaptureRate(int fps)
 {
-    return m_lastFrameBufferUpdateTime;
+    m_captureRate = fps;
+
+    RenderCommand command;
+    command.type = RENDER_COMMAND_CAPTURE_RATE;
+    command.rate = fps;
+    post(command);
 }
 
-void Renderer::updateFrameBuffer()
+void Renderer::requestFrameBuffer()
 {
-    // glFenceSync - maybe useful for sync
+    if (m_thread)
+        m_thread->requestCapture();
+}
 
-    m_frameBufUpdate = true;
+QImage Renderer::getFrameBuffer()
+{
+    return m_thread ? m_thread->getFrameBuffer() : QImage();
+}
 
-    m_pixBufObj->bind();
+qint64 Renderer::getLastFrameBufferUpdateTime()
+{
+    return m_thread ? m_thread->getLastFrameBufferUpdateTime() : 0;
+}
 
-    if (!m_frameBufferRead)
-    {
-        m_frameBufferRead = true;
-        glReadPixels(0, 0, geometry().width(), geometry().height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
-        m_pixBufObj->release();
-        QTimer::singleShot(0, Qt::PreciseTimer, this, &Renderer::updateFrameBuffer);
-        return;
-    }
+void Renderer::setFrameSink(FrameSink* sink)
+{
+    m_frameSink = sink;
 
-    unsigned char* fb = (unsigned char*) m_pixBufObj->map(QOpenGLBuffer::ReadOnly);
-    if (!fb)
-    {
-        qDebug() << "fb: fail\n";
-        m_pixBufObj->release();
-        QTimer::singleShot(0, Qt::PreciseTimer, this, &Renderer::updateFrameBuffer);
-        return;
-    }
+    if (m_thread)
+        m_thread->setFrameSink(sink);
+}
 
-    m_frameBuffer = QImage(fb, geometry().width(), geometry().height(), QImage::Format_RGB32).mirrored();
+void Renderer::savePoster(QString fileName, int width, int height)
+{
+    RenderCommand command;
+    command.type = RENDER_COMMAND_SAVE_POSTER;
+    command.fileName = fileName;
+    command.size = QSize(width, height);
+    post(command);
+}
 
-    if (!m_pixBufObj->unmap())
-    {
-        qDebug() << "FrameBuffer: failed unmap\n";
+void Renderer::loadModel(QString fileName)
+{
+    // Nothing to hand the model to before the widget is shown
+    if (!m_thread)
         return;
-    }
 
-    if (m_frameBuffer.isNull())
+    RenderCommand command;
+    command.fileName = fileName;
+
+    // Preprocessed with --build-chunks, opened by the render thread
+    if (fileName.endsWith(".chunks"))
     {
-        qDebug() << "fb: null frame\n";
-        QTimer::singleShot(0, Qt::PreciseTimer, this, &Renderer::updateFrameBuffer);
+        command.type = RENDER_COMMAND_LOAD_CHUNKS;
+        post(command);
         return;
     }
 
-    m_pixBufObj->release();
-    m_frameBufferRead = false;
-    m_lastFrameBufferUpdateTime = QDateTime::currentMSecsSinceEpoch();
-	recordFrame();
-}
-
-void Renderer::loadModel(QString fileName)
-{
     ModelLoadDialog* mld = new ModelLoadDialog(this, fileName);
     mld->exec();
 
-    if (mld->isReady())
-    {
-        if (m_model)
-            delete m_model;
-        m_model = nullptr;
+    if (!mld->isReady())
+        return;
 
-        m_model = new Model();
-        mld->read(m_model);
+    // Loaded without a context, the render thread creates the buffers
+    doneCurrent();
+
+    if (mld->isPointCloud())
+    {
+        command.type = RENDER_COMMAND_SET_POINT_CLOUD;
+        command.points = new PointOctree();
+        mld->read(*command.points);
     }
+    else
+    {
+        command.type = RENDER_COMMAND_SET_MODEL;
+        command.model = new Model();
+        mld->read(command.model);
+        command.model->moveToThread(m_thread);
+    }
+
+    post(command);
 }
 
 void Renderer::setLightColor(QColor c)
 {
     m_lightColor = c;
+
+    RenderCommand command;
+    command.type = RENDER_COMMAND_LIGHT_COLOR;
+    command.color = c;
+    post(command);
 }
 
 void Renderer::setModelColor(QColor c)
 {
     m_modelColor = c;
+
+    RenderCommand command;
+    command.type = RENDER_COMMAND_MODEL_COLOR;
+    command.color = c;
+    post(command);
 }
 
-int Renderer::getWidth()
+QColor Renderer::getLightColor()
 {
-	GLint vp[4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-	return vp[2];
+    return m_lightColor;
 }
 
-int Renderer::getHeight()
+QColor Renderer::getModelColor()
 {
-	GLint vp[4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-	return vp[3];
+    return m_modelColor;
 }
 
-QColor Renderer::getLightColor()
+void Renderer::setOcclusionCulling(bool enabled)
 {
-    return m_lightColor;
+    m_occlusionCulling = enabled;
+
+    RenderCommand command;
+    command.type = RENDER_COMMAND_OCCLUSION_CULLING;
+    command.enabled = enabled;
+    post(command);
 }
 
-QColor Renderer::getModelColor()
+bool Renderer::isOcclusionCulling()
 {
-    return m_modelColor;
+    return m_occlusionCulling;
 }
 
-void Renderer::mousePressEvent(QMouseEvent *e)
+void Renderer::setDynamicResolution(bool enabled)
 {
-    m_mousePressPosition = QVector2D(e->localPos());
-    m_mouseLastPosition = m_mousePressPosition;
+    m_dynamicResolution = enabled;
+
+    RenderCommand command;
+    command.type = RENDER_COMMAND_DYNAMIC_RESOLUTION;
+    command.enabled = enabled;
+    post(command);
 }
 
-void Renderer::mouseMoveEvent(QMouseEvent *e)
+bool Renderer::isDynamicResolution()
 {
-    QVector2D diff = QVector2D(e->localPos()) - m_mouseLastPosition;
-    m_mouseLastPosition = QVector2D(e->localPos());
+    return m_dynamicResolution;
+}
 
-    if (e->buttons() == Qt::MiddleButton && e->modifiers() & Qt::ShiftModifier)
-    {
-        QVector3D v(m_mouseLastPosition - diff);
-        QVector3D v2(QVector2D(e->localPos()));
+void Renderer::setTwoSidedLighting(bool enabled)
+{
+    m_twoSidedLighting = enabled;
 
-        GLint vp[4];
-        glGetIntegerv(GL_VIEWPORT, vp);
+    RenderCommand command;
+    command.type = RENDER_COMMAND_TWO_SIDED_LIGHTING;
+    command.enabled = enabled;
+    post(command);
+}
 
-        v.setY(vp[3] - v.y());
-        v2.setY(vp[3] - v2.y());
+bool Renderer::isTwoSidedLighting()
+{
+    return m_twoSidedLighting;
+}
 
-        m_modelView.setToIdentity();
-        m_modelView.translate(m_translation);
-        m_modelView.rotate(m_rotation);
-        m_modelView.scale(m_scale);
+void Renderer::setFlatShading(bool enabled)
+{
+    m_flatShading = enabled;
 
-        v.unproject(m_modelView, m_projection, QRect(vp[0], v[1], vp[2], vp[3]));
-        v2.unproject(m_modelView, m_projection, QRect(vp[0], v[1], vp[2], vp[3]));
+    RenderCommand command;
+    command.type = RENDER_COMMAND_FLAT_SHADING;
+    command.enabled = enabled;
+    post(command);
+}
 
-        QVector3D d = (v2 - v) * m_translationSpeed;
-        m_translation += d;
-    }
-    else if (e->buttons() == Qt::MiddleButton)
-    {
-        // Rotation axis is perpendicular to the mouse position difference vector
-        QVector3D n = QVector3D(diff.y(), diff.x(), 0.0).normalized();
+bool Renderer::isFlatShading()
+{
+    return m_flatShading;
+}
 
-        qreal angle = diff.length() / 10.0;
+FrameStats Renderer::getFrameStats()
+{
+    return m_thread ? m_thread->getFrameStats() : FrameStats();
+}
 
-        m_rotation = QQuaternion::fromAxisAndAngle(n, angle) * m_rotation;
-    }
+void Renderer::post(const RenderCommand& command)
+{
+    // Settings made before the context exists are posted again in initializeGL()
+    if (m_thread)
+        m_thread->post(command);
+}
 
-    update();
+RenderCommand Renderer::mouseCommand(RenderCommandType type, QMouseEvent* e)
+{
+    RenderCommand command;
+    command.type = type;
+    command.pos = e->localPos();
+    command.button = e->button();
+    command.buttons = e->buttons();
+    command.modifiers = e->modifiers();
+    command.time = e->timestamp();
+    return command;
+}
+
+void Renderer::mousePressEvent(QMouseEvent *e)
+{
+    post(mouseCommand(RENDER_COMMAND_MOUSE_PRESS, e));
+}
+
+void Renderer::mouseMoveEvent(QMouseEvent *e)
+{
+    post(mouseCommand(RENDER_COMMAND_MOUSE_MOVE, e));
+}
+
+void Renderer::mouseReleaseEvent(QMouseEvent *e)
+{
+    post(mouseCommand(RENDER_COMMAND_MOUSE_RELEASE, e));
+}
+
+void Renderer::mouseDoubleClickEvent(QMouseEvent *e)
+{
+    post(mouseCommand(RENDER_COMMAND_MOUSE_DOUBLE_CLICK, e));
 }
 
 void Renderer::wheelEvent(QWheelEvent* e)
@@ -205,101 +272,108 @@ void Renderer::wheelEvent(QWheelEvent* e)
         d = (numDegrees / 15).y();
     }
 
-    m_scale *= 1 + d / 100.;
-
-    if (m_scale < 0.05)
-        m_scale = 0.05;
+    RenderCommand command;
+    command.type = RENDER_COMMAND_WHEEL;
+    command.pos = e->posF();
+    command.delta = d;
+    post(command);
 
     e->accept();
-    update();
 }
 
 void Renderer::initializeGL()
 {
     initializeOpenGLFunctions();
 
-    glClearColor(0, 0, 0, 1);
-
-    // Compile vertex shader
-    if (!m_ShaderProgram.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/rsc/vshader.glsl"))
-        close();
-
-    // Compile fragment shader
-    if (!m_ShaderProgram.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/rsc/fshader.glsl"))
-        close();
-
-    // Link shader pipeline
-    if (!m_ShaderProgram.link())
-        close();
-
-    // Bind shader pipeline for use
-    if (!m_ShaderProgram.bind())
+    ProgramCache cache;
+    if (!cache.build(m_presentProgram, ":/rsc/presentvshader.glsl", ":/rsc/presentfshader.glsl"))
+    {
         close();
+        return;
+    }
 
-    glEnable(GL_DEPTH_TEST); // Enable depth buffer
-    glDepthFunc(GL_LESS);
-    glDepthMask(GL_TRUE);
-
-    m_model = new Model();
-
-    m_pixBufObj->create();
-    m_pixBufObj->setUsagePattern(QOpenGLBuffer::StaticRead);
-    m_pixBufObj->bind();
-    m_pixBufObj->allocate(geometry().width() * geometry().height() * 4);
-    m_pixBufObj->release();
-
-    // Use QBasicTimer because its faster than QTimer
-    m_timer.start(12, this);
+    static const GLfloat quad[] = { -1, -1, 1, -1, -1, 1, 1, 1 };
+    m_quad.create();
+    m_quad.bind();
+    m_quad.allocate(quad, sizeof(quad));
+    m_quad.release();
+
+    // The frame is always on texture unit 0
+    m_presentProgram.bind();
+    m_presentProgram.setUniformValue("frame", 0);
+    m_presentProgram.release();
+
+    m_thread = new RenderThread(context());
+
+    connect(m_thread, &RenderThread::frameReady, this, static_cast<void (QWidget::*)()>(&QWidget::update));
+    connect(m_thread, &RenderThread::pointMeasured, this, &Renderer::pointMeasured);
+    connect(m_thread, &RenderThread::posterSaved, this, &Renderer::posterSaved);
+    connect(m_thread, &RenderThread::aoBakeStarted, this, &Renderer::showAoBake);
+
+    // Passed on right away on the render thread, the recorder doesn't wait for the event loop
+    connect(m_thread, &RenderThread::recordFrame, this, &Renderer::recordFrame, Qt::DirectConnection);
+
+    setLightColor(m_lightColor);
+    setModelColor(m_modelColor);
+    setOcclusionCulling(m_occlusionCulling);
+    setDynamicResolution(m_dynamicResolution);
+    setTwoSidedLighting(m_twoSidedLighting);
+    setFlatShading(m_flatShading);
+    setCaptureRate(m_captureRate);
+    setFrameSink(m_frameSink);
+
+    m_thread->start();
 }
 
 void Renderer::resizeGL(int w, int h)
 {
-    // Calculate aspect ratio
-    qreal aspect = qreal(w) / qreal(h ? h : 1);
-
-    // Set near plane to 3.0, far plane to 7.0, field of view 45 degrees
-    const qreal zNear = 1.0, zFar = 200.0, fov = 45.0;
-
-    // Reset projection
-    m_projection.setToIdentity();
-
-    // Set perspective projection
-    m_projection.perspective(fov, aspect, zNear, zFar);
-
-    m_pixBufObj->bind();
-    m_pixBufObj->allocate(w * h * 4);
-    m_pixBufObj->release();
+    RenderCommand command;
+    command.type = RENDER_COMMAND_RESIZE;
+    command.size = QSize(w, h);
+    command.pixelRatio = devicePixelRatioF();
+    post(command);
 }
 
 void Renderer::paintGL()
 {
-	makeCurrent();
+    ProfileScope scope("Present");
 
-    // Clear color and depth buffer
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_DEPTH_TEST);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
 
-    if (!m_model)
+    QVector2D texCoordScale;
+    GLuint texture = m_thread ? m_thread->acquireFrame(texCoordScale) : 0;
+    if (!texture)
         return;
 
-    // Calculate model view transformation
-    m_modelView.setToIdentity();
-    m_modelView.translate(m_translation);
-    m_modelView.translate(m_model->pivot);
-    m_modelView.rotate(m_rotation);
-    m_modelView.translate(-m_model->pivot);
-    m_modelView.scale(m_scale);
-
-    // Set modelview-projection matrix
-    m_ShaderProgram.setUniformValue("m_projection", m_projection);
-    m_ShaderProgram.setUniformValue("m_model_view", m_modelView);
-    m_ShaderProgram.setUniformValue("mvp_matrix", m_projection * m_modelView);
-    m_ShaderProgram.setUniformValue("lightPos", QVector3D(0., 0., -1.));
-    m_ShaderProgram.setUniformValue("lightColor", QVector4D(m_lightColor.redF(), m_lightColor.greenF(), m_lightColor.blueF(), 1.));
-    m_ShaderProgram.setUniformValue("modelColor", QVector4D(m_modelColor.redF(), m_modelColor.greenF(), m_modelColor.blueF(), 1.));
-    // Use texture
-
-    // Draw
-    m_model->draw(&m_ShaderProgram);
+    // Stretched over the viewport while a resize is on its way to the render thread
+    // or the frame was rendered at a scaled down resolution
+    m_presentProgram.bind();
+    m_presentProgram.setUniformValue("texCoordScale", texCoordScale);
+    m_quad.bind();
 
-    doneCurrent();
+    m_presentProgram.enableAttributeArray(VERTEX_ATTRIBUTE_POSITION);
+    m_presentProgram.setAttributeBuffer(VERTEX_ATTRIBUTE_POSITION, GL_FLOAT, 0, 2);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_presentProgram.disableAttributeArray(VERTEX_ATTRIBUTE_POSITION);
+    m_quad.release();
+    m_presentProgram.release();
+
+    if (!m_presented)
+    {
+        m_presented = true;
+        qDebug() << "Renderer: first frame" << Profiler::instance()->getUptime() << "ms after start";
+    }
+}
+
+void Renderer::showAoBake(AoBaker* baker)
+{
+    new AoBakeDialog(this, baker);
 }
@@ -6,16 +6,17 @@
 #include <QString>
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
-#include <QMatrix4x4>
-#include <QQuaternion>
-#include <QVector2D>
-#include <QBasicTimer>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLBuffer>
 #include <QColor>
 
-#include "model.h"
+#include "AoBaker.h"
+#include "FrameStats.h"
+#include "RenderView.h"
+#include "RenderThread.h"
 
-class Renderer : public QOpenGLWidget, public QOpenGLFunctions
+// Viewport widget presenting the frames of a RenderThread, input is forwarded to it
+class Renderer : public QOpenGLWidget, public QOpenGLFunctions, public RenderView
 {
     Q_OBJECT
 
@@ -23,23 +24,39 @@ public:
     explicit Renderer(QWidget *parent = 0);
     ~Renderer();
 
-    
-    void setLightColor(QColor);
-    void setModelColor(QColor);
+    QWidget* widget() override;
 
-	int getWidth();
-	int getHeight();
-    QColor getLightColor();
-    QColor getModelColor();
+    void setLightColor(QColor) override;
+    void setModelColor(QColor) override;
 
-	QImage& getFrameBuffer();
-    qint64 getLastFrameBufferUpdateTime();
+    QColor getLightColor() override;
+    QColor getModelColor() override;
 
-	void loadModel(QString);
+    void setOcclusionCulling(bool) override;
+    bool isOcclusionCulling() override;
+    void setDynamicResolution(bool) override;
+    bool isDynamicResolution() override;
+    void setTwoSidedLighting(bool) override;
+    bool isTwoSidedLighting() override;
+    void setFlatShading(bool) override;
+    bool isFlatShading() override;
+    FrameStats getFrameStats() override;
+
+    void setCaptureRate(int fps) override;
+    void requestFrameBuffer() override;
+    QImage getFrameBuffer() override;
+    qint64 getLastFrameBufferUpdateTime() override;
+    void setFrameSink(FrameSink*) override;
+
+    void savePoster(QString fileName, int width, int height) override;
+
+	void loadModel(QString) override;
 
 protected:
     void mousePressEvent(QMouseEvent*) override;
     void mouseMoveEvent(QMouseEvent*) override;
+    void mouseReleaseEvent(QMouseEvent*) override;
+    void mouseDoubleClickEvent(QMouseEvent*) override;
     void wheelEvent(QWheelEvent*) override;
 
     void initializeGL() override;
@@ -47,37 +64,31 @@ protected:
     void paintGL() override;
 
 private:
-    QBasicTimer m_timer;
-    QOpenGLShaderProgram m_ShaderProgram;
-    Model* m_model;
+    void post(const RenderCommand& command);
+    RenderCommand mouseCommand(RenderCommandType type, QMouseEvent* e);
 
-    QMatrix4x4 m_modelView;
-    QMatrix4x4 m_projection;
-
-    QVector2D m_mousePressPosition;
-    QVector3D m_rotationAxis;
-    qreal m_angularSpeed;
-    QQuaternion m_rotation;
-    QVector2D m_mouseLastPosition;
-
-    QVector3D m_translation;
-    qreal m_translationSpeed;
-    qreal m_scale;
+    RenderThread* m_thread; // Created with the context
+    QOpenGLShaderProgram m_presentProgram;
+    QOpenGLBuffer m_quad;
+    bool m_presented; // A frame has been shown, the time to the first one is logged
 
+    // Mirrors of the render thread's settings
     QColor m_modelColor;
     QColor m_lightColor;
-
-    QImage m_frameBuffer;
-    qint64 m_lastFrameBufferUpdateTime;
-    QOpenGLBuffer* m_pixBufObj;
-    bool m_frameBufferRead;
-    bool m_frameBufUpdate;
+    bool m_occlusionCulling;
+    bool m_dynamicResolution;
+    bool m_twoSidedLighting;
+    bool m_flatShading;
+    int m_captureRate;
+    FrameSink* m_frameSink;
 
 signals:
     void recordFrame();
+    void pointMeasured(QVector3D point, qreal distance);
+    void posterSaved(QString fileName, bool ok);
 
-public slots:
-	void updateFrameBuffer();
+private slots:
+    void showAoBake(AoBaker* baker);
 };
 
 #endif // RENDERER_H
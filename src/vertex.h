@@ -7,4 +7,12 @@ struct Vertex
     QVector3D norm;
 };
 
+// Fixed in the shaders with layout(location), so vertex arrays work with every program
+enum VertexAttribute
+{
+    VERTEX_ATTRIBUTE_POSITION = 0,
+    VERTEX_ATTRIBUTE_NORMAL = 1,
+    VERTEX_ATTRIBUTE_OCCLUSION = 2
+};
+
 #endif // VERTEX_H
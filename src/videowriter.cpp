@@ -1,4 +1,7 @@
+#include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <cstring>
 #include <iostream>
 
 extern "C"
@@ -8,6 +11,7 @@ extern "C"
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
 #include "libavutil/mathematics.h"
+#include "libavutil/pixdesc.h"
 #include "libavutil/samplefmt.h"
 #include "libswscale/swscale.h"
 }
@@ -19,6 +23,14 @@ extern "C"
 #include <QString>
 
 #include "videowriter.h"
+#include "Profiler.h"
+#include "ThreadPool.h"
+#include "I420Converter.h"
+
+namespace
+{
+    const int minBandRows = 64; // Smaller bands cost more in context switches than they save
+}
 
 VideoWriter::VideoWriter(int w, int h, int m_fps_, int bitRate_, AVCodecID codecId_, AVPixelFormat pixelFormat_) :
     m_width(w),
@@ -32,9 +44,16 @@ VideoWriter::VideoWriter(int w, int h, int m_fps_, int bitRate_, AVCodecID codec
     m_outputFormat(nullptr),
     m_videoStream(nullptr),
     m_frameCount(0),
+    m_variableFrameRate(false),
+    m_lastPts(-1),
+    m_frameIndex(0),
     m_videoFrame(nullptr),
+    m_framePool(nullptr),
+    m_allocationCount(0),
     m_imgFrame(nullptr),
-    m_imgConversionContext(nullptr)
+    m_imgConversionContext(nullptr),
+    m_captureConversionContext(nullptr),
+    m_frameConversionContext(nullptr)
 {}
 
 VideoWriter::~VideoWriter()
@@ -74,6 +93,9 @@ bool VideoWriter::open(std::string fileName)
 	}
 
     m_formatContext->oformat = m_outputFormat;
+
+    // AVI has no timestamps of its own, a frame's position in the file is its time
+    m_variableFrameRate = !(m_outputFormat->flags & AVFMT_NOTIMESTAMPS) && strcmp(m_outputFormat->name, "avi") != 0;
     _snprintf(m_formatContext->filename, sizeof(m_formatContext->filename), "%s", fileName.c_str());
 
     // add the audio and video streams using the default format codecs and initialize the codecs
@@ -108,14 +130,26 @@ bool VideoWriter::open(std::string fileName)
     // write the stream header, if any
     avformat_write_header(m_formatContext, nullptr);
 
+    m_lastPts = -1;
+    m_frameIndex = 0;
+
 	return true;
 }
 
+int VideoWriter::getAllocationCount()
+{
+    return m_allocationCount;
+}
+
 void VideoWriter::close()
 {
     if (!m_formatContext)
 		return;
 
+    // Drain frames still held by the encoder
+    if (m_videoStream)
+        writeBufferedFrames(m_videoStream);
+
 	/* write the trailer, if any.  the trailer must be written
 	* before you close the CodecContexts open when you wrote the
 	* header; otherwise write_trailer may try to use memory that
@@ -164,6 +198,16 @@ int VideoWriter::getBitRate()
     return m_bitRate;
 }
 
+int VideoWriter::getWidth()
+{
+    return m_width;
+}
+
+int VideoWriter::getHeight()
+{
+    return m_height;
+}
+
 bool VideoWriter::setBitRate(int bitRate_)
 {
     if (isOpen() || bitRate_ <= 0)
@@ -180,13 +224,215 @@ bool VideoWriter::writeVideoFrame(std::string fileName, int64_t time)
 
 bool VideoWriter::writeVideoFrame(const QImage& img, int64_t time)
 {
-    qint64 start = 1000 * av_stream_get_end_pts(m_videoStream) * m_videoStream->time_base.num / m_videoStream->time_base.den;
-    frameReadImage(m_videoFrame, img);
-    writeVideoFrame(m_videoStream, m_videoFrame, time);
-    writeBufferedFrames(m_videoStream);
-    qDebug() << "VW pts\t" << 1000 * av_stream_get_end_pts(m_videoStream) * m_videoStream->time_base.num / m_videoStream->time_base.den - start << " ms";
+    {
+        ProfileScope scope("Convert");
+        if (!prepareFrame(m_videoFrame) || !frameReadImage(m_videoFrame, img))
+            return false;
+    }
 
-	return true;
+    ProfileScope scope("Encode");
+    return writeVideoFrame(m_videoStream, m_videoFrame, time);
+}
+
+bool VideoWriter::writeVideoFrame(const QImage& img)
+{
+    // From the frame index so that rates like 30 fps don't drift at ms precision
+    return writeVideoFrame(img, av_rescale(m_frameIndex++, 1000, m_fps));
+}
+
+AVFrame* VideoWriter::createVideoFrame()
+{
+    return isOpen() ? allocatePooledFrame() : nullptr;
+}
+
+void VideoWriter::destroyVideoFrame(AVFrame* frame)
+{
+    freeFrame(frame);
+}
+
+bool VideoWriter::convertFrame(const uchar* pixels, int width, int height, int stride, AVFrame* frame)
+{
+    if (!prepareFrame(frame))
+        return false;
+
+    // The source is read once, in place, a negative stride flips it on the way
+    const uint8_t* src[4] = { pixels, nullptr, nullptr, nullptr };
+    int srcStride[4] = { stride, 0, 0, 0 };
+
+    return scaleCapture(src, srcStride, width, height, AV_PIX_FMT_BGRA, frame);
+}
+
+bool VideoWriter::convertFrame(const uchar* const planes[3], const int strides[3], int width, int height, AVFrame* frame)
+{
+    if (!prepareFrame(frame))
+        return false;
+
+    // At the video size only the planes are copied
+    const uint8_t* src[4] = { planes[0], planes[1], planes[2], nullptr };
+    int srcStride[4] = { strides[0], strides[1], strides[2], 0 };
+
+    return scaleCapture(src, srcStride, width, height, AV_PIX_FMT_YUV420P, frame);
+}
+
+bool VideoWriter::scaleCapture(const uint8_t* const src[4], const int srcStride[4], int width, int height, AVPixelFormat format, AVFrame* frame)
+{
+    // Only a color conversion
+    if (format == AV_PIX_FMT_BGRA && frame->format == AV_PIX_FMT_YUV420P && width == frame->width && height == frame->height &&
+        I420Converter::convert(src[0], srcStride[0], width, height, frame->data, frame->linesize))
+        return true;
+
+    ThreadPool* pool = ThreadPool::instance();
+    int bands = std::min(pool->getThreadCount() + 1, height / minBandRows);
+
+    // Scaled vertically every output row depends on several bands, one context does it all
+    if (height != frame->height || bands < 2)
+    {
+        // Kept while the capture size and format stay the same
+        m_captureConversionContext = sws_getCachedContext(m_captureConversionContext, width, height, format,
+            frame->width, frame->height, (AVPixelFormat)frame->format,
+            m_swsFlags, nullptr, nullptr, nullptr);
+
+        if (!m_captureConversionContext)
+        {
+            qDebug() << "convertFrame: Cannot initialize the conversion context\n";
+            return false;
+        }
+
+        return sws_scale(m_captureConversionContext, src, srcStride, 0, height, frame->data, frame->linesize) > 0;
+    }
+
+    // Bands start on a chroma row of both formats. Only the chroma rows
+    // next to a band edge can differ slightly from a single context.
+    int hShift;
+    int srcShift;
+    int dstShift;
+    av_pix_fmt_get_chroma_sub_sample(format, &hShift, &srcShift);
+    av_pix_fmt_get_chroma_sub_sample((AVPixelFormat)frame->format, &hShift, &dstShift);
+    int align = 1 << std::max(srcShift, dstShift);
+
+    int bandRows = ((height + bands - 1) / bands + align - 1) / align * align;
+    bands = (height + bandRows - 1) / bandRows;
+
+    if ((int)m_bandConversionContexts.size() < bands)
+        m_bandConversionContexts.resize(bands, nullptr);
+
+    // Set up here, context initialization is not thread safe
+    for (int b = 0; b < bands; ++b)
+    {
+        int rows = std::min(bandRows, height - b * bandRows);
+        m_bandConversionContexts[b] = sws_getCachedContext(m_bandConversionContexts[b], width, rows, format,
+            frame->width, rows, (AVPixelFormat)frame->format,
+            m_swsFlags, nullptr, nullptr, nullptr);
+
+        if (!m_bandConversionContexts[b])
+        {
+            qDebug() << "convertFrame: Cannot initialize the conversion context\n";
+            return false;
+        }
+    }
+
+    std::atomic<bool> ok(true);
+
+    pool->parallelFor(bands, [&](int b)
+    {
+        int y = b * bandRows;
+        int rows = std::min(bandRows, height - y);
+
+        const uint8_t* bandSrc[4];
+        uint8_t* bandDst[4];
+
+        for (int p = 0; p < 4; ++p)
+        {
+            // Chroma planes have fewer rows, alpha as many as luma
+            int srcY = p == 1 || p == 2 ? y >> srcShift : y;
+            int dstY = p == 1 || p == 2 ? y >> dstShift : y;
+
+            bandSrc[p] = src[p] ? src[p] + (ptrdiff_t)srcY * srcStride[p] : nullptr;
+            bandDst[p] = frame->data[p] ? frame->data[p] + (ptrdiff_t)dstY * frame->linesize[p] : nullptr;
+        }
+
+        if (sws_scale(m_bandConversionContexts[b], bandSrc, srcStride, 0, rows, bandDst, frame->linesize) <= 0)
+            ok = false;
+    });
+
+    return ok;
+}
+
+bool VideoWriter::writeVideoFrame(AVFrame* frame, int64_t time)
+{
+    ProfileScope scope("Encode");
+    return writeVideoFrame(m_videoStream, frame, time);
+}
+
+bool VideoWriter::canEncodeToPackets()
+{
+    // The packet would point into the frame, which is reused once it is encoded
+    return isOpen() && !(m_formatContext->oformat->flags & AVFMT_RAWPICTURE);
+}
+
+bool VideoWriter::encodeVideoFrame(AVFrame* frame, int64_t time, std::vector<AVPacket*>& packets)
+{
+    ProfileScope scope("Encode");
+
+    if (!canEncodeToPackets())
+        return false;
+
+    if (!setFramePts(m_videoStream, frame, time))
+        return true;
+
+    AVPacket* pkt = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lck(m_packetMutex);
+        if (!m_freePackets.empty())
+        {
+            pkt = m_freePackets.back();
+            m_freePackets.pop_back();
+        }
+    }
+
+    if (!pkt)
+    {
+        pkt = av_packet_alloc();
+        if (!pkt)
+            return false;
+
+        ++m_allocationCount;
+    }
+
+    int ret = encodePacket(m_videoStream, frame, pkt);
+    if (ret == 0)
+        packets.push_back(pkt);
+    else
+    {
+        std::lock_guard<std::mutex> lck(m_packetMutex);
+        m_freePackets.push_back(pkt);
+    }
+
+    return ret >= 0;
+}
+
+bool VideoWriter::writePacket(AVPacket* pkt)
+{
+    ProfileScope scope("Mux");
+
+    // Takes the packet's data, the empty packet is kept for the next one
+    int ret = av_interleaved_write_frame(m_formatContext, pkt);
+    av_packet_unref(pkt);
+
+    {
+        std::lock_guard<std::mutex> lck(m_packetMutex);
+        m_freePackets.push_back(pkt);
+    }
+
+    if (ret < 0)
+    {
+        qDebug() << "Error " << ret << " while writing video frame\n";
+        return false;
+    }
+
+    m_frameCount++;
+    return true;
 }
 
 AVStream* VideoWriter::openVideo(AVCodecID codec_id)
@@ -214,9 +460,9 @@ AVStream* VideoWriter::openVideo(AVCodecID codec_id)
 	/* time base: this is the fundamental unit of time (in seconds) in terms
     of which frame timestamps are represented. for fixed-m_fps content,
 	timebase should be 1/framerate and timestamp increments should be
-	identically 1. */
+	identically 1. Variable rate frames carry their capture time in ms. */
 	st->time_base.num = 1;
-    st->time_base.den = m_fps;
+    st->time_base.den = m_variableFrameRate ? 1000 : m_fps;
     st->codecpar->format = m_pixelFormat;
 
 	// some formats want stream headers to be separate
@@ -247,7 +493,9 @@ AVStream* VideoWriter::openVideo(AVCodecID codec_id)
 
 	// frames per second
 	c->time_base.num = st->time_base.num; // 1
-    c->time_base.den = st->time_base.den; // m_fps
+    c->time_base.den = st->time_base.den; // m_fps or 1000
+    c->framerate.num = m_fps; // Nominal, for rate control
+    c->framerate.den = 1;
 
 	/* emit one intra frame every ten frames
 	* check frame pict_type before passing frame
@@ -264,8 +512,17 @@ AVStream* VideoWriter::openVideo(AVCodecID codec_id)
 		return nullptr;
 	}
 
+    // Whole frames in one buffer each, aligned like av_image_alloc()
+    m_allocationCount = 0;
+    m_framePool = av_buffer_pool_init2(av_image_get_buffer_size(c->pix_fmt, c->width, c->height, 32), this, allocatePoolBuffer, nullptr);
+    if (!m_framePool)
+    {
+        qDebug() << "Could not create the frame pool\n";
+        return nullptr;
+    }
+
 	// allocate the encoded raw picture
-    m_videoFrame = allocateFrame(c);
+    m_videoFrame = allocatePooledFrame();
     if (!m_videoFrame)
 	{
         qDebug() << "Could not allocate picture\n";
@@ -313,6 +570,29 @@ void VideoWriter::closeVideo(AVStream *st)
         sws_freeContext(m_imgConversionContext);
         m_imgConversionContext = nullptr;
     }
+
+    if (m_captureConversionContext)
+    {
+        sws_freeContext(m_captureConversionContext);
+        m_captureConversionContext = nullptr;
+    }
+
+    for (SwsContext* context : m_bandConversionContexts)
+        sws_freeContext(context);
+    m_bandConversionContexts.clear();
+
+    if (m_frameConversionContext)
+    {
+        sws_freeContext(m_frameConversionContext);
+        m_frameConversionContext = nullptr;
+    }
+
+    // Freed once the last buffer returns, frames may outlive the stream
+    av_buffer_pool_uninit(&m_framePool);
+
+    for (AVPacket* pkt : m_freePackets)
+        av_packet_free(&pkt);
+    m_freePackets.clear();
 }
 
 AVFrame* VideoWriter::allocateFrame(int w, int h, AVPixelFormat pixFmt)
@@ -344,23 +624,80 @@ AVFrame* VideoWriter::allocateFrame(AVCodecContext* c)
 	return allocateFrame(c->width, c->height, c->pix_fmt);
 }
 
+AVFrame* VideoWriter::allocatePooledFrame()
+{
+    AVFrame* frame = av_frame_alloc();
+    if (!frame)
+        return nullptr;
+
+    if (!attachPoolBuffer(frame))
+    {
+        av_frame_free(&frame);
+        return nullptr;
+    }
+
+    return frame;
+}
+
+bool VideoWriter::prepareFrame(AVFrame* frame)
+{
+    // Only this frame refers to the buffer once the encoder is done with it
+    if (frame->buf[0] && av_buffer_is_writable(frame->buf[0]))
+        return true;
+
+    av_frame_unref(frame);
+    return attachPoolBuffer(frame);
+}
+
+bool VideoWriter::attachPoolBuffer(AVFrame* frame)
+{
+    AVCodecContext* c = m_videoStream ? m_videoStream->codec : nullptr;
+    if (!c || !m_framePool)
+        return false;
+
+    frame->buf[0] = av_buffer_pool_get(m_framePool);
+    if (!frame->buf[0])
+    {
+        qDebug() << "Could not get a frame buffer\n";
+        return false;
+    }
+
+    frame->format = c->pix_fmt;
+    frame->width = c->width;
+    frame->height = c->height;
+
+    av_image_fill_arrays(frame->data, frame->linesize, frame->buf[0]->data, c->pix_fmt, c->width, c->height, 32);
+    return true;
+}
+
+AVBufferRef* VideoWriter::allocatePoolBuffer(void* writer, int size)
+{
+    ++static_cast<VideoWriter*>(writer)->m_allocationCount;
+    return av_buffer_alloc(size);
+}
+
 void VideoWriter::freeFrame(AVFrame* f)
 {
 	if (!f)
 		return;
 
-	av_free(f->data[0]);
-	av_free(f);
+    // Pooled buffers go back to the pool
+    if (!f->buf[0])
+        av_freep(&f->data[0]);
+    av_frame_free(&f);
 }
 
 int VideoWriter::writeVideoFrame(AVStream* st, AVFrame* frame)
 {
-	int outSize;
 	int ret;
 
-	if (!frame || st->codec->pix_fmt != (AVPixelFormat)frame->format)
+	// A null frame drains the encoder
+	if (frame && st->codec->pix_fmt != (AVPixelFormat)frame->format)
 		return -1; // Fail
 
+    if (!frame && m_formatContext->oformat->flags & AVFMT_RAWPICTURE)
+        return 1; // Nothing buffered
+
 	AVPacket pkt;
 	av_init_packet(&pkt);
 
@@ -373,6 +710,7 @@ int VideoWriter::writeVideoFrame(AVStream* st, AVFrame* frame)
 		pkt.stream_index = st->index;
 		pkt.data = (uint8_t*) frame;
 		pkt.size = sizeof(AVPicture);
+		pkt.pts = pkt.dts = frame->pts;
 
 		if (pkt.pts != AV_NOPTS_VALUE)
 			pkt.pts = av_rescale_q(pkt.pts, st->codec->time_base, st->time_base);
@@ -384,39 +722,14 @@ int VideoWriter::writeVideoFrame(AVStream* st, AVFrame* frame)
 	}
 	else
 	{
-		// encode the image
-		int gotPacket;
-
-		pkt.data = nullptr;
-		pkt.size = 0;
+		ret = encodePacket(st, frame, &pkt);
 
-		outSize = avcodec_encode_video2(st->codec, &pkt, frame, &gotPacket);
-
-		if (outSize < 0)
-		{
-			std::cerr << "Error " << outSize << " encoding frame\n";
+		if (ret < 0)
 			return -1;
-		}
-
-		// if zero size, it means the image was buffered
-        if (gotPacket)
-		{
-            if (pkt.pts != AV_NOPTS_VALUE)
-                pkt.pts = av_rescale_q(pkt.pts, st->codec->time_base, st->time_base);
-
-            if (pkt.dts != AV_NOPTS_VALUE)
-                pkt.dts = av_rescale_q(pkt.dts, st->codec->time_base, st->time_base);
-
-			if (st->codec->coded_frame->key_frame)
-				pkt.flags |= AV_PKT_FLAG_KEY;
-
-            pkt.stream_index = st->index;
 
-			// write the compressed frame in the media file
+		// write the compressed frame in the media file
+        if (ret == 0)
             ret = av_interleaved_write_frame(m_formatContext, &pkt);
-		}
-        else
-            ret = 1;
 	}
 
 	if (ret < 0)
@@ -431,20 +744,64 @@ int VideoWriter::writeVideoFrame(AVStream* st, AVFrame* frame)
 	return ret;
 }
 
-bool VideoWriter::writeVideoFrames(AVStream* st, AVFrame* frame, int frames)
+int VideoWriter::encodePacket(AVStream* st, AVFrame* frame, AVPacket* pkt)
 {
-	for (int i = 0; i < frames; ++i)
+	int gotPacket;
+
+	pkt->data = nullptr;
+	pkt->size = 0;
+
+	int outSize = avcodec_encode_video2(st->codec, pkt, frame, &gotPacket);
+
+	if (outSize < 0)
 	{
-		if (writeVideoFrame(st, frame) < 0)
-			return false;
+		std::cerr << "Error " << outSize << " encoding frame\n";
+		return -1;
 	}
 
-	return true;
+	// if zero size, it means the image was buffered
+	if (!gotPacket)
+		return 1;
+
+    if (pkt->pts != AV_NOPTS_VALUE)
+        pkt->pts = av_rescale_q(pkt->pts, st->codec->time_base, st->time_base);
+
+    if (pkt->dts != AV_NOPTS_VALUE)
+        pkt->dts = av_rescale_q(pkt->dts, st->codec->time_base, st->time_base);
+
+	if (st->codec->coded_frame->key_frame)
+		pkt->flags |= AV_PKT_FLAG_KEY;
+
+    pkt->stream_index = st->index;
+    return 0;
+}
+
+bool VideoWriter::setFramePts(AVStream* st, AVFrame* frame, int64_t time)
+{
+    // Rounded to the nearest tick of the codec time base
+    int64_t pts = av_rescale_q(time, AVRational{ 1, 1000 }, st->codec->time_base);
+
+    if (pts <= m_lastPts)
+    {
+        // At the fixed rate only the first frame of a tick is kept, the muxer
+        // fills gaps by repeating the previous frame instead
+        if (!m_variableFrameRate)
+            return false;
+
+        pts = m_lastPts + 1;
+    }
+
+    frame->pts = pts;
+    m_lastPts = pts;
+    return true;
 }
 
 bool VideoWriter::writeVideoFrame(AVStream* st, AVFrame* frame, int64_t time)
 {
-    return writeVideoFrames(st, frame, time * m_fps / 1000);
+    if (!setFramePts(st, frame, time))
+        return true;
+
+    return writeVideoFrame(st, frame) >= 0;
 }
 
 bool VideoWriter::writeBufferedFrames(AVStream* st)
@@ -457,27 +814,30 @@ bool VideoWriter::writeBufferedFrames(AVStream* st)
 
 bool VideoWriter::convertVideoFrame(AVCodecContext* c, AVFrame* srcFrame, AVFrame* dstFrame)
 {
-	SwsContext* conversionContext = sws_getContext(srcFrame->width, srcFrame->height,
+    // Kept while the source size and format stay the same
+    m_frameConversionContext = sws_getCachedContext(m_frameConversionContext, srcFrame->width, srcFrame->height,
 		(AVPixelFormat)srcFrame->format,
 		c->width, c->height,
 		c->pix_fmt,
         m_swsFlags, nullptr, nullptr, nullptr);
 
-	if (conversionContext == nullptr)
+	if (m_frameConversionContext == nullptr)
 	{
         qDebug() << "Cannot initialize the conversion context\n";
 		return false;
 	}
 
-	int ret = sws_scale(conversionContext, srcFrame->data, srcFrame->linesize, 0, srcFrame->height, dstFrame->data, dstFrame->linesize);
-
-	sws_freeContext(conversionContext);
-
-	return ret > 0;
+	return sws_scale(m_frameConversionContext, srcFrame->data, srcFrame->linesize, 0, srcFrame->height, dstFrame->data, dstFrame->linesize) > 0;
 }
 
 bool VideoWriter::frameReadImage(AVFrame* frame, const QImage& img)
 {
+    // 32 bit images are BGRA in memory, at the video size they are converted in place
+    bool bgra = img.format() == QImage::Format_RGB32 || img.format() == QImage::Format_ARGB32 || img.format() == QImage::Format_ARGB32_Premultiplied;
+    if (bgra && frame->format == AV_PIX_FMT_YUV420P && img.width() == frame->width && img.height() == frame->height &&
+        I420Converter::convert(img.constBits(), img.bytesPerLine(), img.width(), img.height(), frame->data, frame->linesize))
+        return true;
+
     if (!m_imgFrame || m_imgFrame->width != img.width() || m_imgFrame->height != img.height() || !m_imgConversionContext)
 	{
         freeFrame(m_imgFrame);
@@ -501,7 +861,11 @@ bool VideoWriter::frameReadImage(AVFrame* frame, const QImage& img)
 	}
 
     //if (!img.hasAlphaChannel())
-        memcpy(m_imgFrame->data[0], img.constBits(), img.width() * img.height() * 4);
+    {
+        // Copy row by row, frame and image strides may differ
+        for (int y = 0; y < img.height(); ++y)
+            memcpy(m_imgFrame->data[0] + y * m_imgFrame->linesize[0], img.constScanLine(y), img.width() * 4);
+    }
     //else
     /*{
         QImage im = img.scaled(QSize(frame->width, frame->height));
@@ -526,43 +890,6 @@ bool VideoWriter::frameReadImage(AVFrame* frame, const QImage& img)
 	return true;
 }
 
-AVFrame* VideoWriter::loadFrame(const QImage& img)
-{
-	AVFrame* frame = av_frame_alloc();
-
-	if (!frame)
-		return nullptr;
-
-	frame->format = AV_PIX_FMT_RGB24;
-	frame->width = img.width();
-	frame->height = img.height();
-
-	// the image can be allocated by any means and av_image_alloc() is
-	// just the most convenient way if av_malloc() is to be used
-
-	if (av_image_alloc(frame->data, frame->linesize, frame->width, frame->height, (AVPixelFormat)frame->format, 32) < 0)
-	{
-        qDebug() << "Could not allocate raw picture buffer\n";
-		return nullptr;
-	}
-
-	int x, y;
-	QColor clr;
-
-    for (y = 0; y < img.height(); y++)
-	{
-		for (x = 0; x < img.width(); x++)
-		{
-			clr = img.pixelColor(QPoint(x, y));
-			frame->data[0][y * frame->linesize[0] + x * 3] = (uint8_t)clr.red() * clr.alpha() / 255;
-			frame->data[0][y * frame->linesize[0] + x * 3 + 1] = (uint8_t)clr.green() * clr.alpha() / 255;
-			frame->data[0][y * frame->linesize[0] + x * 3 + 2] = (uint8_t)clr.blue() * clr.alpha() / 255;
-		}
-	}
-
-	return frame;
-}
-
 AVFrame* VideoWriter::loadFrame(const std::string imageFileName)
 {
     AVFormatContext* formatCtx = nullptr;
@@ -3,7 +3,10 @@
 #ifndef VIDEOWRITER_H
 #define VIDEOWRITER_H
 
+#include <atomic>
+#include <mutex>
 #include <string>
+#include <vector>
 
 extern "C"
 {
@@ -29,11 +32,40 @@ public:
 	bool isOpen();
 	int getFps();
     int getBitRate();
+    int getWidth();
+    int getHeight();
 
     bool setBitRate(int);
 
+    // Frames are encoded once, shown from msec after the start of the video on.
+    // Containers with per frame timestamps (MKV, MP4) get them at ms precision,
+    // AVI stays at the fixed rate, the muxer repeats frames over the gaps.
 	bool writeVideoFrame(std::string, int64_t msec);
     bool writeVideoFrame(const QImage&, int64_t msec);
+    bool writeVideoFrame(const QImage&); // Exactly one frame interval after the previous one, for fixed rate output
+
+    // Frames in the video format for captures converted on another thread, see FrameSink.
+    // Only while open, destroyed before close(). Their buffers come from a pool and are
+    // reference counted, so the encoder holds on to them without a copy. A frame about to be
+    // converted into gets another buffer from the pool while the encoder still has its old one.
+    AVFrame* createVideoFrame();
+    void destroyVideoFrame(AVFrame*);
+    // BGRA captures of the video size go through I420Converter, others of the video height
+    // are converted in bands on the thread pool.
+    bool convertFrame(const uchar* pixels, int width, int height, int stride, AVFrame* frame); // BGRA, scaled to the video size
+    bool convertFrame(const uchar* const planes[3], const int strides[3], int width, int height, AVFrame* frame); // YUV 4:2:0
+    bool writeVideoFrame(AVFrame* frame, int64_t msec);
+
+    // writeVideoFrame() split in two, so that encoding and muxing run on different threads.
+    // The packets go to writePacket() in the order they were encoded, which frees them.
+    // Raw picture formats are refused, their packets point into the frame and can't wait for the muxer.
+    bool canEncodeToPackets(); // False for raw picture formats, which are written by writeVideoFrame()
+    bool encodeVideoFrame(AVFrame* frame, int64_t msec, std::vector<AVPacket*>& packets);
+    bool writePacket(AVPacket* packet);
+
+    // Frame buffers and packets allocated since open(). Steady once recording has warmed up,
+    // after that frames and packets are recycled.
+    int getAllocationCount();
 
 private:
 	// Video Stream
@@ -43,17 +75,22 @@ private:
 	// Frame
 	AVFrame* allocateFrame(int w, int h, AVPixelFormat);
 	AVFrame* allocateFrame(AVCodecContext*);
+    AVFrame* allocatePooledFrame();
+    bool prepareFrame(AVFrame*); // Before writing into a pooled frame
+    bool attachPoolBuffer(AVFrame*);
 	void freeFrame(AVFrame*);
+    static AVBufferRef* allocatePoolBuffer(void* writer, int size);
 	
 	int writeVideoFrame(AVStream* st, AVFrame* frame);
-    bool writeVideoFrames(AVStream* st, AVFrame* frame, int frames);
     bool writeVideoFrame(AVStream* st, AVFrame* frame, int64_t time);
+    int encodePacket(AVStream* st, AVFrame* frame, AVPacket* pkt); // 0 for a packet, 1 if buffered, < 0 on error
+    bool setFramePts(AVStream* st, AVFrame* frame, int64_t time); // False if the frame is skipped
 	bool writeBufferedFrames(AVStream*);
 
     bool convertVideoFrame(AVCodecContext*, AVFrame*, AVFrame*);
 	
 	bool frameReadImage(AVFrame*, const QImage&);
-	AVFrame* loadFrame(const QImage&);
+    bool scaleCapture(const uint8_t* const src[4], const int srcStride[4], int width, int height, AVPixelFormat, AVFrame*);
 	AVFrame* loadFrame(const std::string); // Load with ffmpeg
 
 	void fillYuvImage(AVFrame *pict, int frame_index); // prepare a dummy image
@@ -63,7 +100,10 @@ private:
     int m_height;
     int m_fps;
     int m_bitRate;
-    int m_frameCount;
+    std::atomic<int> m_frameCount; // Written packets, counted on the mux thread
+    bool m_variableFrameRate; // Time base of 1 ms instead of one frame
+    int64_t m_lastPts; // In codec time base, -1 before the first frame
+    int64_t m_frameIndex; // Of fixed rate frames
     AVPixelFormat m_pixelFormat;
     AVCodecID m_codecId;
 
@@ -72,9 +112,17 @@ private:
     AVStream* m_videoStream;
 	
     AVFrame* m_videoFrame; // Target format video frame
+    AVBufferPool* m_framePool; // Buffers of video frames
+    std::atomic<int> m_allocationCount;
+
+    std::mutex m_packetMutex; // Packets are freed on the mux thread
+    std::vector<AVPacket*> m_freePackets;
 
     AVFrame* m_imgFrame; // Temporary conversion frame
     SwsContext* m_imgConversionContext; // Conversion context
+    SwsContext* m_captureConversionContext; // Used by convertFrame() only
+    std::vector<SwsContext*> m_bandConversionContexts; // One per band of convertFrame()
+    SwsContext* m_frameConversionContext; // Used by convertVideoFrame() only
     int m_swsFlags;
 };
 
@@ -18,7 +18,46 @@ HEADERS += ./src/debug/CrashDump.h \
     ./src/ModelLoadDialog.h \
     ./src/ModelLoader.h \
     ./src/Renderer.h \
-    ./src/VideoRecorder.h
+    ./src/VideoRecorder.h \
+    ./src/BoundingBox.h \
+    ./src/FrameStats.h \
+    ./src/ThreadPool.h \
+    ./src/OcclusionCuller.h \
+    ./src/Camera.h \
+    ./src/RenderView.h \
+    ./src/SoftwareRasterizer.h \
+    ./src/SoftwareRenderer.h \
+    ./src/SceneRenderer.h \
+    ./src/CameraPath.h \
+    ./src/OffscreenRenderer.h \
+    ./src/HeadlessRecorder.h \
+    ./src/Bvh.h \
+    ./src/BvhBuilder.h \
+    ./src/SurfacePicker.h \
+    ./src/AoBaker.h \
+    ./src/AoBakeDialog.h \
+    ./src/ChunkFile.h \
+    ./src/ChunkBuilder.h \
+    ./src/ChunkStreamer.h \
+    ./src/ChunkedModel.h \
+    ./src/LodMetric.h \
+    ./src/GpuBudget.h \
+    ./src/PointOctree.h \
+    ./src/PointCloud.h \
+    ./src/Profiler.h \
+    ./src/GpuProfiler.h \
+    ./src/ProfilerHud.h \
+    ./src/SpscQueue.h \
+    ./src/RenderThread.h \
+    ./src/ProgramCache.h \
+    ./src/TiffWriter.h \
+    ./src/PosterRenderer.h \
+    ./src/Benchmark.h \
+    ./src/FrameSink.h \
+    ./src/YuvConverter.h \
+    ./src/I420Converter.h \
+    ./src/ConversionBenchmark.h \
+    ./src/RingBuffer.h
 
 SOURCES += ./src/debug/CrashDump.cpp \
     ./src/debug/MemoryLeaksDetection.cpp \
@@ -29,7 +68,37 @@ SOURCES += ./src/debug/CrashDump.cpp \
     ./src/ModelLoader.cpp \
     ./src/Renderer.cpp \
     ./src/VideoWriter.cpp \
-    ./src/VideoRecorder.cpp
+    ./src/VideoRecorder.cpp \
+    ./src/ThreadPool.cpp \
+    ./src/OcclusionCuller.cpp \
+    ./src/Camera.cpp \
+    ./src/SoftwareRasterizer.cpp \
+    ./src/SoftwareRenderer.cpp \
+    ./src/SceneRenderer.cpp \
+    ./src/CameraPath.cpp \
+    ./src/OffscreenRenderer.cpp \
+    ./src/HeadlessRecorder.cpp \
+    ./src/Bvh.cpp \
+    ./src/BvhBuilder.cpp \
+    ./src/SurfacePicker.cpp \
+    ./src/AoBaker.cpp \
+    ./src/AoBakeDialog.cpp \
+    ./src/ChunkBuilder.cpp \
+    ./src/ChunkStreamer.cpp \
+    ./src/ChunkedModel.cpp \
+    ./src/PointOctree.cpp \
+    ./src/PointCloud.cpp \
+    ./src/Profiler.cpp \
+    ./src/GpuProfiler.cpp \
+    ./src/ProfilerHud.cpp \
+    ./src/RenderThread.cpp \
+    ./src/ProgramCache.cpp \
+    ./src/TiffWriter.cpp \
+    ./src/PosterRenderer.cpp \
+    ./src/Benchmark.cpp \
+    ./src/YuvConverter.cpp \
+    ./src/I420Converter.cpp \
+    ./src/ConversionBenchmark.cpp
 
 LIBS += -lshell32 \
     -lopengl32 \